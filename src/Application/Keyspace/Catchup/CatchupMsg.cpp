@@ -19,6 +19,65 @@ void CatchupMsg::Commit(uint64_t paxosID_)
 	
 }
 
+void CatchupMsg::Round(uint64_t paxosID_, ByteString& round_)
+{
+	Init(CATCHUP_ROUND);
+	paxosID = paxosID_;
+	round.Set(round_);
+}
+
+void CatchupMsg::NoRounds()
+{
+	Init(CATCHUP_NO_ROUNDS);
+}
+
+void CatchupMsg::Split(ByteString& key_)
+{
+	Init(CATCHUP_SPLIT);
+	key.Set(key_);
+}
+
+void CatchupMsg::File(ByteString& name, uint64_t fileSize_)
+{
+	Init(CATCHUP_FILE);
+	key.Set(name);
+	fileSize = fileSize_;
+}
+
+void CatchupMsg::NoSnapshot()
+{
+	Init(CATCHUP_NO_SNAPSHOT);
+}
+
+void CatchupMsg::RequestFull()
+{
+	Init(CATCHUP_REQUEST_FULL);
+}
+
+void CatchupMsg::RequestRounds(uint64_t paxosID_)
+{
+	Init(CATCHUP_REQUEST_ROUNDS);
+	paxosID = paxosID_;
+}
+
+void CatchupMsg::RequestSplit(unsigned numRanges_)
+{
+	Init(CATCHUP_REQUEST_SPLIT);
+	numRanges = numRanges_;
+}
+
+void CatchupMsg::RequestRange(ByteString& key_, ByteString& endKey_)
+{
+	Init(CATCHUP_REQUEST_RANGE);
+	key.Set(key_);
+	endKey.Set(endKey_);
+}
+
+void CatchupMsg::RequestSnapshot()
+{
+	Init(CATCHUP_REQUEST_SNAPSHOT);
+}
+
 bool CatchupMsg::Read(const ByteString& data)
 {
 	int read;
@@ -33,9 +92,36 @@ bool CatchupMsg::Read(const ByteString& data)
 						   &type, &key, &value);
 			break;
 		case CATCHUP_COMMIT:
+		case CATCHUP_REQUEST_ROUNDS:
 			read = snreadf(data.buffer, data.length, "%c:%U",
 						   &type, &paxosID);
 			break;
+		case CATCHUP_ROUND:
+			read = snreadf(data.buffer, data.length, "%c:%U:%N",
+						   &type, &paxosID, &round);
+			break;
+		case CATCHUP_NO_ROUNDS:
+		case CATCHUP_NO_SNAPSHOT:
+		case CATCHUP_REQUEST_FULL:
+		case CATCHUP_REQUEST_SNAPSHOT:
+			read = snreadf(data.buffer, data.length, "%c", &type);
+			break;
+		case CATCHUP_FILE:
+			read = snreadf(data.buffer, data.length, "%c:%M:%U",
+						   &type, &key, &fileSize);
+			break;
+		case CATCHUP_SPLIT:
+			read = snreadf(data.buffer, data.length, "%c:%M",
+						   &type, &key);
+			break;
+		case CATCHUP_REQUEST_SPLIT:
+			read = snreadf(data.buffer, data.length, "%c:%u",
+						   &type, &numRanges);
+			break;
+		case CATCHUP_REQUEST_RANGE:
+			read = snreadf(data.buffer, data.length, "%c:%M:%M",
+						   &type, &key, &endKey);
+			break;
 		default:
 			return false;
 	}
@@ -52,9 +138,36 @@ bool CatchupMsg::Write(ByteString& data)
 							   type, &key, &value);
 			break;
 		case CATCHUP_COMMIT:
+		case CATCHUP_REQUEST_ROUNDS:
 			return data.Writef("%c:%U",
 							   type, paxosID);
 			break;
+		case CATCHUP_ROUND:
+			return data.Writef("%c:%U:%M",
+							   type, paxosID, &round);
+			break;
+		case CATCHUP_NO_ROUNDS:
+		case CATCHUP_NO_SNAPSHOT:
+		case CATCHUP_REQUEST_FULL:
+		case CATCHUP_REQUEST_SNAPSHOT:
+			return data.Writef("%c", type);
+			break;
+		case CATCHUP_FILE:
+			return data.Writef("%c:%M:%U",
+							   type, &key, fileSize);
+			break;
+		case CATCHUP_SPLIT:
+			return data.Writef("%c:%M",
+							   type, &key);
+			break;
+		case CATCHUP_REQUEST_SPLIT:
+			return data.Writef("%c:%u",
+							   type, numRanges);
+			break;
+		case CATCHUP_REQUEST_RANGE:
+			return data.Writef("%c:%M:%M",
+							   type, &key, &endKey);
+			break;
 		default:
 			return false;
 	}
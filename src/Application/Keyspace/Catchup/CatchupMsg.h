@@ -6,6 +6,18 @@
 
 #define CATCHUP_KEY_VALUE	'k'
 #define CATCHUP_COMMIT		'c'
+#define CATCHUP_ROUND		'p'
+#define CATCHUP_NO_ROUNDS	'n'
+#define CATCHUP_SPLIT		's'
+#define CATCHUP_FILE		'b'	// followed by the contents of the file
+#define CATCHUP_NO_SNAPSHOT	'o'
+
+// sent by the reader after connecting, older readers send nothing
+#define CATCHUP_REQUEST_FULL	'f'
+#define CATCHUP_REQUEST_ROUNDS	'r'
+#define CATCHUP_REQUEST_SPLIT	'x'
+#define CATCHUP_REQUEST_RANGE	'g'
+#define CATCHUP_REQUEST_SNAPSHOT	'h'
 
 class CatchupMsg
 {
@@ -14,12 +26,26 @@ typedef ByteArray<KEYSPACE_VAL_SIZE> ValBuffer;
 public:
 	char		type;
 	KeyBuffer	key;
+	KeyBuffer	endKey;		// end of a range, empty for the last one
 	ValBuffer	value;
 	uint64_t	paxosID;
+	ByteString	round;		// not copied when reading
+	unsigned	numRanges;
+	uint64_t	fileSize;	// the file name is in key
 	
 	void		Init(char type_);
 	void		KeyValue(ByteString& key_, ByteString& value_);
 	void		Commit(uint64_t paxosID);
+	void		Round(uint64_t paxosID, ByteString& round_);
+	void		NoRounds();
+	void		Split(ByteString& key_);
+	void		File(ByteString& name, uint64_t fileSize);
+	void		NoSnapshot();
+	void		RequestFull();
+	void		RequestRounds(uint64_t paxosID);
+	void		RequestSplit(unsigned numRanges);
+	void		RequestRange(ByteString& key_, ByteString& endKey_);
+	void		RequestSnapshot();
 
 	bool		Read(const ByteString& data);
 	bool		Write(ByteString& data);
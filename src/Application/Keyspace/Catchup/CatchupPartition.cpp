@@ -0,0 +1,207 @@
+#include "CatchupPartition.h"
+#include "CatchupReader.h"
+#include "System/IO/IOProcessor.h"
+#include "Framework/AsyncDatabase/AsyncDatabase.h"
+
+CatchupPartition::CatchupPartition() :
+apply(this, &CatchupPartition::Apply),
+onApplyComplete(this, &CatchupPartition::OnApplyComplete)
+{
+	applying = false;
+	committed = false;
+	aborted = false;
+}
+
+void CatchupPartition::Init(CatchupReader* reader_)
+{
+	reader = reader_;
+
+	// a key-value may be added when the batch is almost full
+	if (!batches[0].Allocate(CATCHUP_BATCH_SIZE + KEYSPACE_BUF_SIZE) ||
+		!batches[1].Allocate(CATCHUP_BATCH_SIZE + KEYSPACE_BUF_SIZE))
+			ASSERT_FAIL();
+}
+
+void CatchupPartition::Start(Endpoint& endpoint, Table* table_,
+Table* expiryTable_, ByteString& startKey, ByteString& endKey)
+{
+	Log_Trace("startKey = %.*s, endKey = %.*s",
+			  startKey.length, startKey.buffer, endKey.length, endKey.buffer);
+
+	table = table_;
+	expiryTable = expiryTable_;
+	transaction.Set(table);
+
+	msg.RequestRange(startKey, endKey);
+	if (!msg.Write(requestData) || !request.Writef("%M", &requestData))
+		ASSERT_FAIL();
+
+	reading = 0;
+	batches[0].length = 0;
+	batches[1].length = 0;
+	applying = false;
+	applyFailed = false;
+	committed = false;
+	aborted = false;
+	paxosID = 0;
+	running = true;
+
+	Connect(endpoint, CATCHUP_CONNECT_TIMEOUT);
+}
+
+void CatchupPartition::Abort()
+{
+	aborted = true;
+	if (state != DISCONNECTED)
+		Close();
+}
+
+bool CatchupPartition::IsComplete()
+{
+	return committed && !applying && batches[reading].length == 0;
+}
+
+void CatchupPartition::OnMessageRead(const ByteString& message)
+{
+	ByteString* batch;
+	int			len;
+
+	if (!msg.Read(message))
+		return;
+
+	if (msg.type == CATCHUP_KEY_VALUE)
+	{
+		batch = &batches[reading];
+		len = snwritef(batch->buffer + batch->length, batch->size - batch->length,
+					   "%M%M", &msg.key, &msg.value);
+		if (len < 0 || (unsigned) len > batch->size - batch->length)
+			ASSERT_FAIL();
+		batch->length += len;
+
+		if (batch->length >= CATCHUP_BATCH_SIZE)
+		{
+			// reading goes on only while the other batch is applied
+			if (!applying)
+				Flush();
+			else
+				Stop();
+		}
+	}
+	else if (msg.type == CATCHUP_COMMIT)
+	{
+		Log_Trace("paxosID = %" PRIu64, msg.paxosID);
+
+		paxosID = msg.paxosID;
+		committed = true;
+		Close();
+
+		if (!applying)
+		{
+			if (batches[reading].length > 0)
+				Flush();
+			else
+				reader->OnPartitionComplete();
+		}
+	}
+	else
+		OnClose();
+}
+
+void CatchupPartition::OnClose()
+{
+	Log_Trace();
+
+	if (state == DISCONNECTED)
+		return;
+
+	Close();
+	reader->OnPartitionFailed();
+}
+
+void CatchupPartition::OnConnect()
+{
+	Log_Trace();
+
+	TCPConn<>::OnConnect();
+
+	Write(request.buffer, request.length);
+
+	AsyncRead();
+}
+
+void CatchupPartition::OnConnectTimeout()
+{
+	Log_Trace();
+
+	OnClose();
+}
+
+void CatchupPartition::Flush()
+{
+	applying = true;
+	reading = 1 - reading;
+	dbWriter.Execute(&apply);
+}
+
+// runs on the dbWriter thread
+void CatchupPartition::Apply()
+{
+	ByteString	data;
+	ByteString	key;
+	ByteString	value;
+	int			read;
+	bool		ret;
+
+	data.Set(batches[1 - reading]);
+
+	ret = transaction.Begin();
+	while (ret && data.length > 0)
+	{
+		read = snreadf(data.buffer, data.length, "%N%N", &key, &value);
+		if (read < 0)
+		{
+			ret = false;
+			break;
+		}
+		if (key.length > 2 && key.buffer[0] == '!' && key.buffer[1] == '!')
+			ret &= expiryTable->Set(&transaction, key, value);
+		else if (!(key.length > 2 && key.buffer[0] == '@' && key.buffer[1] == '@'))
+			ret &= table->Set(&transaction, key, value);
+		data.Advance(read);
+	}
+
+	if (ret)
+		ret = transaction.Commit();
+	else if (transaction.IsActive())
+		transaction.Rollback();
+
+	applyFailed = !ret;
+	IOProcessor::Complete(&onApplyComplete);
+}
+
+void CatchupPartition::OnApplyComplete()
+{
+	Log_Trace();
+
+	applying = false;
+	batches[1 - reading].length = 0;
+
+	if (aborted || applyFailed)
+	{
+		Abort();
+		reader->OnPartitionFailed();
+		return;
+	}
+
+	if (batches[reading].length >= CATCHUP_BATCH_SIZE ||
+		(committed && batches[reading].length > 0))
+	{
+		Flush();
+		if (!committed && !running)
+			Continue();
+		return;
+	}
+
+	if (committed)
+		reader->OnPartitionComplete();
+}
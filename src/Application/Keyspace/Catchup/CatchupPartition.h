@@ -0,0 +1,64 @@
+#ifndef CATCHUPPARTITION_H
+#define CATCHUPPARTITION_H
+
+#include "Framework/Transport/MessageConn.h"
+#include "Framework/Database/Table.h"
+#include "Framework/Database/Transaction.h"
+#include "Application/Keyspace/Database/KeyspaceConsts.h"
+#include "CatchupMsg.h"
+
+#define CATCHUP_BATCH_SIZE	(1*MB)
+
+class CatchupReader;
+
+/*
+ * Receives one key range of a partitioned catchup. Key-values are
+ * collected into a batch, which is applied on the dbWriter thread
+ * while the next batch is read from the network.
+ */
+
+class CatchupPartition : public MessageConn<>
+{
+	typedef MFunc<CatchupPartition> Func;
+public:
+	CatchupPartition();
+
+	void			Init(CatchupReader* reader);
+	void			Start(Endpoint& endpoint, Table* table, Table* expiryTable,
+						  ByteString& startKey, ByteString& endKey);
+	void			Abort();
+
+	bool			IsApplying() { return applying; }
+	bool			IsComplete();
+	uint64_t		GetPaxosID() { return paxosID; }
+
+	void			OnMessageRead(const ByteString& message);
+	void			OnClose();
+	virtual void	OnConnect();
+	virtual void	OnConnectTimeout();
+
+	void			Apply();
+	void			OnApplyComplete();
+
+private:
+	void			Flush();
+
+	CatchupReader*	reader;
+	Table*			table;
+	Table*			expiryTable;
+	Transaction		transaction;
+	CatchupMsg		msg;
+	ByteBuffer		request;
+	ByteBuffer		requestData;
+	ByteBuffer		batches[2];
+	unsigned		reading;	// the other batch is applied
+	bool			applying;
+	bool			applyFailed;
+	bool			committed;
+	bool			aborted;
+	uint64_t		paxosID;
+	Func			apply;
+	Func			onApplyComplete;
+};
+
+#endif
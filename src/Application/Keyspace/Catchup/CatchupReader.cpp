@@ -1,18 +1,59 @@
 #include "CatchupReader.h"
 #include "Framework/ReplicatedLog/ReplicatedConfig.h"
+#include "Framework/ReplicatedLog/ReplicatedLogMsg.h"
+#include "Framework/Paxos/PaxosAcceptor.h"
 #include "Application/Keyspace/Database/ReplicatedKeyspaceDB.h"
+#include "System/Config.h"
 
-void CatchupReader::Init(ReplicatedKeyspaceDB* keyspaceDB_, Table* table_)
+CatchupReader::CatchupReader()
 {
+	partitions = NULL;
+	splitting = false;
+	partitioned = false;
+	numSplits = 0;
+	snapshotting = false;
+}
+
+CatchupReader::~CatchupReader()
+{
+	delete[] partitions;
+}
+
+void CatchupReader::Init(ReplicatedKeyspaceDB* keyspaceDB_, Table* table_,
+Table* expiryTable_)
+{
+	unsigned i;
+	
 	keyspaceDB = keyspaceDB_;
 	table = table_;
+	expiryTable = expiryTable_;
 	
 	transaction.Set(table);
+	snapshot.Init(this);
+	
+	// a full copy is split into this many key ranges, each one read
+	// on its own connection
+	numStreams = MAX(1, Config::GetIntValue("keyspace.catchupStreams", 1));
+	if (numStreams > 1)
+	{
+		partitions = new CatchupPartition[numStreams];
+		for (i = 0; i < numStreams; i++)
+			partitions[i].Init(this);
+		if (!splits.Allocate(numStreams * (KEYSPACE_KEY_SIZE + 16)))
+			ASSERT_FAIL();
+	}
 }
 
 void CatchupReader::Shutdown()
 {
-	if (state != DISCONNECTED)
+	if (snapshotting)
+	{
+		snapshotting = false;
+		snapshot.Abort();
+	}
+	else if (partitioned)
+		OnPartitionFailed();
+	else if (state != DISCONNECTED)
 		OnClose();
 }
 
@@ -20,17 +61,72 @@ void CatchupReader::Start(unsigned nodeID)
 {
 	Log_Trace();
 
+	rounds = false;
+	shadow = false;
+	target = table;
+	expiryTarget = expiryTable;
+	StartCatchup(nodeID);
+}
+
+void CatchupReader::StartRounds(unsigned nodeID, uint64_t paxosID_)
+{
+	Log_Trace("paxosID = %" PRIu64, paxosID_);
+
+	rounds = true;
+	shadow = false;
+	target = table;
+	expiryTarget = expiryTable;
+	nextRound = paxosID_;
+	StartCatchup(nodeID);
+}
+
+void CatchupReader::StartShadow(unsigned nodeID, Table* shadow_,
+Table* expiryShadow)
+{
+	Log_Trace();
+
+	rounds = false;
+	shadow = true;
+	target = shadow_;
+	expiryTarget = expiryShadow;
+	StartCatchup(nodeID);
+}
+
+void CatchupReader::StartSnapshot(unsigned nodeID)
+{
+	Log_Trace();
+
+	rounds = false;
+	shadow = true;
+	target = NULL;
+	expiryTarget = NULL;
+	snapshotting = true;
+	SetEndpoint(nodeID);
+	if (!snapshot.Start(endpoint))
+		OnSnapshotFailed();
+}
+
+void CatchupReader::SetEndpoint(unsigned nodeID)
+{
+	endpoint = RCONF->GetEndpoint(nodeID);
+	endpoint.SetPort(endpoint.GetPort() + CATCHUP_PORT_OFFSET);
+}
+
+void CatchupReader::StartCatchup(unsigned nodeID)
+{
 	bool ret;
-	Endpoint endpoint;
 
 	ret = true;
 	count = 0;
+	splitting = false;
+	partitioned = false;
+	numSplits = 0;
+	splits.length = 0;
 	ret &= transaction.Begin();
 	if (!ret)
 		ASSERT_FAIL();
 
-	endpoint = RCONF->GetEndpoint(nodeID);
-	endpoint.SetPort(endpoint.GetPort() + CATCHUP_PORT_OFFSET);
+	SetEndpoint(nodeID);
 	Connect(endpoint, CATCHUP_CONNECT_TIMEOUT);
 }
 
@@ -50,9 +146,10 @@ void CatchupReader::OnClose()
 	if (transaction.IsActive())
 		transaction.Rollback();
 	
-	keyspaceDB->OnCatchupFailed();
-	
+	// closed first, the failure handler may start a new catchup
 	Close();
+	
+	keyspaceDB->OnCatchupFailed();
 }
 
 void CatchupReader::OnConnect()
@@ -61,6 +158,18 @@ void CatchupReader::OnConnect()
 
 	TCPConn<>::OnConnect();
 	
+	// the split points of a partitioned copy are asked first
+	splitting = (!rounds && numStreams > 1);
+	if (rounds)
+		msg.RequestRounds(nextRound);
+	else if (splitting)
+		msg.RequestSplit(numStreams);
+	else
+		msg.RequestFull();
+	msg.Write(requestData);
+	requestBuffer.Writef("%M", &requestData);
+	Write(requestBuffer.buffer, requestBuffer.length);
+	
 	AsyncRead();
 }
 
@@ -75,8 +184,34 @@ void CatchupReader::ProcessMsg()
 {
 //	Log_Trace();
 
-	if (msg.type == CATCHUP_KEY_VALUE)
+	if (splitting)
+	{
+		if (msg.type == CATCHUP_SPLIT)
+		{
+			OnSplit();
+			return;
+		}
+		if (msg.type == CATCHUP_COMMIT)
+		{
+			splitting = false;
+			Close();
+			StartPartitions();
+			return;
+		}
+		// an older server sends a full copy on this connection
+		splitting = false;
+	}
+
+	// an older server sends a full copy instead of the rounds, the
+	// database has not been truncated for that
+	if (msg.type == CATCHUP_KEY_VALUE && rounds)
+		OnClose();
+	else if (msg.type == CATCHUP_NO_ROUNDS)
+		OnClose();
+	else if (msg.type == CATCHUP_KEY_VALUE)
 		OnKeyValue();
+	else if (msg.type == CATCHUP_ROUND)
+		OnRound();
 	else if (msg.type == CATCHUP_COMMIT)
 		OnCommit();
 	else
@@ -87,7 +222,12 @@ void CatchupReader::OnKeyValue()
 {
 //	Log_Trace();
 
-	table->Set(&transaction, msg.key, msg.value);
+	// the keys of the expiry index start with "!!", older nodes send
+	// their own "@@" keys as well, those are dropped
+	if (msg.key.length > 2 && msg.key.buffer[0] == '!' && msg.key.buffer[1] == '!')
+		expiryTarget->Set(&transaction, msg.key, msg.value);
+	else if (!(msg.key.length > 2 && msg.key.buffer[0] == '@' && msg.key.buffer[1] == '@'))
+		target->Set(&transaction, msg.key, msg.value);
 	count++;
 	if (count % CATCHUP_COMMIT_GRANULARITY == 0)
 	{
@@ -100,11 +240,182 @@ void CatchupReader::OnCommit()
 {
 	Log_Trace();
 
-	RLOG->SetPaxosID(&transaction, msg.paxosID);
+	Complete(msg.paxosID);
+	
+	Close();
+}
+
+void CatchupReader::Complete(uint64_t paxosID)
+{
+	Log_Trace("paxosID = %" PRIu64, paxosID);
+
+	if (shadow)
+	{
+		// the paxosID is written when the shadows replace the tables
+		transaction.Commit();
+		
+		keyspaceDB->OnShadowCatchupComplete(paxosID);
+		return;
+	}
+
+	RLOG->SetPaxosID(&transaction, paxosID);
 	
 	transaction.Commit();
 	
 	keyspaceDB->OnCatchupComplete();
+}
+
+void CatchupReader::OnRound()
+{
+	ReplicatedLogMsg	rmsg;
+
+	Log_Trace("paxosID = %" PRIu64, msg.paxosID);
+
+	if (msg.paxosID != nextRound || !rmsg.Read(msg.round))
+	{
+		OnClose();
+		return;
+	}
+
+	// each round is committed together with the paxosID, so a failed
+	// catchup leaves a consistent database behind
+	if (!(rmsg.value == BS_MSG_NOP))
+	{
+		if (!keyspaceDB->ApplyCatchupRound(&transaction, msg.paxosID, rmsg.value))
+		{
+			OnClose();
+			return;
+		}
+	}
+	nextRound++;
+
+	RLOG->SetPaxosID(&transaction, nextRound);
+	transaction.Commit();
+	transaction.Begin();
+}
+
+void CatchupReader::OnSplit()
+{
+	int len;
 	
-	Close();
+	if (numSplits + 1 >= numStreams)
+		return;
+
+	len = snwritef(splits.buffer + splits.length, splits.size - splits.length,
+				   "%M", &msg.key);
+	if (len < 0 || (unsigned) len > splits.size - splits.length)
+		ASSERT_FAIL();
+	splits.length += len;
+	numSplits++;
+}
+
+void CatchupReader::StartPartitions()
+{
+	unsigned	i;
+	int			read;
+	ByteString	data;
+	ByteString	startKey;
+	ByteString	endKey;
+	
+	Log_Message("Catchup split into %u key ranges", numSplits + 1);
+	
+	// the ranges are [start, end), the first one starts with the first
+	// key, the last one ends with the last key
+	partitioned = true;
+	data.Set(splits);
+	for (i = 0; i <= numSplits; i++)
+	{
+		if (i < numSplits)
+		{
+			read = snreadf(data.buffer, data.length, "%N", &endKey);
+			if (read < 0)
+				ASSERT_FAIL();
+			data.Advance(read);
+		}
+		else
+			endKey.length = 0;
+		
+		partitions[i].Start(endpoint, target, expiryTarget, startKey, endKey);
+		startKey = endKey;
+	}
+}
+
+void CatchupReader::OnPartitionComplete()
+{
+	unsigned	i;
+	uint64_t	paxosID;
+	
+	// each range was read at a different paxosID, the rounds after the
+	// smallest one are replayed by Paxos and skip the newer values
+	paxosID = 0;
+	for (i = 0; i <= numSplits; i++)
+	{
+		if (!partitions[i].IsComplete())
+			return;
+		if (i == 0 || partitions[i].GetPaxosID() < paxosID)
+			paxosID = partitions[i].GetPaxosID();
+	}
+	
+	partitioned = false;
+	Complete(paxosID);
+}
+
+void CatchupReader::OnPartitionFailed()
+{
+	unsigned i;
+	
+	if (!partitioned)
+		return;
+
+	for (i = 0; i <= numSplits; i++)
+		partitions[i].Abort();
+	
+	// the table may be deleted when this returns
+	for (i = 0; i <= numSplits; i++)
+	{
+		if (partitions[i].IsApplying())
+			return;
+	}
+	
+	partitioned = false;
+	if (transaction.IsActive())
+		transaction.Rollback();
+	
+	keyspaceDB->OnCatchupFailed();
+}
+
+void CatchupReader::OnSnapshotComplete()
+{
+	uint64_t	paxosID;
+	bool		ret;
+	
+	snapshotting = false;
+	target = database.GetShadowTable("keyspace");
+	expiryTarget = database.GetShadowTable("expiry");
+	
+	// the rounds up to this were applied when the logs of the snapshot
+	// were written, the rest is replayed from the log cache; the other
+	// node's Paxos state is only read
+	ret = PaxosAcceptor::ReadPaxosID(database.GetShadowTable("meta"), paxosID);
+	database.DeleteShadowTable("meta");
+	if (!ret || !transaction.Begin())
+	{
+		keyspaceDB->OnSnapshotCatchupFailed();
+		return;
+	}
+	
+	Log_Message("Catchup: snapshot recovered at round %" PRIu64, paxosID);
+	
+	Complete(paxosID);
+}
+
+void CatchupReader::OnSnapshotFailed()
+{
+	Log_Trace();
+	
+	if (!snapshotting)
+		return;
+	
+	snapshotting = false;
+	keyspaceDB->OnSnapshotCatchupFailed();
 }
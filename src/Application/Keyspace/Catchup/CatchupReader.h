@@ -6,6 +6,8 @@
 #include "Framework/Database/Transaction.h"
 #include "Application/Keyspace/Database/KeyspaceConsts.h"
 #include "CatchupMsg.h"
+#include "CatchupPartition.h"
+#include "CatchupSnapshot.h"
 
 #define CATCHUP_CONNECT_TIMEOUT		2000
 #define CATCHUP_COMMIT_GRANULARITY	1000
@@ -15,25 +17,62 @@ class ReplicatedKeyspaceDB;
 class CatchupReader : public MessageConn<>
 {
 public:
-	void			Init(ReplicatedKeyspaceDB* keyspaceDB_, Table* table_);
+	CatchupReader();
+	~CatchupReader();
+
+	void			Init(ReplicatedKeyspaceDB* keyspaceDB_, Table* table_,
+						 Table* expiryTable_);
 	void			Shutdown();
 	
 	void			Start(unsigned nodeID);
+	void			StartRounds(unsigned nodeID, uint64_t paxosID);
+	void			StartShadow(unsigned nodeID, Table* shadow,
+								Table* expiryShadow);
+	void			StartSnapshot(unsigned nodeID);
 	void			OnMessageRead(const ByteString& message);
 	void			OnClose();
 	virtual void	OnConnect();
 	virtual void	OnConnectTimeout();
+	
+	void			OnPartitionComplete();
+	void			OnPartitionFailed();
+	
+	void			OnSnapshotComplete();
+	void			OnSnapshotFailed();
 
 private:
+	void			StartCatchup(unsigned nodeID);
+	void			SetEndpoint(unsigned nodeID);
 	void			ProcessMsg();
 	void			OnKeyValue();
 	void			OnCommit();
+	void			OnRound();
+	void			OnSplit();
+	void			StartPartitions();
+	void			Complete(uint64_t paxosID);
 
 	Table*			table;
+	Table*			expiryTable;
+	Table*			target;		// table or the shadow table
+	Table*			expiryTarget;
 	CatchupMsg		msg;
 	uint64_t		paxosID;
+	bool			rounds;
+	bool			shadow;
+	uint64_t		nextRound;
 	Transaction		transaction;
 	uint64_t		count; // experimental
+	ByteArray<32>	requestData;
+	ByteArray<64>	requestBuffer;
+	Endpoint		endpoint;
+	bool			splitting;
+	bool			partitioned;
+	unsigned		numStreams;
+	unsigned		numSplits;
+	ByteBuffer		splits;
+	CatchupPartition*	partitions;
+	bool			snapshotting;
+	CatchupSnapshot	snapshot;
 	ReplicatedKeyspaceDB*	keyspaceDB;
 };
 
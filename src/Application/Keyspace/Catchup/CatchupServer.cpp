@@ -1,8 +1,37 @@
 #include "CatchupServer.h"
 #include "CatchupWriter.h"
+#include "System/Config.h"
+#include "System/Events/EventLoop.h"
+#include "Framework/Database/Database.h"
+
+CatchupServer::CatchupServer() :
+onBackupStarted(this, &CatchupServer::OnBackupStarted)
+{
+	backupConn = NULL;
+	backupStarting = false;
+}
 
 void CatchupServer::Init(int port_)
 {
+	unsigned	pageSize;
+	Table*		table;
+
+	numStreams = MAX(1, Config::GetIntValue("keyspace.catchupStreams", 1));
+	
+	// MB/sec on the network and database pages/sec read by the cursors
+	maxSendBytes = MAX(0, Config::GetIntValue("keyspace.catchupBandwidth", 0));
+	maxSendBytes = maxSendBytes * MB * CATCHUP_THROTTLE_SLICE / 1000;
+	table = database.GetTable("keyspace");
+	pageSize = table->GetPageSize();
+	if (pageSize == 0)
+		pageSize = 4*KB;
+	maxReadBytes = MAX(0, Config::GetIntValue("keyspace.catchupPageRate", 0));
+	maxReadBytes = maxReadBytes * pageSize * CATCHUP_THROTTLE_SLICE / 1000;
+	sliceStart = 0;
+	sliceSendBytes = 0;
+	sliceReadBytes = 0;
+	numThrottled = 0;
+
 	if (!TCPServerT<CatchupServer, CatchupWriter>::Init(port_, CONN_BACKLOG))
 		STOP_FAIL("Cannot initialize CatchupServer", 1);
 }
@@ -14,7 +43,8 @@ void CatchupServer::Shutdown()
 
 void CatchupServer::InitConn(CatchupWriter* conn)
 {
-	if (numActive > 1)
+	// one connection per key range, and one asking for the ranges
+	if (numActive > (numStreams == 1 ? 1 : (int) numStreams + 1))
 	{
 		Log_Trace("@@@ have an active catchup connection, closing this @@@");
 		conn->Close();
@@ -24,3 +54,111 @@ void CatchupServer::InitConn(CatchupWriter* conn)
 
 	conn->Init(this);
 }
+
+bool CatchupServer::StartBackup(CatchupWriter* conn)
+{
+	if (backupConn != NULL || backupStarting)
+		return false;
+	
+	if (!database.StartBackup(&onBackupStarted))
+		return false;
+	
+	backupConn = conn;
+	backupStarting = true;
+	return true;
+}
+
+void CatchupServer::EndBackup(CatchupWriter* conn)
+{
+	if (conn != backupConn)
+		return;
+	
+	backupConn = NULL;
+	
+	// ended in OnBackupStarted()
+	if (backupStarting)
+		return;
+	
+	database.EndBackup();
+}
+
+void CatchupServer::OnBackupStarted()
+{
+	Log_Trace();
+	
+	backupStarting = false;
+	if (backupConn == NULL)
+	{
+		database.EndBackup();
+		return;
+	}
+	
+	backupConn->OnBackupStarted();
+}
+
+bool CatchupServer::IsThrottled()
+{
+	uint64_t now;
+	
+	now = EventLoop::Now();
+	if (now >= sliceStart + CATCHUP_THROTTLE_SLICE || now < sliceStart)
+	{
+		sliceStart = now;
+		sliceSendBytes = 0;
+		sliceReadBytes = 0;
+	}
+	
+	if ((maxSendBytes > 0 && sliceSendBytes >= maxSendBytes) ||
+		(maxReadBytes > 0 && sliceReadBytes >= maxReadBytes))
+	{
+		numThrottled++;
+		return true;
+	}
+	
+	return false;
+}
+
+uint64_t CatchupServer::GetThrottleDelay()
+{
+	uint64_t now;
+	
+	now = EventLoop::Now();
+	if (now >= sliceStart + CATCHUP_THROTTLE_SLICE)
+		return 1;
+	return sliceStart + CATCHUP_THROTTLE_SLICE - now;
+}
+
+void CatchupServer::OnSend(unsigned length)
+{
+	sliceSendBytes += length;
+}
+
+void CatchupServer::OnCursorRead(unsigned length)
+{
+	sliceReadBytes += length;
+}
+
+void CatchupServer::PrintStats(ByteString& text)
+{
+	CatchupWriter**	it;
+	ByteString		line;
+	
+	text.length = 0;
+	for (it = activeConns.Head(); it != NULL; it = activeConns.Next(it))
+	{
+		line.buffer = text.buffer + text.length;
+		line.size = text.size - text.length;
+		line.length = 0;
+		(*it)->PrintProgress(line);
+		text.length += line.length;
+	}
+	
+	if (activeConns.Length() > 0 && (maxSendBytes > 0 || maxReadBytes > 0))
+	{
+		line.buffer = text.buffer + text.length;
+		line.size = text.size - text.length;
+		line.length = 0;
+		line.Writef("Catchup throttled %U times\n", numThrottled);
+		text.length += line.length;
+	}
+}
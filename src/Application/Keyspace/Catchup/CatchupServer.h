@@ -8,13 +8,46 @@
 
 #define CONN_BACKLOG	2
 
+// the throttling budgets are spent in slices of this many msec
+#define CATCHUP_THROTTLE_SLICE	100
+
 class CatchupServer : public TCPServerT<CatchupServer, CatchupWriter>
 {
 public:
+	CatchupServer();
+	
 	void	Init(int port);
 	void	Shutdown();
 	
 	void	InitConn(CatchupWriter* conn);
+	
+	unsigned	GetNumStreams() { return numStreams; }
+	
+	// the budgets are shared by all catchup connections
+	bool		IsThrottled();
+	uint64_t	GetThrottleDelay();
+	void		OnSend(unsigned length);
+	void		OnCursorRead(unsigned length);
+	
+	void		PrintStats(ByteString& text);
+	
+	// one snapshot is sent at a time, the backup is ended when the
+	// connection is closed even before it started
+	bool		StartBackup(CatchupWriter* conn);
+	void		EndBackup(CatchupWriter* conn);
+	void		OnBackupStarted();
+
+private:
+	unsigned	numStreams;
+	uint64_t	maxSendBytes;	// per slice, 0 is unlimited
+	uint64_t	maxReadBytes;	// per slice, 0 is unlimited
+	uint64_t	sliceStart;
+	uint64_t	sliceSendBytes;
+	uint64_t	sliceReadBytes;
+	uint64_t	numThrottled;
+	CatchupWriter*	backupConn;
+	bool		backupStarting;
+	MFunc<CatchupServer>	onBackupStarted;
 };
 
 #endif
@@ -0,0 +1,227 @@
+#include "CatchupSnapshot.h"
+#include "CatchupReader.h"
+#include "System/IO/IOProcessor.h"
+#include "Framework/Database/Database.h"
+#include "Framework/AsyncDatabase/AsyncDatabase.h"
+
+CatchupSnapshot::CatchupSnapshot() :
+restore(this, &CatchupSnapshot::Restore),
+onRestoreComplete(this, &CatchupSnapshot::OnRestoreComplete)
+{
+	file = NULL;
+	restoring = false;
+	aborted = false;
+	restored = false;
+}
+
+void CatchupSnapshot::Init(CatchupReader* reader_)
+{
+	reader = reader_;
+}
+
+bool CatchupSnapshot::Start(Endpoint& endpoint)
+{
+	Log_Trace();
+
+	// files of an earlier attempt are removed
+	dir = database.BeginRestore();
+	if (dir == NULL)
+		return false;
+
+	msg.RequestSnapshot();
+	msg.Write(requestData);
+	requestBuffer.Writef("%M", &requestData);
+
+	fileRemaining = 0;
+	aborted = false;
+	restored = false;
+
+	Connect(endpoint, CATCHUP_CONNECT_TIMEOUT);
+	return true;
+}
+
+void CatchupSnapshot::Abort()
+{
+	aborted = true;
+	CloseFile();
+	if (state != DISCONNECTED)
+		Close();
+}
+
+void CatchupSnapshot::OnRead()
+{
+	ByteString	data;
+	ByteString	message;
+	unsigned	len;
+	int			read;
+
+	data.buffer = tcpread.data.buffer;
+	data.length = tcpread.data.length;
+	data.size = tcpread.data.size;
+
+	while (data.length > 0)
+	{
+		// the contents of a file follow its CATCHUP_FILE message
+		if (file != NULL)
+		{
+			len = (unsigned) MIN(fileRemaining, data.length);
+			if (fwrite(data.buffer, 1, len, file) != len)
+			{
+				Log_Errno();
+				OnClose();
+				return;
+			}
+			data.Advance(len);
+			fileRemaining -= len;
+			if (fileRemaining == 0)
+				CloseFile();
+			continue;
+		}
+
+		read = snreadf(data.buffer, data.length, "%N", &message);
+		if (read < 0)
+			break;
+		data.Advance(read);
+
+		if (!msg.Read(message) || !ProcessMsg())
+		{
+			OnClose();
+			return;
+		}
+
+		// closed after the last message
+		if (state != CONNECTED)
+			return;
+	}
+
+	if (data.length == tcpread.data.size)
+	{
+		Log_Trace("message too long");
+		OnClose();
+		return;
+	}
+
+	memmove(tcpread.data.buffer, data.buffer, data.length);
+	tcpread.data.length = data.length;
+	IOProcessor::Add(&tcpread);
+}
+
+bool CatchupSnapshot::ProcessMsg()
+{
+	if (msg.type == CATCHUP_FILE)
+		return OpenFile();
+
+	if (msg.type == CATCHUP_COMMIT)
+	{
+		Log_Message("Catchup: snapshot received, recovering it");
+
+		Close();
+		restoring = true;
+		dbWriter.Execute(&restore);
+		return true;
+	}
+
+	// there is no snapshot, or an older node sends the key-values
+	return false;
+}
+
+bool CatchupSnapshot::OpenFile()
+{
+	char		path[4096];
+	unsigned	i;
+
+	// only file names in the restore folder are accepted
+	if (msg.key.length == 0 || msg.key.buffer[0] == '.')
+		return false;
+	for (i = 0; i < msg.key.length; i++)
+	{
+		if (msg.key.buffer[i] == '/' || msg.key.buffer[i] == '\\')
+			return false;
+	}
+
+	snprintf(path, SIZE(path), "%s/%.*s", dir, msg.key.length, msg.key.buffer);
+
+	Log_Trace("file = %s, size = %" PRIu64, path, msg.fileSize);
+
+	file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		Log_Errno();
+		return false;
+	}
+
+	fileRemaining = msg.fileSize;
+	if (fileRemaining == 0)
+		CloseFile();
+
+	return true;
+}
+
+void CatchupSnapshot::CloseFile()
+{
+	if (file == NULL)
+		return;
+
+	fclose(file);
+	file = NULL;
+}
+
+void CatchupSnapshot::OnClose()
+{
+	Log_Trace();
+
+	if (state == DISCONNECTED)
+		return;
+
+	CloseFile();
+	Close();
+	reader->OnSnapshotFailed();
+}
+
+void CatchupSnapshot::OnConnect()
+{
+	Log_Trace();
+
+	TCPConn<>::OnConnect();
+
+	Write(requestBuffer.buffer, requestBuffer.length);
+
+	AsyncRead();
+}
+
+void CatchupSnapshot::OnConnectTimeout()
+{
+	Log_Trace();
+
+	OnClose();
+}
+
+// runs on the dbWriter thread
+void CatchupSnapshot::Restore()
+{
+	restored = database.RestoreShadowTables();
+	IOProcessor::Complete(&onRestoreComplete);
+}
+
+void CatchupSnapshot::OnRestoreComplete()
+{
+	Log_Trace();
+
+	restoring = false;
+
+	if (aborted)
+	{
+		if (restored)
+			database.DeleteShadowTables();
+		return;
+	}
+
+	if (!restored)
+	{
+		Log_Message("Catchup: cannot recover the snapshot");
+		reader->OnSnapshotFailed();
+		return;
+	}
+
+	reader->OnSnapshotComplete();
+}
@@ -0,0 +1,56 @@
+#ifndef CATCHUPSNAPSHOT_H
+#define CATCHUPSNAPSHOT_H
+
+#include <stdio.h>
+#include "Framework/Transport/TCPConn.h"
+#include "Framework/Database/Table.h"
+#include "CatchupMsg.h"
+
+class CatchupReader;
+
+/*
+ * Receives a hot backup of the other node's database: the table files
+ * and the log files, each after a CATCHUP_FILE message. They are
+ * recovered on the dbWriter thread into the shadow tables.
+ */
+
+class CatchupSnapshot : public TCPConn<>
+{
+	typedef MFunc<CatchupSnapshot> Func;
+public:
+	CatchupSnapshot();
+
+	void			Init(CatchupReader* reader);
+	bool			Start(Endpoint& endpoint);
+	void			Abort();
+
+	bool			IsRestoring() { return restoring; }
+
+	virtual void	OnRead();
+	virtual void	OnClose();
+	virtual void	OnConnect();
+	virtual void	OnConnectTimeout();
+
+	void			Restore();
+	void			OnRestoreComplete();
+
+private:
+	bool			ProcessMsg();
+	bool			OpenFile();
+	void			CloseFile();
+
+	CatchupReader*	reader;
+	CatchupMsg		msg;
+	ByteArray<32>	requestData;
+	ByteArray<64>	requestBuffer;
+	const char*		dir;
+	FILE*			file;
+	uint64_t		fileRemaining;
+	bool			restoring;
+	bool			aborted;
+	bool			restored;
+	Func			restore;
+	Func			onRestoreComplete;
+};
+
+#endif
@@ -1,11 +1,93 @@
 #include "CatchupWriter.h"
 #include <math.h>
+#ifndef PLATFORM_WINDOWS
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "CatchupServer.h"
 #include "Framework/Transport/Transport.h"
 #include "Framework/ReplicatedLog/ReplicatedLog.h"
 
-CatchupWriter::CatchupWriter()
+// keys are ordered by bytes, a prefix first, like in BDB
+static int CompareKeys(const ByteString& a, const ByteString& b)
 {
+	int cmp;
+	
+	cmp = memcmp(a.buffer, b.buffer, MIN(a.length, b.length));
+	if (cmp != 0)
+		return cmp;
+	return (int) a.length - (int) b.length;
+}
+
+static unsigned CommonPrefix(const ByteString& a, const ByteString& b)
+{
+	unsigned n;
+	
+	n = 0;
+	while (n < a.length && n < b.length && a.buffer[n] == b.buffer[n])
+		n++;
+	
+	return n;
+}
+
+// the 8 bytes after the prefix as a number, keys are assumed to be
+// spread evenly over these
+static uint64_t KeyPosition(const ByteString& key, unsigned prefix)
+{
+	unsigned	i;
+	uint64_t	x;
+	
+	x = 0;
+	for (i = prefix; i < prefix + 8; i++)
+		x = (x << 8) | (i < key.length ? (unsigned char) key.buffer[i] : 0);
+	
+	return x;
+}
+
+// returns the key at i/n between first and last
+static bool InterpolateKey(const ByteString& first, const ByteString& last,
+unsigned i, unsigned n, ByteString& key)
+{
+	unsigned	prefix;
+	unsigned	j;
+	uint64_t	a;
+	uint64_t	b;
+	uint64_t	x;
+	
+	prefix = CommonPrefix(first, last);
+	if (prefix + 8 > key.size)
+		return false;
+	
+	a = KeyPosition(first, prefix);
+	b = KeyPosition(last, prefix);
+	if (b <= a)
+		return false;
+	
+	x = a + (b - a) / n * i + (b - a) % n * i / n;
+	
+	memcpy(key.buffer, first.buffer, prefix);
+	key.length = prefix;
+	for (j = 0; j < 8; j++)
+		key.buffer[key.length++] = (char) (x >> (56 - 8 * j));
+	while (key.length > prefix + 1 && key.buffer[key.length - 1] == 0)
+		key.length--;
+	
+	return true;
+}
+
+CatchupWriter::CatchupWriter() :
+onRequestTimeout(this, &CatchupWriter::OnRequestTimeout),
+requestTimeout(CATCHUP_REQUEST_TIMEOUT, &onRequestTimeout),
+onThrottleTimeout(this, &CatchupWriter::OnThrottleTimeout),
+throttleTimeout(&onThrottleTimeout),
+onSendFile(this, &CatchupWriter::OnSendFile),
+onSendFileClose(this, &CatchupWriter::OnClose)
+{
+	file = INVALID_FD;
+	sendFile.onComplete = &onSendFile;
+	sendFile.onClose = &onSendFileClose;
 }
 
 void CatchupWriter::Init(CatchupServer* server_)
@@ -16,24 +98,261 @@ void CatchupWriter::Init(CatchupServer* server_)
 	
 	server = server_;
 	table = database.GetTable("keyspace");
+	expiryTable = database.GetTable("expiry");
+	metaTable = database.GetTable("meta");
+	
+	started = false;
+	sendRounds = false;
+	sendRange = false;
+	sendExpiry = false;
+	sendSnapshot = false;
+	sendLogs = false;
+	startTime = EventLoop::Now();
+	bytesSent = 0;
+	progressStart = 0;
+	progressEnd = 0;
+	progressPos = 0;
+	EventLoop::Reset(&requestTimeout);
+}
+
+void CatchupWriter::OnRead()
+{
+	if (!started)
+	{
+		if (ReadRequest())
+			return;
+
+		// wait for the rest of the request
+		IOProcessor::Add(&tcpread);
+		return;
+	}
+	
+	// drop anything else
+	AsyncRead();
+}
+
+void CatchupWriter::OnRequestTimeout()
+{
+	Log_Trace();
+	
+	StartFull();
+}
+
+bool CatchupWriter::ReadRequest()
+{
+	int			read;
+	ByteString	data;
+	
+	read = snreadf(tcpread.data.buffer, tcpread.data.length, "%N", &data);
+	if (read < 0)
+	{
+		if (tcpread.data.length > 2 * KEYSPACE_KEY_SIZE + 64)
+		{
+			Log_Trace("invalid catchup request");
+			OnClose();
+			return true;
+		}
+		return false;
+	}
+	
+	AsyncRead();
+	
+	// a request that does not parse gets a full catchup
+	if (!msg.Read(data))
+	{
+		StartFull();
+		return true;
+	}
+	
+	switch (msg.type)
+	{
+	case CATCHUP_REQUEST_ROUNDS:
+		StartRounds(msg.paxosID);
+		break;
+	case CATCHUP_REQUEST_SPLIT:
+		StartSplit(msg.numRanges);
+		break;
+	case CATCHUP_REQUEST_RANGE:
+		StartRange(msg.key, msg.endKey);
+		break;
+	case CATCHUP_REQUEST_SNAPSHOT:
+		StartSnapshot();
+		break;
+	default:
+		StartFull();
+		break;
+	}
+	
+	return true;
+}
 
-	if (!table->Get(NULL, "@@paxosID", paxosID))
+void CatchupWriter::StartFull()
+{
+	Log_Trace();
+	
+	started = true;
+	EventLoop::Remove(&requestTimeout);
+	
+	if (!PaxosAcceptor::ReadPaxosID(metaTable, paxosID))
 		ASSERT_FAIL();
 	
     key.Clear();
+	endKey.Clear();
+	firstKey = true;
+	sendExpiry = true;
+	InitProgress();
 	WriteNext();
 }
 
-void CatchupWriter::OnRead()
+void CatchupWriter::StartRange(ByteString& startKey, ByteString& endKey_)
 {
-	AsyncRead();
+	Log_Trace("startKey = %.*s, endKey = %.*s", startKey.length,
+			  startKey.buffer, endKey_.length, endKey_.buffer);
+	
+	started = true;
+	EventLoop::Remove(&requestTimeout);
+	
+	if (!PaxosAcceptor::ReadPaxosID(metaTable, paxosID))
+		ASSERT_FAIL();
+	
+	sendRange = true;
+	key.Set(startKey);
+	endKey.Set(endKey_);
+	firstKey = true;
+	// the first range has the expiry index as well
+	sendExpiry = (startKey.length == 0);
+	InitProgress();
+	WriteNext();
+}
+
+void CatchupWriter::StartSplit(unsigned numRanges)
+{
+	KeyBuffer	first;
+	KeyBuffer	last;
+	KeyBuffer	prev;
+	KeyBuffer	split;
+	unsigned	i;
+	bool		ret;
+	
+	Log_Trace("numRanges = %u", numRanges);
+	
+	started = true;
+	EventLoop::Remove(&requestTimeout);
+	
+	if (numRanges > server->GetNumStreams())
+		numRanges = server->GetNumStreams();
+
+	if (!PaxosAcceptor::ReadPaxosID(metaTable, paxosID))
+		ASSERT_FAIL();
+	
+	table->Iterate(NULL, cursor);
+	ret = cursor.Start(first, value);
+	ret = ret && cursor.Last(last, value);
+	cursor.Close();
+	
+	// the split points need not be exact, the ranges cover
+	// all keys anyway
+	prev.Set(first);
+	for (i = 1; ret && i < numRanges; i++)
+	{
+		if (!InterpolateKey(first, last, i, numRanges, split))
+			break;
+		if (CompareKeys(split, prev) <= 0)
+			continue;
+		msg.Split(split);
+		WriteMsg();
+		prev.Set(split);
+	}
+	
+	msg.Commit(paxosID);
+	WriteMsg();
+	WritePending();
+}
+
+void CatchupWriter::StartSnapshot()
+{
+	Log_Trace();
+	
+	started = true;
+	sendSnapshot = true;
+	EventLoop::Remove(&requestTimeout);
+
+#ifdef PLATFORM_WINDOWS
+	// the IOProcessor cannot send files here, the reader copies
+	// the key-values instead
+	msg.NoSnapshot();
+	WriteMsg();
+	WritePending();
+#else
+	if (!server->StartBackup(this))
+	{
+		Log_Message("Catchup: another snapshot is being sent");
+		msg.NoSnapshot();
+		WriteMsg();
+		WritePending();
+	}
+#endif
+}
+
+void CatchupWriter::OnBackupStarted()
+{
+	Log_Trace();
+	
+	// the reader recovers the database as of the end of the logs, this
+	// is only where the rounds are known to be applied
+	if (!PaxosAcceptor::ReadPaxosID(metaTable, paxosID))
+		ASSERT_FAIL();
+	
+	Log_Message("Catchup: sending snapshot at round %" PRIu64, paxosID);
+	
+	// the log files are listed after the tables are sent, those written
+	// meanwhile are needed for the recovery
+	if (!database.GetBackupFiles(fileNames))
+	{
+		OnClose();
+		return;
+	}
+	nextFile.Set(fileNames);
+	fileSize = 0;
+	fileSent = 0;
+	WriteNext();
+}
+
+void CatchupWriter::StartRounds(uint64_t paxosID_)
+{
+	ByteString round;
+	
+	Log_Trace("paxosID = %" PRIu64, paxosID_);
+	
+	started = true;
+	sendRounds = true;
+	nextRound = paxosID_;
+	progressStart = nextRound;
+	progressEnd = RLOG->GetPaxosID();
+	progressPos = nextRound;
+	EventLoop::Remove(&requestTimeout);
+	
+	// the reader falls back to a full copy if the rounds are
+	// no longer in the log cache
+	if (nextRound < RLOG->GetPaxosID() &&
+		!RLOG->GetCachedValue(nextRound, round))
+	{
+		Log_Message("Catchup: round %" PRIu64 " is not cached, "
+					"a full copy is needed", nextRound);
+		msg.NoRounds();
+		WriteMsg();
+		WritePending();
+		return;
+	}
+	
+	WriteNext();
 }
 
 void CatchupWriter::OnWrite()
 {
 	TCPConn<>::OnWrite();
 
-	if (msg.type == CATCHUP_COMMIT)
+	if (IsLastMsg())
 	{
 		if (BytesQueued() == 0)
 			OnClose();
@@ -45,21 +364,108 @@ void CatchupWriter::OnWrite()
 	}
 }
 
+void CatchupWriter::OnThrottleTimeout()
+{
+	Log_Trace();
+	
+	if (IsLastMsg())
+		return;
+	
+	if (BytesQueued() < MAX_TCP_MESSAGE_SIZE)
+		WriteNext();
+}
+
 void CatchupWriter::OnClose()
 {
 	Log_Trace();
 
+	EventLoop::Remove(&requestTimeout);
+	EventLoop::Remove(&throttleTimeout);
+	if (sendFile.active)
+		IOProcessor::Remove(&sendFile);
+	CloseFile();
+	if (sendSnapshot)
+		server->EndBackup(this);
 	Close();
 	server->DeleteConn(this);
 }
 
+void CatchupWriter::WriteMsg()
+{
+	msg.Write(msgData);
+	writeBuffer.Writef("%M", &msgData);
+	Write(writeBuffer.buffer, writeBuffer.length, false);
+	bytesSent += writeBuffer.length;
+	server->OnSend(writeBuffer.length);
+}
+
 void CatchupWriter::WriteNext()
+{
+	if (server->IsThrottled())
+	{
+		Throttle();
+		return;
+	}
+	
+	if (sendSnapshot)
+		WriteNextFile();
+	else if (sendRounds)
+		WriteNextRound();
+	else
+		WriteNextKeyValue();
+}
+
+void CatchupWriter::WriteNextRound()
+{
+	ByteString round;
+	
+	while (true)
+	{
+		// rounds chosen while sending are sent as well, the ones after
+		// the commit reach the reader through Paxos
+		if (nextRound >= RLOG->GetPaxosID())
+		{
+			Log_Trace("Sending commit!");
+			msg.Commit(nextRound);
+		}
+		else if (RLOG->GetCachedValue(nextRound, round))
+		{
+			server->OnCursorRead(round.length);
+			msg.Round(nextRound, round);
+			nextRound++;
+			progressPos = nextRound;
+		}
+		else
+			msg.NoRounds();
+		
+		WriteMsg();
+		if (BytesQueued() >= MAX_TCP_MESSAGE_SIZE ||
+			msg.type == CATCHUP_COMMIT || msg.type == CATCHUP_NO_ROUNDS)
+				break;
+		if (server->IsThrottled())
+		{
+			Throttle();
+			break;
+		}
+	}
+	WritePending();
+}
+
+void CatchupWriter::WriteNextKeyValue()
 {
 	bool    kv;
     bool    first;
 
-	table->Iterate(NULL, cursor);
-    first = (key.length == 0);
+	// the reader tells the expiry index apart by its "!!" prefix
+	if (sendExpiry)
+		expiryTable->Iterate(NULL, cursor);
+	else
+		table->Iterate(NULL, cursor);
+	// the pages read here are evicted first, the catchup should not
+	// push the working set out of the cache
+	cursor.SetReadOnce();
+    first = firstKey;
+    firstKey = false;
     kv = cursor.Start(key, value);
 	while(true)
 	{
@@ -67,33 +473,227 @@ void CatchupWriter::WriteNext()
             kv = cursor.Next(key, value);
         else
             first = false;
+		if (kv)
+			server->OnCursorRead(key.length + value.length);
+		if (!kv && sendExpiry)
+		{
+			// continue with the key-values of the range
+			sendExpiry = false;
+			cursor.Close();
+			key.Clear();
+			firstKey = true;
+			WriteNextKeyValue();
+			return;
+		}
+		if (kv && !sendExpiry && endKey.length > 0 && CompareKeys(key, endKey) >= 0)
+			kv = false;
 		if (!kv)
 		{
 			Log_Trace("Sending commit!");
 			msg.Commit(paxosID);
 		}
 		else
-		{
-			if (key.length > 2 && key.buffer[0] == '@' && key.buffer[1] == '@')
-			{
-				if (strncmp(key.buffer, "@@pround:", MIN(key.length, sizeof("@@pround:") - 1)) == 0)
-					msg.KeyValue(key, value);
-				else
-					continue;
-			}
-			// but write keys starting with "!!"
-			else
-				msg.KeyValue(key, value);
-		}
+			msg.KeyValue(key, value);
 
-		msg.Write(msgData);
-		writeBuffer.Writef("%M", &msgData);
-		Write(writeBuffer.buffer, writeBuffer.length, false);
-		if (BytesQueued() < MAX_TCP_MESSAGE_SIZE && msg.type != CATCHUP_COMMIT)
-			continue;
-		else
+		WriteMsg();
+		if (msg.type == CATCHUP_KEY_VALUE && !sendExpiry)
+			progressPos = KeyPosition(key, progressPrefix);
+		if (BytesQueued() >= MAX_TCP_MESSAGE_SIZE || msg.type == CATCHUP_COMMIT)
+			break;
+		if (server->IsThrottled())
+		{
+			Throttle();
 			break;
+		}
 	}
     cursor.Close();
 	WritePending();
 }
+
+// nothing is left after these
+bool CatchupWriter::IsLastMsg()
+{
+	return (msg.type == CATCHUP_COMMIT ||
+			msg.type == CATCHUP_NO_ROUNDS ||
+			msg.type == CATCHUP_NO_SNAPSHOT);
+}
+
+void CatchupWriter::WriteNextFile()
+{
+	KeyBuffer name;
+	
+	// the file goes directly to the socket, so the queued messages
+	// are written first
+	if (sendFile.active || BytesQueued() > 0)
+		return;
+	
+	if (file != INVALID_FD && fileSent < fileSize)
+	{
+		sendFile.fd = socket.fd;
+		sendFile.file = file;
+		sendFile.fileOffset = fileSent;
+		sendFile.length = (unsigned) MIN(fileSize - fileSent, CATCHUP_SENDFILE_SIZE);
+		sendFile.transferred = 0;
+		if (!IOProcessor::Add(&sendFile))
+			OnClose();
+		return;
+	}
+	CloseFile();
+	
+	if (nextFile.length == 0 && !sendLogs)
+	{
+		sendLogs = true;
+		if (!database.GetLogFiles(fileNames))
+		{
+			OnClose();
+			return;
+		}
+		nextFile.Set(fileNames);
+	}
+	
+	if (nextFile.length > 0)
+	{
+		if (!OpenNextFile(name))
+		{
+			OnClose();
+			return;
+		}
+		msg.File(name, fileSize);
+		WriteMsg();
+		WritePending();
+		return;
+	}
+	
+	server->EndBackup(this);
+	msg.Commit(paxosID);
+	WriteMsg();
+	WritePending();
+}
+
+bool CatchupWriter::OpenNextFile(ByteString& name)
+{
+	char*		newline;
+	unsigned	len;
+	
+	newline = (char*) memchr(nextFile.buffer, '\n', nextFile.length);
+	if (newline == NULL)
+		return false;
+	len = newline - nextFile.buffer;
+	if (!name.Set(nextFile.buffer, len))
+		return false;
+	nextFile.Advance(len + 1);
+	
+#ifdef PLATFORM_WINDOWS
+	return false;
+#else
+	char		path[4096];
+	struct stat	st;
+	
+	snprintf(path, SIZE(path), "%s/%.*s", database.GetDir(),
+			 name.length, name.buffer);
+	file = open(path, O_RDONLY);
+	if (file < 0 || fstat(file, &st) != 0)
+	{
+		Log_Errno();
+		CloseFile();
+		return false;
+	}
+	
+	// the file may grow meanwhile, the recovery does not need more
+	fileSize = st.st_size;
+	fileSent = 0;
+	progressStart = 0;
+	progressEnd = fileSize;
+	progressPos = 0;
+	
+	Log_Trace("file = %s, size = %" PRIu64, path, fileSize);
+	return true;
+#endif
+}
+
+void CatchupWriter::CloseFile()
+{
+#ifndef PLATFORM_WINDOWS
+	if (file != INVALID_FD)
+		close(file);
+#endif
+	file = INVALID_FD;
+}
+
+void CatchupWriter::OnSendFile()
+{
+	fileSent += sendFile.transferred;
+	progressPos = fileSent;
+	bytesSent += sendFile.transferred;
+	server->OnSend(sendFile.transferred);
+	
+	WriteNext();
+}
+
+void CatchupWriter::Throttle()
+{
+	if (throttleTimeout.IsActive())
+		return;
+	
+	throttleTimeout.SetDelay(server->GetThrottleDelay());
+	EventLoop::Add(&throttleTimeout);
+}
+
+void CatchupWriter::InitProgress()
+{
+	KeyBuffer	first;
+	KeyBuffer	last;
+	
+	// the range is [key, endKey), the table's first and last keys
+	// stand in for the open ends
+	first.Set(key);
+	last.Set(endKey);
+	table->Iterate(NULL, cursor);
+	if (first.length == 0)
+		cursor.Start(first, value);
+	if (last.length == 0)
+		cursor.Last(last, value);
+	cursor.Close();
+	
+	progressPrefix = CommonPrefix(first, last);
+	progressStart = KeyPosition(first, progressPrefix);
+	progressEnd = KeyPosition(last, progressPrefix);
+	progressPos = progressStart;
+}
+
+void CatchupWriter::PrintProgress(ByteString& text)
+{
+	uint64_t	elapsed;
+	uint64_t	rate;
+	uint64_t	eta;
+	double		done;
+	
+	elapsed = EventLoop::Now() - startTime;
+	rate = elapsed > 0 ? bytesSent * 1000 / elapsed : 0;
+	
+	if (!started)
+		done = 0;
+	else if (progressEnd <= progressStart || progressPos >= progressEnd)
+		done = 1;
+	else if (progressPos <= progressStart)
+		done = 0;
+	else
+		done = (double) (progressPos - progressStart) /
+			   (double) (progressEnd - progressStart);
+	
+	// the rate so far, scaled to what is left
+	if (done > 0)
+		eta = (uint64_t) (elapsed * (1 - done) / done / 1000);
+	else
+		eta = 0;
+	
+	text.Writef("Catchup %s: %u%% done, %U KB sent at %U KB/sec, ETA %U sec\n",
+		!started ? "waiting for request" :
+		sendSnapshot ? "of snapshot" :
+		sendRounds ? "of rounds" :
+		sendRange ? "of key range" : "of database",
+		(unsigned) (done * 100),
+		bytesSent / KB,
+		rate / KB,
+		eta);
+}
@@ -7,6 +7,12 @@
 #include "Framework/Paxos/PaxosConsts.h"
 #include "CatchupMsg.h"
 
+// older readers do not send a request, they get a full copy after this
+#define CATCHUP_REQUEST_TIMEOUT		1000
+
+// files are sent in pieces of this size, so that throttling applies
+#define CATCHUP_SENDFILE_SIZE		(1*MB)
+
 class CatchupServer;
 
 class CatchupWriter : public TCPConn<>
@@ -22,19 +28,68 @@ public:
 	void			OnRead();
 	void			OnWrite();	
 	virtual void	OnClose();
+	void			OnRequestTimeout();
+	void			OnThrottleTimeout();
+	void			OnBackupStarted();
+	void			OnSendFile();
+	void			PrintProgress(ByteString& text);
 	
 private:
+	bool			ReadRequest();
+	void			StartFull();
+	void			StartRounds(uint64_t paxosID);
+	void			StartRange(ByteString& startKey, ByteString& endKey);
+	void			StartSplit(unsigned numRanges);
+	void			StartSnapshot();
 	void			WriteNext();
+	void			WriteNextKeyValue();
+	void			WriteNextRound();
+	void			WriteNextFile();
+	bool			OpenNextFile(ByteString& name);
+	void			CloseFile();
+	bool			IsLastMsg();
+	void			WriteMsg();
+	void			Throttle();
+	void			InitProgress();
 	Buffer			writeBuffer;
 	Table*			table;
+	Table*			expiryTable;
+	Table*			metaTable;
 	Cursor			cursor;
 	CatchupMsg		msg;
 	uint64_t		paxosID;
 	KeyBuffer		key;
+	KeyBuffer		endKey;
+	bool			firstKey;
 	ValBuffer		value;
 	CatchupServer*	server;
 	ByteArray<32>	prefix;
 	ByteArray<MAX_TCP_MESSAGE_SIZE> msgData;
+	bool			started;
+	bool			sendRounds;
+	bool			sendRange;
+	bool			sendExpiry;	// the expiry index before the key-values
+	bool			sendSnapshot;
+	bool			sendLogs;
+	uint64_t		nextRound;
+	MFunc<CatchupWriter>	onRequestTimeout;
+	CdownTimer		requestTimeout;
+	MFunc<CatchupWriter>	onThrottleTimeout;
+	CdownTimer		throttleTimeout;
+	uint64_t		startTime;
+	uint64_t		bytesSent;
+	unsigned		progressPrefix;
+	uint64_t		progressStart;
+	uint64_t		progressEnd;
+	uint64_t		progressPos;
+	TCPSendFile		sendFile;
+	MFunc<CatchupWriter>	onSendFile;
+	MFunc<CatchupWriter>	onSendFileClose;
+	ByteBuffer		fileNames;	// separated by newlines
+	ByteString		nextFile;	// the rest of fileNames
+	FD				file;
+	uint64_t		fileSize;
+	uint64_t		fileSent;
 
 };
 
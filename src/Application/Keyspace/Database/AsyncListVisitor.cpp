@@ -92,16 +92,8 @@ void AsyncVisitorCallback::Execute()
 				tmp.buffer = valuebuf.buffer + valuepos[i];
 				tmp.size = valuelen[i];
 				tmp.length = valuelen[i];
-				if (op->key.length > 2 && op->key.buffer[0] == '!' && op->key.buffer[1] == '!')
-				{
-					// for debugging
-					userValue = tmp;
-				}
-				else
-				{
 				KeyspaceDB::ReadValue(tmp, storedPaxosID,
 									  storedCommandID, userValue);
-				}
 				// this is a huge hack, since op->value is a ByteBuffer!
 				// if it were allocated, this would result in memleak
 				op->value.buffer = userValue.buffer;
@@ -189,12 +181,6 @@ bool AsyncListVisitor::Accept(const ByteString &key,
 	if (op->IsAborted())
 		return false;
 
-	// don't list system keys
-	if (key.length >= 2 && key.buffer[0] == '@' && key.buffer[1] == '@')
-		return true;
-	if (key.length >= 2 && key.buffer[0] == '!' && key.buffer[1] == '!')
-		return true;
-	
 	if (num == 0 && startKey != key && offset > 0)
 	{
 		offset--;
@@ -0,0 +1,196 @@
+#include "ExpiryQueue.h"
+#include "KeyspaceDB.h"
+#include "System/Config.h"
+
+#define EXPIRY_TIME_PREFIX	"!!t:"
+
+ExpiryQueue::ExpiryQueue()
+{
+	table = NULL;
+	entries = NULL;
+	size = 0;
+	num = 0;
+	maxLoad = EXPIRYQUEUE_DEFAULT_SIZE;
+	loaded = false;
+	complete = false;
+	horizon = 0;
+}
+
+ExpiryQueue::~ExpiryQueue()
+{
+	Clear();
+	free(entries);
+}
+
+void ExpiryQueue::Init(Table* table_)
+{
+	table = table_;
+	maxLoad = MAX(1, Config::GetIntValue("keyspace.expiryQueueSize",
+										 EXPIRYQUEUE_DEFAULT_SIZE));
+}
+
+void ExpiryQueue::Clear()
+{
+	unsigned i;
+
+	for (i = 0; i < num; i++)
+		free(entries[i].key);
+	num = 0;
+	loaded = false;
+	complete = false;
+}
+
+bool ExpiryQueue::NeedsLoad()
+{
+	// the removed expiries are dropped by reloading when there are
+	// too many of them
+	return (!loaded || (num == 0 && !complete) || num > 2 * maxLoad);
+}
+
+bool ExpiryQueue::Load(Transaction* transaction)
+{
+	Cursor					cursor;
+	ByteArray<KEYSPACE_KEY_META_SIZE>	kdata;
+	ByteArray<32>			value;
+	ByteString				key;
+	uint64_t				expiryTime;
+	bool					ret;
+
+	Log_Trace();
+
+	Clear();
+
+	// the expiry times are zero padded, so the rows are in time order
+	table->Iterate(transaction, cursor);
+	kdata.Set(EXPIRY_TIME_PREFIX);
+	ret = cursor.Start(kdata, value);
+	complete = true;
+	while (ret)
+	{
+		if (kdata.length < sizeof(EXPIRY_TIME_PREFIX) - 1 ||
+			memcmp(kdata.buffer, EXPIRY_TIME_PREFIX, sizeof(EXPIRY_TIME_PREFIX) - 1) != 0)
+				break;
+
+		KeyspaceDB::ReadExpiryTime(kdata, expiryTime, key);
+		if (num == maxLoad)
+		{
+			// the ones at this time may be partly loaded
+			complete = false;
+			horizon = expiryTime - 1;
+			break;
+		}
+		Push(expiryTime, key);
+
+		ret = cursor.Next(kdata, value);
+	}
+	cursor.Close();
+
+	loaded = true;
+	Log_Trace("loaded %u expiries, complete = %d", num, complete);
+
+	return true;
+}
+
+void ExpiryQueue::Add(uint64_t expiryTime, const ByteString& key)
+{
+	// the ones after the horizon are read from the table later
+	if (!loaded || (!complete && expiryTime > horizon))
+		return;
+
+	Push(expiryTime, key);
+}
+
+bool ExpiryQueue::Head(uint64_t& expiryTime, ByteString& key)
+{
+	if (num == 0)
+		return false;
+
+	expiryTime = entries[0].expiryTime;
+	key.buffer = entries[0].key;
+	key.length = entries[0].keyLength;
+	key.size = entries[0].keyLength;
+
+	return true;
+}
+
+void ExpiryQueue::RemoveHead()
+{
+	if (num == 0)
+		return;
+
+	free(entries[0].key);
+	num--;
+	if (num > 0)
+	{
+		entries[0] = entries[num];
+		SiftDown(0);
+	}
+}
+
+void ExpiryQueue::RemoveUntil(uint64_t expiryTime)
+{
+	while (num > 0 && entries[0].expiryTime <= expiryTime)
+		RemoveHead();
+}
+
+void ExpiryQueue::Push(uint64_t expiryTime, const ByteString& key)
+{
+	Entry*		newEntries;
+	unsigned	newSize;
+
+	if (num == size)
+	{
+		newSize = size == 0 ? 1024 : size * 2;
+		newEntries = (Entry*) realloc(entries, newSize * sizeof(Entry));
+		if (newEntries == NULL)
+			ASSERT_FAIL();
+		entries = newEntries;
+		size = newSize;
+	}
+
+	entries[num].expiryTime = expiryTime;
+	entries[num].keyLength = key.length;
+	entries[num].key = (char*) malloc(MAX(key.length, 1));
+	if (entries[num].key == NULL)
+		ASSERT_FAIL();
+	memcpy(entries[num].key, key.buffer, key.length);
+	num++;
+
+	SiftUp(num - 1);
+}
+
+void ExpiryQueue::SiftUp(unsigned i)
+{
+	Entry		entry;
+	unsigned	parent;
+
+	entry = entries[i];
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+		if (entries[parent].expiryTime <= entry.expiryTime)
+			break;
+		entries[i] = entries[parent];
+		i = parent;
+	}
+	entries[i] = entry;
+}
+
+void ExpiryQueue::SiftDown(unsigned i)
+{
+	Entry		entry;
+	unsigned	child;
+
+	entry = entries[i];
+	while ((child = 2 * i + 1) < num)
+	{
+		if (child + 1 < num &&
+			entries[child + 1].expiryTime < entries[child].expiryTime)
+				child++;
+		if (entry.expiryTime <= entries[child].expiryTime)
+			break;
+		entries[i] = entries[child];
+		i = child;
+	}
+	entries[i] = entry;
+}
@@ -0,0 +1,60 @@
+#ifndef EXPIRYQUEUE_H
+#define EXPIRYQUEUE_H
+
+#include "System/Buffer.h"
+#include "Framework/Database/Table.h"
+#include "Framework/Database/Transaction.h"
+
+#define EXPIRYQUEUE_DEFAULT_SIZE	100000
+
+/*
+ * ExpiryQueue keeps the upcoming expiries of the expiry table in a
+ * min-heap, so that the next one is known without a seek. At most
+ * keyspace.expiryQueueSize of them are read from the table, the heap
+ * then holds every expiry up to the horizon and later ones are read
+ * when it runs empty. Expiries removed or changed are not taken out,
+ * the caller checks the head against the table.
+ */
+
+class ExpiryQueue
+{
+public:
+	ExpiryQueue();
+	~ExpiryQueue();
+
+	void			Init(Table* table);
+	void			Clear();
+
+	bool			NeedsLoad();
+	bool			Load(Transaction* transaction);
+
+	void			Add(uint64_t expiryTime, const ByteString& key);
+	bool			Head(uint64_t& expiryTime, ByteString& key);
+	void			RemoveHead();
+	void			RemoveUntil(uint64_t expiryTime);
+
+	unsigned		GetLength() { return num; }
+
+private:
+	struct Entry
+	{
+		uint64_t	expiryTime;
+		char*		key;
+		unsigned	keyLength;
+	};
+
+	void			Push(uint64_t expiryTime, const ByteString& key);
+	void			SiftUp(unsigned i);
+	void			SiftDown(unsigned i);
+
+	Table*			table;
+	Entry*			entries;
+	unsigned		size;
+	unsigned		num;
+	unsigned		maxLoad;
+	bool			loaded;
+	bool			complete;	// the whole table is in the heap
+	uint64_t		horizon;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "KeyFilter.h"
+#include "System/Common.h"
+#include "System/Log.h"
+
+// the slots are filled to about 95% before the kicks fail
+#define KEYFILTER_LOAD_PERCENT	95
+
+class KeyFilterVisitor : public TableVisitor
+{
+public:
+	KeyFilterVisitor(KeyFilter* filter_) { filter = filter_; }
+
+	bool Accept(const ByteString& key, const ByteString&)
+	{
+		filter->Add(key);
+		return filter->IsActive();
+	}
+
+private:
+	KeyFilter*	filter;
+};
+
+KeyFilter::KeyFilter()
+{
+	slots = NULL;
+	numBuckets = 0;
+	capacity = 0;
+	num = 0;
+	active = false;
+	numLookups = 0;
+	numNegatives = 0;
+}
+
+KeyFilter::~KeyFilter()
+{
+	free(slots);
+}
+
+bool KeyFilter::Init(uint64_t capacity_)
+{
+	uint64_t	minBuckets;
+
+	free(slots);
+	slots = NULL;
+	active = false;
+	num = 0;
+
+	// the bucket index is masked, so their number is a power of two
+	minBuckets = capacity_ * 100 / KEYFILTER_LOAD_PERCENT / KEYFILTER_BUCKET_SIZE + 1;
+	numBuckets = 1;
+	while (numBuckets < minBuckets)
+		numBuckets *= 2;
+	capacity = numBuckets * KEYFILTER_BUCKET_SIZE * KEYFILTER_LOAD_PERCENT / 100;
+
+	slots = (uint16_t*) calloc(numBuckets * KEYFILTER_BUCKET_SIZE, sizeof(uint16_t));
+	if (slots == NULL)
+	{
+		Log_Message("Cannot allocate the key filter for %" PRIu64 " keys", capacity_);
+		return false;
+	}
+
+	active = true;
+	return true;
+}
+
+bool KeyFilter::Build(Table* table)
+{
+	KeyFilterVisitor visitor(this);
+
+	if (!active)
+		return false;
+
+	table->Visit(visitor);
+
+	return active;
+}
+
+void KeyFilter::Disable()
+{
+	active = false;
+}
+
+bool KeyFilter::MayContain(const ByteString& key)
+{
+	uint64_t	bucket;
+	uint16_t	fp;
+
+	if (!active)
+		return true;
+
+	numLookups++;
+	Hash(key, bucket, fp);
+	if (Find(bucket, fp) || Find(AltBucket(bucket, fp), fp))
+		return true;
+
+	numNegatives++;
+	return false;
+}
+
+void KeyFilter::Add(const ByteString& key)
+{
+	uint64_t	bucket;
+	uint16_t	fp;
+	uint16_t	victim;
+	unsigned	i;
+	unsigned	kick;
+
+	if (!active)
+		return;
+
+	Hash(key, bucket, fp);
+	if (Insert(bucket, fp) || Insert(AltBucket(bucket, fp), fp))
+	{
+		num++;
+		return;
+	}
+
+	// move fingerprints to their other bucket until one is free
+	for (kick = 0; kick < KEYFILTER_MAX_KICKS; kick++)
+	{
+		i = bucket * KEYFILTER_BUCKET_SIZE + randint(0, KEYFILTER_BUCKET_SIZE - 1);
+		victim = slots[i];
+		slots[i] = fp;
+		fp = victim;
+		bucket = AltBucket(bucket, fp);
+		if (Insert(bucket, fp))
+		{
+			num++;
+			return;
+		}
+	}
+
+	// a fingerprint is lost, so the filter cannot be used anymore
+	Log_Message("The key filter is full with %" PRIu64 " keys, it is off "
+				"until it is built again", num);
+	active = false;
+}
+
+void KeyFilter::Remove(const ByteString& key)
+{
+	uint64_t	bucket;
+	uint16_t	fp;
+
+	if (!active)
+		return;
+
+	Hash(key, bucket, fp);
+	if (Delete(bucket, fp) || Delete(AltBucket(bucket, fp), fp))
+		num--;
+}
+
+void KeyFilter::PrintStats(ByteString& text)
+{
+	if (!active)
+	{
+		text.length = 0;
+		return;
+	}
+
+	text.Writef(
+		"Key filter: %U/%U keys, lookups: %U, definite misses: %U\n",
+		num,
+		capacity,
+		numLookups,
+		numNegatives);
+}
+
+void KeyFilter::Hash(const ByteString& key, uint64_t& bucket, uint16_t& fp)
+{
+	uint64_t	hash;
+	unsigned	i;
+
+	// FNV-1a
+	hash = 14695981039346656037ULL;
+	for (i = 0; i < key.length; i++)
+	{
+		hash ^= (unsigned char) key.buffer[i];
+		hash *= 1099511628211ULL;
+	}
+
+	// zero marks an empty slot
+	fp = (uint16_t) (hash >> 48);
+	if (fp == 0)
+		fp = 1;
+	bucket = hash & (numBuckets - 1);
+}
+
+uint64_t KeyFilter::AltBucket(uint64_t bucket, uint16_t fp)
+{
+	// the other bucket is found from either one and the fingerprint
+	return (bucket ^ ((uint64_t) fp * 0x5bd1e995)) & (numBuckets - 1);
+}
+
+bool KeyFilter::Find(uint64_t bucket, uint16_t fp)
+{
+	uint16_t*	slot;
+	unsigned	i;
+
+	slot = &slots[bucket * KEYFILTER_BUCKET_SIZE];
+	for (i = 0; i < KEYFILTER_BUCKET_SIZE; i++)
+	{
+		if (slot[i] == fp)
+			return true;
+	}
+
+	return false;
+}
+
+bool KeyFilter::Insert(uint64_t bucket, uint16_t fp)
+{
+	uint16_t*	slot;
+	unsigned	i;
+
+	slot = &slots[bucket * KEYFILTER_BUCKET_SIZE];
+	for (i = 0; i < KEYFILTER_BUCKET_SIZE; i++)
+	{
+		if (slot[i] == 0)
+		{
+			slot[i] = fp;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool KeyFilter::Delete(uint64_t bucket, uint16_t fp)
+{
+	uint16_t*	slot;
+	unsigned	i;
+
+	slot = &slots[bucket * KEYFILTER_BUCKET_SIZE];
+	for (i = 0; i < KEYFILTER_BUCKET_SIZE; i++)
+	{
+		if (slot[i] == fp)
+		{
+			slot[i] = 0;
+			return true;
+		}
+	}
+
+	return false;
+}
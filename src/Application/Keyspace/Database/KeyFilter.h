@@ -0,0 +1,57 @@
+#ifndef KEYFILTER_H
+#define KEYFILTER_H
+
+#include "System/Buffer.h"
+#include "Framework/Database/Table.h"
+
+#define KEYFILTER_BUCKET_SIZE	4
+#define KEYFILTER_MAX_KICKS		500
+
+/*
+ * KeyFilter is a cuckoo filter over the keys of the keyspace table: a
+ * 16 bit fingerprint of each key is kept in one of two buckets. If the
+ * fingerprint is in neither, the key is certainly not in the table.
+ *
+ * Keys have to be added when they are created and removed when they
+ * are deleted, exactly once. Adding one more than once only leaves a
+ * false positive; removing one that does not exist may hide another
+ * key, so the caller must know the key existed. When it runs full the
+ * filter turns itself off until it is built again.
+ */
+
+class KeyFilter
+{
+public:
+	KeyFilter();
+	~KeyFilter();
+
+	bool			Init(uint64_t capacity);
+	bool			Build(Table* table);
+	void			Disable();
+	bool			IsActive() { return active; }
+
+	bool			MayContain(const ByteString& key);
+	void			Add(const ByteString& key);
+	void			Remove(const ByteString& key);
+
+	uint64_t		GetCapacity() { return capacity; }
+	void			PrintStats(ByteString& text);
+
+private:
+	void			Hash(const ByteString& key, uint64_t& bucket, uint16_t& fp);
+	uint64_t		AltBucket(uint64_t bucket, uint16_t fp);
+	bool			Find(uint64_t bucket, uint16_t fp);
+	bool			Insert(uint64_t bucket, uint16_t fp);
+	bool			Delete(uint64_t bucket, uint16_t fp);
+
+	uint16_t*		slots;
+	uint64_t		numBuckets;
+	uint64_t		capacity;
+	uint64_t		num;
+	bool			active;
+
+	uint64_t		numLookups;
+	uint64_t		numNegatives;
+};
+
+#endif
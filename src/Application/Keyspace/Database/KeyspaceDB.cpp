@@ -0,0 +1,11 @@
+#include "KeyspaceDB.h"
+#include "System/Config.h"
+
+bool KeyspaceDB::binaryValues = false;
+
+void KeyspaceDB::InitValueFormat()
+{
+	// values in either format are always read, this only
+	// selects the format of new writes
+	binaryValues = Config::GetBoolValue("keyspace.binaryValues", false);
+}
@@ -1,11 +1,18 @@
 #ifndef KEYSPACEDB_H
 #define KEYSPACEDB_H
 
+#include "System/Buffer.h"
 #include "KeyspaceConsts.h"
 #include "../Protocol/ProtocolServer.h"
 
 #define LISTWORKER_TIMEOUT      1
 
+// stored values are either "paxosID:commandID:value" in decimal text,
+// or a binary header followed by the value; the first byte of the
+// text format is always a digit, the binary one starts with its version
+#define KEYSPACE_VALUE_V1				1
+#define KEYSPACE_VALUE_V1_HEADER_SIZE	13	// version, paxosID, commandID
+
 class KeyspaceOp;
 
 class KeyspaceDB
@@ -23,10 +30,28 @@ public:
 	virtual bool		IsMaster() = 0;
 	virtual bool		IsReplicated() = 0;
 	virtual void		SetProtocolServer(ProtocolServer* pserver) = 0;
+	virtual void		PrintStats(ByteString& text) { text.Clear(); }
 	
+	static void InitValueFormat();
+
 	static void WriteValue(
 	ByteString &target, uint64_t paxosID, uint64_t commandID, ByteString value)
 	{
+		if (binaryValues)
+		{
+			if (target.size < KEYSPACE_VALUE_V1_HEADER_SIZE + value.length ||
+				commandID > UINT32_MAX)
+					ASSERT_FAIL();
+			
+			target.buffer[0] = KEYSPACE_VALUE_V1;
+			WriteLittleEndian(target.buffer + 1, paxosID, 8);
+			WriteLittleEndian(target.buffer + 9, commandID, 4);
+			memmove(target.buffer + KEYSPACE_VALUE_V1_HEADER_SIZE,
+					value.buffer, value.length);
+			target.length = KEYSPACE_VALUE_V1_HEADER_SIZE + value.length;
+			return;
+		}
+		
 		if (!target.Writef("%U:%U:%B", paxosID, commandID,
 		value.length, value.buffer))
 			ASSERT_FAIL();
@@ -35,8 +60,10 @@ public:
 	static void WriteValue(
 	ByteString &target, uint64_t paxosID, uint64_t commandID, uint64_t value)
 	{
-		if (!target.Writef("%U:%U:%U", paxosID, commandID, value))
-			ASSERT_FAIL();
+		ByteArray<32> num;
+		
+		num.Writef("%U", value);
+		WriteValue(target, paxosID, commandID, num);
 	}
 
 	static void ReadValue(
@@ -48,6 +75,20 @@ public:
 		
 		p = source.buffer;
 		len = source.length;
+		
+		if (len > 0 && p[0] == KEYSPACE_VALUE_V1)
+		{
+			if (len < KEYSPACE_VALUE_V1_HEADER_SIZE)
+				ASSERT_FAIL();
+			
+			paxosID = ReadLittleEndian(p + 1, 8);
+			commandID = ReadLittleEndian(p + 9, 4);
+			value.size = len - KEYSPACE_VALUE_V1_HEADER_SIZE;
+			value.length = len - KEYSPACE_VALUE_V1_HEADER_SIZE;
+			value.buffer = p + KEYSPACE_VALUE_V1_HEADER_SIZE;
+			return;
+		}
+		
 		paxosID = strntouint64(p, len, &num);
 		
 		if (num == 0)
@@ -126,6 +167,29 @@ public:
 		
 		key = source; 
 	}
+
+private:
+	static bool	binaryValues;
+
+	static void WriteLittleEndian(char* p, uint64_t value, unsigned width)
+	{
+		unsigned i;
+		
+		for (i = 0; i < width; i++)
+			p[i] = (char)((value >> (8 * i)) & 0xFF);
+	}
+
+	static uint64_t ReadLittleEndian(const char* p, unsigned width)
+	{
+		unsigned i;
+		uint64_t value;
+		
+		value = 0;
+		for (i = 0; i < width; i++)
+			value |= ((uint64_t)(unsigned char) p[i]) << (8 * i);
+		
+		return value;
+	}
 };
 
 
@@ -1,5 +1,6 @@
 #include "KeyspaceMsg.h"
 #include "KeyspaceService.h"
+#include "System/Binary.h"
 
 void KeyspaceMsg::Init(char type_)
 {
@@ -53,7 +54,11 @@ bool KeyspaceMsg::Read(ByteString& data, unsigned &n)
 						   &type, &key, &prevExpiryTime);
 			break;
 		case KEYSPACE_CLEAR_EXPIRIES:
-			read = snreadf(data.buffer, data.length, "%c");
+			read = snreadf(data.buffer, data.length, "%c", &type);
+			break;
+		case KEYSPACE_EXPIRE_KEYS:
+			read = snreadf(data.buffer, data.length, "%c:%U:%I",
+						   &type, &prevExpiryTime, &num);
 			break;
 		default:
 			return false;
@@ -111,9 +116,181 @@ bool KeyspaceMsg::Write(ByteString& data)
 		case KEYSPACE_CLEAR_EXPIRIES:
 			return data.Writef("%c", type);
 			break;
+		case KEYSPACE_EXPIRE_KEYS:
+			return data.Writef("%c:%U:%I",
+						       type, prevExpiryTime, num);
+			break;
+		default:
+			return false;
+	}
+}
+
+// binary messages are the type byte followed by the fields of the
+// text format, see System/Binary.h for the encoding of the fields
+
+bool KeyspaceMsg::ReadBinary(ByteString& data, unsigned &n)
+{
+	unsigned	pos;
+	uint64_t	u;
+	bool		ret;
+	
+	if (data.length < 1)
+		return false;
+	
+	type = data.buffer[0];
+	pos = 1;
+	u = 0;
+	ret = true;
+	
+	switch (type)
+	{
+		case KEYSPACE_SET:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadBytes(data, pos, value);
+			break;
+		case KEYSPACE_TEST_AND_SET:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadBytes(data, pos, test);
+			ret = ret && ReadBytes(data, pos, value);
+			break;
+		case KEYSPACE_ADD:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadVarint(data, pos, u);
+			num = UnZigZag(u);
+			break;
+		case KEYSPACE_RENAME:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadBytes(data, pos, newKey);
+			break;
+		case KEYSPACE_DELETE:
+		case KEYSPACE_REMOVE:
+			ret = ret && ReadBytes(data, pos, key);
+			break;
+		case KEYSPACE_PRUNE:
+			ret = ret && ReadBytes(data, pos, prefix);
+			break;
+		case KEYSPACE_SET_EXPIRY:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadVarint(data, pos, prevExpiryTime);
+			ret = ret && ReadVarint(data, pos, nextExpiryTime);
+			break;
+		case KEYSPACE_EXPIRE:
+		case KEYSPACE_REMOVE_EXPIRY:
+			ret = ret && ReadBytes(data, pos, key);
+			ret = ret && ReadVarint(data, pos, prevExpiryTime);
+			break;
+		case KEYSPACE_CLEAR_EXPIRIES:
+			break;
+		case KEYSPACE_EXPIRE_KEYS:
+			ret = ret && ReadVarint(data, pos, prevExpiryTime);
+			ret = ret && ReadVarint(data, pos, u);
+			num = UnZigZag(u);
+			break;
 		default:
 			return false;
 	}
+	
+	if (!ret)
+		return false;
+	
+	n = pos;
+	
+	return true;
+}
+
+bool KeyspaceMsg::WriteBinary(ByteString& data)
+{
+	bool ret;
+	
+	if (data.size < 1)
+		return false;
+	
+	data.buffer[0] = type;
+	data.length = 1;
+	ret = true;
+	
+	switch (type)
+	{
+		case KEYSPACE_SET:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteBytes(data, value);
+			break;
+		case KEYSPACE_TEST_AND_SET:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteBytes(data, test);
+			ret = ret && WriteBytes(data, value);
+			break;
+		case KEYSPACE_ADD:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteVarint(data, ZigZag(num));
+			break;
+		case KEYSPACE_RENAME:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteBytes(data, newKey);
+			break;
+		case KEYSPACE_DELETE:
+		case KEYSPACE_REMOVE:
+			ret = ret && WriteBytes(data, key);
+			break;
+		case KEYSPACE_PRUNE:
+			ret = ret && WriteBytes(data, prefix);
+			break;
+		case KEYSPACE_SET_EXPIRY:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteVarint(data, prevExpiryTime);
+			ret = ret && WriteVarint(data, nextExpiryTime);
+			break;
+		case KEYSPACE_EXPIRE:
+		case KEYSPACE_REMOVE_EXPIRY:
+			ret = ret && WriteBytes(data, key);
+			ret = ret && WriteVarint(data, prevExpiryTime);
+			break;
+		case KEYSPACE_CLEAR_EXPIRIES:
+			break;
+		case KEYSPACE_EXPIRE_KEYS:
+			ret = ret && WriteVarint(data, prevExpiryTime);
+			ret = ret && WriteVarint(data, ZigZag(num));
+			break;
+		default:
+			return false;
+	}
+	
+	return ret;
+}
+
+unsigned KeyspaceMsg::GetBinaryLength()
+{
+#define BYTES_LENGTH(bs) (VarintLength((bs).length) + (bs).length)
+
+	switch (type)
+	{
+		case KEYSPACE_SET:
+			return 1 + BYTES_LENGTH(key) + BYTES_LENGTH(value);
+		case KEYSPACE_TEST_AND_SET:
+			return 1 + BYTES_LENGTH(key) + BYTES_LENGTH(test) +
+				   BYTES_LENGTH(value);
+		case KEYSPACE_ADD:
+			return 1 + BYTES_LENGTH(key) + VarintLength(ZigZag(num));
+		case KEYSPACE_RENAME:
+			return 1 + BYTES_LENGTH(key) + BYTES_LENGTH(newKey);
+		case KEYSPACE_DELETE:
+		case KEYSPACE_REMOVE:
+			return 1 + BYTES_LENGTH(key);
+		case KEYSPACE_PRUNE:
+			return 1 + BYTES_LENGTH(prefix);
+		case KEYSPACE_SET_EXPIRY:
+			return 1 + BYTES_LENGTH(key) + VarintLength(prevExpiryTime) +
+				   VarintLength(nextExpiryTime);
+		case KEYSPACE_EXPIRE:
+		case KEYSPACE_REMOVE_EXPIRY:
+			return 1 + BYTES_LENGTH(key) + VarintLength(prevExpiryTime);
+		case KEYSPACE_EXPIRE_KEYS:
+			return 1 + VarintLength(prevExpiryTime) + VarintLength(ZigZag(num));
+		default:
+			return 1;
+	}
+
+#undef BYTES_LENGTH
 }
 
 bool KeyspaceMsg::FromKeyspaceOp(KeyspaceOp* op)
@@ -142,6 +319,8 @@ bool KeyspaceMsg::FromKeyspaceOp(KeyspaceOp* op)
 		Init(KEYSPACE_REMOVE_EXPIRY);
 	else if (op->type == KeyspaceOp::CLEAR_EXPIRIES)
 		Init(KEYSPACE_CLEAR_EXPIRIES);
+	else if (op->type == KeyspaceOp::EXPIRE_KEYS)
+		Init(KEYSPACE_EXPIRE_KEYS);
 	else
 		ASSERT_FAIL();
 	
@@ -171,6 +350,12 @@ bool KeyspaceMsg::FromKeyspaceOp(KeyspaceOp* op)
 	{
 		prevExpiryTime = op->prevExpiryTime;
 	}
+	if (op->type == KeyspaceOp::EXPIRE_KEYS)
+	{
+		// every key expiring until then, at most num of them
+		prevExpiryTime = op->prevExpiryTime;
+		num = op->num;
+	}
 		
 	return ret;
 }
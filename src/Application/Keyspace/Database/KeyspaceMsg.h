@@ -15,6 +15,12 @@
 #define KEYSPACE_EXPIRE				'y'
 #define KEYSPACE_REMOVE_EXPIRY		'z'
 #define KEYSPACE_CLEAR_EXPIRIES		'w'
+#define KEYSPACE_EXPIRE_KEYS		'k'
+
+// a Paxos value holding binary messages starts with this version byte,
+// text messages always start with one of the letters above
+#define KEYSPACE_MSG_BINARY_V1		1
+
 class KeyspaceOp;
 
 class KeyspaceMsg
@@ -37,6 +43,10 @@ public:
 	bool		Read(ByteString& data, unsigned &nread);
 	bool		Write(ByteString& data);
 
+	bool		ReadBinary(ByteString& data, unsigned &nread);
+	bool		WriteBinary(ByteString& data);
+	unsigned	GetBinaryLength();
+
 	bool		FromKeyspaceOp(KeyspaceOp* op);
 };
 
@@ -2,6 +2,7 @@
 #define KEYSPACESERVICE_H
 
 #include "System/Buffer.h"
+#include "System/Atomic.h"
 #include "KeyspaceDB.h"
 
 class KeyspaceOp;
@@ -9,6 +10,7 @@ class KeyspaceOp;
 class KeyspaceService
 {
 public:
+	KeyspaceService() { aborted = NULL; }
 	virtual			~KeyspaceService() {}
 	virtual	void	OnComplete(KeyspaceOp* op, bool final = true) = 0;
 	virtual bool	IsAborted() = 0;
@@ -17,6 +19,19 @@ public:
 	{
 		kdb = kdb_;
 		numpending = 0;
+		aborted = NULL;
+	}
+
+	// IsAborted() may only be called on the service's own loop, the
+	// loop executing its ops reads this flag instead
+	void Abort()
+	{
+		AtomicExchange(&aborted, (void*) this);
+	}
+
+	bool WasAborted()
+	{
+		return AtomicLoad(&aborted) != NULL;
 	}
 
 
@@ -33,6 +48,7 @@ public:
 protected:
 	int				numpending;
 	KeyspaceDB*		kdb;
+	void* volatile	aborted;
 };
 
 
@@ -59,7 +75,8 @@ public:
 		SET_EXPIRY,
 		EXPIRE,
 		REMOVE_EXPIRY,
-		CLEAR_EXPIRIES
+		CLEAR_EXPIRIES,
+		EXPIRE_KEYS
 	};
 	
 	bool					appended;
@@ -80,9 +97,15 @@ public:
 	bool					status;
 	
 	KeyspaceService*		service;
+	// set while the op of a service on another event loop is executed,
+	// service is then the one passing the completions back to it
+	KeyspaceService*		origin;
+	KeyspaceOp*				next;
 	
 	KeyspaceOp()
 	{
+		origin = NULL;
+		next = NULL;
 		appended = false;
 		status = false;
         num = 0;
@@ -108,6 +131,8 @@ public:
 	
 	bool IsAborted()
 	{
+		if (origin)
+			return origin->WasAborted();
 		return service->IsAborted();
 	}
 	
@@ -170,7 +195,8 @@ public:
 		return (type == KeyspaceOp::SET_EXPIRY ||
 			    type == KeyspaceOp::EXPIRE ||
 			    type == KeyspaceOp::REMOVE_EXPIRY ||
-				type == KeyspaceOp::CLEAR_EXPIRIES);
+				type == KeyspaceOp::CLEAR_EXPIRIES ||
+				type == KeyspaceOp::EXPIRE_KEYS);
 	}
 	
 	bool MasterOnly()
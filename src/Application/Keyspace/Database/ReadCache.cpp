@@ -0,0 +1,301 @@
+#include "ReadCache.h"
+#include "System/Common.h"
+#include "System/Log.h"
+
+#define READCACHE_MIN_BUCKETS	1024
+
+static uint32_t HashKey(const ByteString& key)
+{
+	uint32_t	hash;
+	unsigned	i;
+
+	// FNV-1a
+	hash = 2166136261U;
+	for (i = 0; i < key.length; i++)
+	{
+		hash ^= (unsigned char) key.buffer[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+ReadCache::ReadCache()
+{
+	maxSize = 0;
+	maxProtected = 0;
+	probation.head = probation.tail = NULL;
+	probation.size = 0;
+	protect.head = protect.tail = NULL;
+	protect.size = 0;
+	buckets = NULL;
+	numBuckets = 0;
+	num = 0;
+	numHits = 0;
+	numMisses = 0;
+	numEvictions = 0;
+}
+
+ReadCache::~ReadCache()
+{
+	Clear();
+	free(buckets);
+}
+
+void ReadCache::Init(uint64_t maxSize_)
+{
+	maxSize = maxSize_;
+	maxProtected = maxSize / 100 * READCACHE_PROTECTED_PERCENT;
+	if (maxSize == 0)
+		return;
+
+	numBuckets = READCACHE_MIN_BUCKETS;
+	buckets = (Entry**) calloc(numBuckets, sizeof(Entry*));
+	if (buckets == NULL)
+		ASSERT_FAIL();
+}
+
+bool ReadCache::Get(const ByteString& key, ByteString& value)
+{
+	Entry*	entry;
+	Entry*	demoted;
+
+	if (maxSize == 0)
+		return false;
+
+	entry = Find(key, HashKey(key));
+	if (entry == NULL)
+	{
+		numMisses++;
+		return false;
+	}
+	numHits++;
+
+	// a second read moves it to the protected segment, the least
+	// recently used ones there go back to probation
+	Unlink(entry);
+	Link(&protect, entry);
+	while (protect.size > maxProtected && protect.tail != entry)
+	{
+		demoted = protect.tail;
+		Unlink(demoted);
+		Link(&probation, demoted);
+	}
+
+	value.buffer = entry->Value();
+	value.length = entry->valueLength;
+	value.size = entry->valueLength;
+
+	return true;
+}
+
+void ReadCache::Add(const ByteString& key, const ByteString& value)
+{
+	Entry*		entry;
+	uint32_t	hash;
+
+	if (maxSize == 0)
+		return;
+
+	hash = HashKey(key);
+	entry = Find(key, hash);
+	if (entry != NULL)
+		Delete(entry);
+
+	entry = Create(key, hash, value);
+	Link(&probation, entry);
+	Evict();
+}
+
+void ReadCache::Update(const ByteString& key, const ByteString& value)
+{
+	Entry*		entry;
+	Entry*		newEntry;
+	uint32_t	hash;
+
+	if (maxSize == 0)
+		return;
+
+	// written keys are not added, only the cached ones are changed
+	hash = HashKey(key);
+	entry = Find(key, hash);
+	if (entry == NULL)
+		return;
+
+	if (entry->valueLength == value.length)
+	{
+		memcpy(entry->Value(), value.buffer, value.length);
+		return;
+	}
+
+	newEntry = Create(key, hash, value);
+	Link(entry->inProtected ? &protect : &probation, newEntry);
+	Delete(entry);
+	Evict();
+}
+
+void ReadCache::Remove(const ByteString& key)
+{
+	Entry* entry;
+
+	if (maxSize == 0)
+		return;
+
+	entry = Find(key, HashKey(key));
+	if (entry != NULL)
+		Delete(entry);
+}
+
+void ReadCache::Clear()
+{
+	while (probation.head != NULL)
+		Delete(probation.head);
+	while (protect.head != NULL)
+		Delete(protect.head);
+}
+
+void ReadCache::PrintStats(ByteString& text)
+{
+	if (maxSize == 0)
+	{
+		text.length = 0;
+		return;
+	}
+
+	text.Writef(
+		"Read cache: %u keys, %U/%U bytes, hits: %U, misses: %U, evictions: %U\n",
+		num,
+		probation.size + protect.size,
+		maxSize,
+		numHits,
+		numMisses,
+		numEvictions);
+}
+
+ReadCache::Entry* ReadCache::Find(const ByteString& key, uint32_t hash)
+{
+	Entry* entry;
+
+	for (entry = buckets[hash & (numBuckets - 1)]; entry != NULL; entry = entry->hashNext)
+	{
+		if (entry->hash == hash && entry->keyLength == key.length &&
+			memcmp(entry->Key(), key.buffer, key.length) == 0)
+				return entry;
+	}
+
+	return NULL;
+}
+
+ReadCache::Entry* ReadCache::Create(const ByteString& key, uint32_t hash,
+const ByteString& value)
+{
+	Entry*		entry;
+	unsigned	i;
+
+	entry = (Entry*) malloc(sizeof(Entry) + key.length + value.length);
+	if (entry == NULL)
+		ASSERT_FAIL();
+
+	entry->hash = hash;
+	entry->keyLength = key.length;
+	entry->valueLength = value.length;
+	memcpy(entry->Key(), key.buffer, key.length);
+	memcpy(entry->Value(), value.buffer, value.length);
+
+	i = hash & (numBuckets - 1);
+	entry->hashNext = buckets[i];
+	buckets[i] = entry;
+	num++;
+
+	if (num > numBuckets)
+		Grow();
+
+	return entry;
+}
+
+void ReadCache::Delete(Entry* entry)
+{
+	Entry** curr;
+
+	for (curr = &buckets[entry->hash & (numBuckets - 1)]; *curr != entry;
+	 curr = &(*curr)->hashNext)
+		/* empty */;
+	*curr = entry->hashNext;
+	num--;
+
+	Unlink(entry);
+	free(entry);
+}
+
+void ReadCache::Link(Segment* segment, Entry* entry)
+{
+	entry->inProtected = (segment == &protect);
+	entry->prev = NULL;
+	entry->next = segment->head;
+	if (segment->head != NULL)
+		segment->head->prev = entry;
+	else
+		segment->tail = entry;
+	segment->head = entry;
+	segment->size += entry->Size();
+}
+
+void ReadCache::Unlink(Entry* entry)
+{
+	Segment* segment;
+
+	segment = entry->inProtected ? &protect : &probation;
+	if (entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else
+		segment->head = entry->next;
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+	else
+		segment->tail = entry->prev;
+	segment->size -= entry->Size();
+}
+
+void ReadCache::Evict()
+{
+	while (probation.size + protect.size > maxSize)
+	{
+		if (probation.tail != NULL)
+			Delete(probation.tail);
+		else
+			Delete(protect.tail);
+		numEvictions++;
+	}
+}
+
+void ReadCache::Grow()
+{
+	Entry**		newBuckets;
+	Entry*		entry;
+	Entry*		next;
+	unsigned	newNum;
+	unsigned	i;
+
+	newNum = numBuckets * 2;
+	newBuckets = (Entry**) calloc(newNum, sizeof(Entry*));
+	if (newBuckets == NULL)
+	{
+		// the chains just get longer
+		Log_Trace("cannot grow the read cache");
+		return;
+	}
+
+	for (i = 0; i < numBuckets; i++)
+	{
+		for (entry = buckets[i]; entry != NULL; entry = next)
+		{
+			next = entry->hashNext;
+			entry->hashNext = newBuckets[entry->hash & (newNum - 1)];
+			newBuckets[entry->hash & (newNum - 1)] = entry;
+		}
+	}
+
+	free(buckets);
+	buckets = newBuckets;
+	numBuckets = newNum;
+}
@@ -0,0 +1,82 @@
+#ifndef READCACHE_H
+#define READCACHE_H
+
+#include "System/Buffer.h"
+
+#define READCACHE_PROTECTED_PERCENT	80
+
+/*
+ * ReadCache keeps the user values of recently read keys in memory, up
+ * to keyspace.readCacheSize bytes, so that GETs of hot keys do not go
+ * to the database. It is a segmented LRU: keys read once are in the
+ * probation segment and are evicted first, keys read again are moved
+ * to the protected segment.
+ *
+ * Only values read from the table are added. The apply path updates or
+ * removes the cached ones, so the cache always has the values of the
+ * table. It is used from one thread at a time.
+ */
+
+class ReadCache
+{
+public:
+	ReadCache();
+	~ReadCache();
+
+	void			Init(uint64_t maxSize);
+	bool			IsEnabled() { return maxSize > 0; }
+
+	bool			Get(const ByteString& key, ByteString& value);
+	void			Add(const ByteString& key, const ByteString& value);
+	void			Update(const ByteString& key, const ByteString& value);
+	void			Remove(const ByteString& key);
+	void			Clear();
+
+	void			PrintStats(ByteString& text);
+
+private:
+	struct Entry
+	{
+		Entry*		hashNext;
+		Entry*		prev;
+		Entry*		next;
+		uint32_t	hash;
+		unsigned	keyLength;
+		unsigned	valueLength;
+		bool		inProtected;
+
+		char*		Key() { return (char*) (this + 1); }
+		char*		Value() { return Key() + keyLength; }
+		unsigned	Size() { return sizeof(Entry) + keyLength + valueLength; }
+	};
+
+	struct Segment
+	{
+		Entry*		head;	// most recently used
+		Entry*		tail;
+		uint64_t	size;
+	};
+
+	Entry*			Find(const ByteString& key, uint32_t hash);
+	Entry*			Create(const ByteString& key, uint32_t hash,
+						   const ByteString& value);
+	void			Delete(Entry* entry);
+	void			Link(Segment* segment, Entry* entry);
+	void			Unlink(Entry* entry);
+	void			Evict();
+	void			Grow();
+
+	uint64_t		maxSize;
+	uint64_t		maxProtected;
+	Segment			probation;
+	Segment			protect;
+	Entry**			buckets;
+	unsigned		numBuckets;
+	unsigned		num;
+
+	uint64_t		numHits;
+	uint64_t		numMisses;
+	uint64_t		numEvictions;
+};
+
+#endif
@@ -1,4 +1,4 @@
-//#include "Framework/AsyncDatabase/AsyncDatabase.h"
+#include "Framework/AsyncDatabase/AsyncDatabase.h"
 #include "ReplicatedKeyspaceDB.h"
 #include "KeyspaceService.h"
 #include <assert.h>
@@ -8,6 +8,52 @@
 //#include "AsyncListVisitor.h"
 #include "SyncListVisitor.h"
 #include "System/Stopwatch.h"
+#include "System/Config.h"
+
+// a command of the chosen value, see AsyncOnAppendSorted()
+struct ApplyEntry
+{
+	char*		cmd;
+	unsigned	cmdLength;
+	char*		key;
+	unsigned	keyLength;
+	uint64_t	commandID;
+	bool		barrier;
+};
+
+static int CompareApplyEntries(const void* a, const void* b)
+{
+	const ApplyEntry*	ea = (const ApplyEntry*) a;
+	const ApplyEntry*	eb = (const ApplyEntry*) b;
+	int					cmp;
+	
+	// same order as the BDB default btree comparison
+	cmp = memcmp(ea->key, eb->key, MIN(ea->keyLength, eb->keyLength));
+	if (cmp == 0)
+		cmp = (int) ea->keyLength - (int) eb->keyLength;
+	if (cmp != 0)
+		return cmp;
+
+	// commands on the same key keep their relative order
+	return ea->commandID < eb->commandID ? -1 : 1;
+}
+
+static bool IsApplyBarrier(char type)
+{
+	// commands touching exactly one user key commute with
+	// commands on other keys, the rest are applied in place
+	switch (type)
+	{
+	case KEYSPACE_SET:
+	case KEYSPACE_TEST_AND_SET:
+	case KEYSPACE_ADD:
+	case KEYSPACE_DELETE:
+	case KEYSPACE_REMOVE:
+		return false;
+	default:
+		return true;
+	}
+}
 
 ReplicatedKeyspaceDB::ReplicatedKeyspaceDB()
 :	asyncOnAppend(this, &ReplicatedKeyspaceDB::AsyncOnAppend),
@@ -15,12 +61,19 @@ ReplicatedKeyspaceDB::ReplicatedKeyspaceDB()
 	onExpiryTimer(this, &ReplicatedKeyspaceDB::OnExpiryTimer),
 	expiryTimer(&onExpiryTimer),
     onListWorkerTimeout(this, &ReplicatedKeyspaceDB::OnListWorkerTimeout),
-    listTimer(LISTWORKER_TIMEOUT, &onListWorkerTimeout)
+    listTimer(LISTWORKER_TIMEOUT, &onListWorkerTimeout),
+	onBatchTimeout(this, &ReplicatedKeyspaceDB::OnBatchTimeout),
+	batcher(&onBatchTimeout)
 {
 	asyncAppender = ThreadPool::Create(1);
 	catchingUp = false;
+	shadowTable = NULL;
+	shadowExpiryTable = NULL;
+	snapshotting = false;
+	snapshotRounds = false;
 	transaction = NULL;
 	expiryAdded = false;
+	expiredUntil = 0;
 }
 
 ReplicatedKeyspaceDB::~ReplicatedKeyspaceDB()
@@ -35,14 +88,29 @@ bool ReplicatedKeyspaceDB::Init()
 	RLOG->SetReplicatedDB(this);
 	
 	table = database.GetTable("keyspace");
+	expiryTable = database.GetTable("expiry");
+	expiryQueue.Init(expiryTable);
+	InitValueFormat();
 	
 	catchupServer.Init(RCONF->GetPort() + CATCHUP_PORT_OFFSET);
-	catchupClient.Init(this, table);
+	catchupClient.Init(this, table, expiryTable);
 
 	estimatedLength = 0;
+	numUnappended = 0;
 
 	asyncAppender->Start();
 	asyncAppenderActive = false;
+	overlapApply = Config::GetBoolValue("rlog.overlapApply", false);
+	sortedApply = Config::GetBoolValue("rlog.sortedApply", false);
+	binaryCommands = Config::GetBoolValue("keyspace.binaryCommands", false);
+	readBinary = false;
+	shadowCatchup = Config::GetBoolValue("keyspace.shadowCatchup", true);
+	snapshotCatchup = Config::GetBoolValue("keyspace.snapshotCatchup", false);
+	expiryBatch = MAX(1, Config::GetIntValue("keyspace.expiryBatch", 1));
+	readCache.Init(MAX(0, Config::GetIntValue("keyspace.readCacheSize", 0)));
+	keyFilterSize = MAX(0, Config::GetIntValue("keyspace.keyFilterSize", 0));
+	BuildKeyFilter();
+	batcher.Init();
 	
 	deleteDB = false;
 
@@ -52,7 +120,11 @@ bool ReplicatedKeyspaceDB::Init()
 void ReplicatedKeyspaceDB::Shutdown()
 {
 	asyncAppender->Stop();
+	batcher.Shutdown();
 	catchupServer.Shutdown();
+	// don't start another catchup when this one is closed
+	shadowCatchup = false;
+	snapshotCatchup = false;
 	catchupClient.Shutdown();
 }
 
@@ -83,8 +155,7 @@ bool ReplicatedKeyspaceDB::IsCatchingUp()
 
 bool ReplicatedKeyspaceDB::Add(KeyspaceOp* op)
 {
-	uint64_t storedPaxosID, storedCommandID;
-	ByteString userValue;
+	unsigned length;
 	
 	// don't allow writes for @@ keys
 	if (op->IsWrite() && op->key.length > 2 &&
@@ -95,7 +166,9 @@ bool ReplicatedKeyspaceDB::Add(KeyspaceOp* op)
 		op->key.buffer[0] == '!' && op->key.buffer[1] == '!')
 			return false;
 
-	if (catchingUp)
+	// while catching up into a shadow table the old one is still
+	// consistent, so dirty reads are served from it
+	if (catchingUp && !((shadowTable != NULL || snapshotting) && op->IsDirty()))
 		return false;
 	
 	// reads are handled locally, they don't have to
@@ -115,13 +188,7 @@ bool ReplicatedKeyspaceDB::Add(KeyspaceOp* op)
             return true;
         }
 
-		op->value.Allocate(KEYSPACE_VAL_SIZE);
-		op->status = table->Get(NULL, op->key, rdata);
-		if (op->status)
-		{
-			ReadValue(rdata, storedPaxosID, storedCommandID, userValue);
-			op->value.Set(userValue);
-		}
+		ExecuteGet(op);
 		op->service->OnComplete(op);
 		return true;
 	}
@@ -153,16 +220,20 @@ bool ReplicatedKeyspaceDB::Add(KeyspaceOp* op)
 		expiryAdded = true;
 	
 	writeOps.Append(op);
-
-	// TODO: huge hack
-	if (estimatedLength < PAXOS_SIZE)
-	{
-		tmp.FromKeyspaceOp(op);
-		if (tmp.Write(tmpBuffer))
-			estimatedLength += tmpBuffer.length;
-	}
+	numUnappended++;
+
+	tmp.FromKeyspaceOp(op);
+	length = 0;
+	if (binaryCommands)
+		length = tmp.GetBinaryLength();
+	else if (tmp.Write(tmpBuffer))
+		length = tmpBuffer.length;
+	
+	estimatedLength += length;
+	batcher.OnAdd(length);
 	
-	if (estimatedLength >= PAXOS_SIZE)
+	// a full batch is appended without waiting for the protocol layer
+	if (estimatedLength >= batcher.GetMaxSize())
 		Submit();
 	
 	return true;
@@ -176,12 +247,16 @@ bool ReplicatedKeyspaceDB::Submit()
 	if (!RLOG->IsMaster())
 		return false;
 
-	if (!RLOG->IsAppending() &&
-		RLOG->IsMaster() &&
-		!asyncAppenderActive)
+	// with rlog.appendQueueDepth > 1 several rounds may be queued
+	// in the ReplicatedLog while the first one is in flight; the
+	// estimate may run low, so it does not decide if there is anything
+	// left to append
+	while (numUnappended > 0 && RLOG->CanAppend() && !asyncAppenderActive &&
+		   batcher.ShouldFlush(estimatedLength, RLOG->GetLastRound_Time()))
 	{
 		Log_Trace("writeOps.size() = %d", writeOps.Length());	
-		Append();
+		if (!Append())
+			break;
 		Log_Trace("writeOps.size() = %d", writeOps.Length());
 	}
 	
@@ -198,11 +273,22 @@ uint64_t paxosID_, ByteString value_, bool ownAppend_)
 	valueBuffer.Set(value_);
 	ownAppend = ownAppend_;
 	
-	RLOG->StopPaxos();
-
 	assert(asyncAppenderActive == false);
 	asyncAppenderActive = true;
-	asyncAppender->Execute(&asyncOnAppend);
+
+	if (overlapApply)
+	{
+		// the next round runs while this one is applied; the apply
+		// goes to dbWriter so that the acceptor's writes (and commit)
+		// are serialized after it
+		RLOG->PausePaxos();
+		dbWriter.Execute(&asyncOnAppend);
+	}
+	else
+	{
+		RLOG->StopPaxos();
+		asyncAppender->Execute(&asyncOnAppend);
+	}
 }
 
 
@@ -221,6 +307,18 @@ void ReplicatedKeyspaceDB::AsyncOnAppend()
 	value.Set(valueBuffer);
 	Log_Trace("length: %d", value.length);
 	
+	// values of either format may be in the log during an upgrade
+	readBinary = (value.length > 0 && value.buffer[0] == KEYSPACE_MSG_BINARY_V1);
+	if (readBinary)
+		value.Advance(1);
+	
+	if (sortedApply)
+	{
+		AsyncOnAppendSorted(value);
+		IOProcessor::Complete(&onAppendComplete);
+		return;
+	}
+	
 	numOps = 0;
 	if (ownAppend)
 		it = writeOps.Head();
@@ -230,7 +328,7 @@ void ReplicatedKeyspaceDB::AsyncOnAppend()
 	commandID = 0;	
 	while (true)
 	{
-		if (msg.Read(value, nread))
+		if (ReadMsg(value, nread))
 		{
 			sw.Start();
 			ret = Execute(transaction, paxosID, commandID);
@@ -242,14 +340,7 @@ void ReplicatedKeyspaceDB::AsyncOnAppend()
 			if (ownAppend)
 			{
 				op = *it;
-				if (op->type == KeyspaceOp::DIRTY_GET ||
-					op->type == KeyspaceOp::GET)
-						ASSERT_FAIL();
-				if ((op->type == KeyspaceOp::ADD ||
-					 op->type == KeyspaceOp::TEST_AND_SET ||
-					 op->type == KeyspaceOp::REMOVE) && ret)
-						op->value.Set(wdata);
-				op->status = ret;
+				SetOpResult(op, ret);
 				it = writeOps.Next(it);
 			}
 			
@@ -272,6 +363,143 @@ void ReplicatedKeyspaceDB::AsyncOnAppend()
 	IOProcessor::Complete(&onAppendComplete);
 }
 
+void ReplicatedKeyspaceDB::AsyncOnAppendSorted(ByteString value)
+{
+	unsigned		i, start, end, num, size, nread;
+	bool			ret;
+	char*			keys;
+	char*			keyBuffer;
+	ByteString		cmd;
+	KeyspaceOp**	ops;
+	KeyspaceOp**	it;
+	ApplyEntry*		entries;
+	ApplyEntry*		newEntries;
+	ApplyEntry*		entry;
+	Stopwatch		sw;
+
+	// first pass: split the value into commands and save the keys,
+	// which are part of the commands so they fit into value.length
+	size = 1024;
+	entries = (ApplyEntry*) Alloc(size, sizeof(ApplyEntry));
+	keyBuffer = (char*) Alloc(value.length);
+	keys = keyBuffer;
+	num = 0;
+	while (value.length > 0)
+	{
+		if (!ReadMsg(value, nread))
+		{
+			Log_Trace("Failed parsing:");
+			Log_Trace("%.*s", value.length, value.buffer);
+			ASSERT_FAIL();
+			break;
+		}
+		
+		if (num == size)
+		{
+			newEntries = (ApplyEntry*) realloc(entries, 2 * size * sizeof(ApplyEntry));
+			if (newEntries == NULL)
+				ASSERT_FAIL();
+			entries = newEntries;
+			size *= 2;
+		}
+		
+		entry = &entries[num];
+		entry->cmd = value.buffer;
+		entry->cmdLength = nread;
+		entry->commandID = num;
+		entry->barrier = IsApplyBarrier(msg.type);
+		entry->key = keys;
+		entry->keyLength = 0;
+		if (!entry->barrier)
+		{
+			memcpy(keys, msg.key.buffer, msg.key.length);
+			entry->keyLength = msg.key.length;
+			keys += msg.key.length;
+		}
+		value.Advance(nread);
+		num++;
+	}
+	
+	ops = NULL;
+	if (ownAppend)
+	{
+		ops = (KeyspaceOp**) Alloc(num, sizeof(KeyspaceOp*));
+		it = writeOps.Head();
+		for (i = 0; i < num; i++)
+		{
+			ops[i] = *it;
+			it = writeOps.Next(it);
+		}
+	}
+	
+	// second pass: sort the runs between barrier commands by key and
+	// execute them in that order, so the btree is written in key order;
+	// each command is executed with its original commandID
+	sw.Start();
+	for (start = 0; start < num; start = end)
+	{
+		if (entries[start].barrier)
+			end = start + 1;
+		else
+		{
+			for (end = start; end < num && !entries[end].barrier; end++)
+				/* empty */;
+			qsort(&entries[start], end - start, sizeof(ApplyEntry),
+				  CompareApplyEntries);
+		}
+		
+		for (i = start; i < end; i++)
+		{
+			entry = &entries[i];
+			cmd.Init();
+			cmd.buffer = entry->cmd;
+			cmd.size = entry->cmdLength;
+			cmd.length = entry->cmdLength;
+			if (!ReadMsg(cmd, nread))
+				ASSERT_FAIL();
+			ret = Execute(transaction, paxosID, entry->commandID);
+			if (ownAppend)
+				SetOpResult(ops[entry->commandID], ret);
+		}
+	}
+	sw.Stop();
+	
+	numOps = num;
+	
+	Log_Trace("time spent in Execute(): %ld", sw.elapsed);
+	Log_Trace("ops = %u", numOps);
+
+	free(ops);
+	free(keyBuffer);
+	free(entries);
+}
+
+bool ReplicatedKeyspaceDB::ReadMsg(ByteString& data, unsigned& nread)
+{
+	if (readBinary)
+		return msg.ReadBinary(data, nread);
+	return msg.Read(data, nread);
+}
+
+bool ReplicatedKeyspaceDB::WriteMsg(ByteString& data)
+{
+	if (binaryCommands)
+		return msg.WriteBinary(data);
+	return msg.Write(data);
+}
+
+void ReplicatedKeyspaceDB::SetOpResult(KeyspaceOp* op, bool ret)
+{
+	if (op->type == KeyspaceOp::DIRTY_GET ||
+		op->type == KeyspaceOp::GET)
+			ASSERT_FAIL();
+	if ((op->type == KeyspaceOp::ADD ||
+		 op->type == KeyspaceOp::TEST_AND_SET ||
+		 op->type == KeyspaceOp::REMOVE) && ret)
+			op->value.Set(wdata);
+	op->status = ret;
+}
+
 bool ReplicatedKeyspaceDB::Execute(
 Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 {
@@ -281,6 +509,7 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		return true;
 
 	bool		ret;
+	bool		exists;
 	unsigned	nread;
 	int64_t		num;
 	uint64_t	storedPaxosID, storedCommandID;
@@ -292,8 +521,11 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 	switch (msg.type)
 	{
 	case KEYSPACE_SET:
+		exists = KeyExists(transaction, msg.key);
 		WriteValue(wdata, paxosID, commandID, msg.value);
 		ret &= table->Set(transaction, msg.key, wdata);
+		if (ret && !exists)
+			keyFilter.Add(msg.key);
 		wdata.Set(msg.value);
 		break;
 
@@ -324,12 +556,12 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		{
 			num = num + msg.num;
 			// print number:
-			wdata.length = snwritef(wdata.buffer, wdata.size, "%U:%U:%I",
-								   paxosID, commandID, num);
+			tmp.length = snwritef(tmp.buffer, tmp.size, "%I", num);
+			WriteValue(wdata, paxosID, commandID, tmp);
 			// write number:
 			ret &= table->Set(transaction, msg.key, wdata);
 			// data is returned to the user
-			wdata.length = snwritef(wdata.buffer, wdata.size, "%I", num);
+			wdata.Set(tmp);
 		}
 		else
 			ret = false;
@@ -342,13 +574,20 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		CHECK_CMD();
 		tmp.Set(userValue);
 		WriteValue(wdata, paxosID, commandID, tmp);
+		exists = KeyExists(transaction, msg.newKey);
 		ret &= table->Set(transaction, msg.newKey, wdata);
 		if (!ret) break;
+		if (!exists)
+			keyFilter.Add(msg.newKey);
 		ret &= table->Delete(transaction, msg.key);
+		if (ret)
+			keyFilter.Remove(msg.key);
 		break;
 
 	case KEYSPACE_DELETE:
 		ret &= table->Delete(transaction, msg.key);
+		if (ret)
+			keyFilter.Remove(msg.key);
 		break;
 		
 	case KEYSPACE_REMOVE:
@@ -358,9 +597,13 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		CHECK_CMD();
 		wdata.Set(userValue);
 		ret &= table->Delete(transaction, msg.key);
+		if (ret)
+			keyFilter.Remove(msg.key);
 		break;
 
 	case KEYSPACE_PRUNE:
+		// the fingerprints of the pruned keys stay in the filter until
+		// it is built again, they only cause false positives
 		ret &= table->Prune(transaction, msg.prefix);
 		break;
 
@@ -370,15 +613,15 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		if (msg.prevExpiryTime > 0)
 		{
 			WriteExpiryTime(kdata, msg.prevExpiryTime, msg.key);
-			table->Delete(transaction, kdata);			
+			expiryTable->Delete(transaction, kdata);			
 		}
 		// write !!t:<expirytime>:<key> => NULL
 		WriteExpiryTime(kdata, msg.nextExpiryTime, msg.key);
 		rdata.Clear();
-		table->Set(transaction, kdata, rdata);
+		expiryTable->Set(transaction, kdata, rdata);
 		// write !!k:<key> => <expiryTime>
 		WriteExpiryKey(kdata, msg.key);
-		table->Set(transaction, kdata, msg.nextExpiryTime);
+		expiryTable->Set(transaction, kdata, msg.nextExpiryTime);
 		ret = true;
 		break;
 
@@ -386,12 +629,13 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		Log_Trace("Expiring key: %.*s", msg.key.length, msg.key.buffer);
 		// delete !!k:<key> => <expiryTime>
 		WriteExpiryKey(kdata, msg.key);
-		table->Delete(transaction, kdata);
+		expiryTable->Delete(transaction, kdata);
 		// delete !!t:<expirytime>:<key> => NULL
 		WriteExpiryTime(kdata, msg.prevExpiryTime, msg.key);
-		table->Delete(transaction, kdata);
+		expiryTable->Delete(transaction, kdata);
 		// delete actual key
-		table->Delete(transaction, msg.key); // (*)
+		if (table->Delete(transaction, msg.key)) // (*)
+			keyFilter.Remove(msg.key);
 		expiryAdded = false;
 		ret = true;
 		break;
@@ -401,17 +645,25 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		Log_Trace("Removing expiry for key: %.*s", msg.key.length, msg.key.buffer);
 		// delete !!k:<key> => <expiryTime>
 		WriteExpiryKey(kdata, msg.key);
-		table->Delete(transaction, kdata);
+		expiryTable->Delete(transaction, kdata);
 		// delete !!t:<expirytime>:<key> => NULL
 		WriteExpiryTime(kdata, msg.prevExpiryTime, msg.key);
-		table->Delete(transaction, kdata);
+		expiryTable->Delete(transaction, kdata);
 		ret = true;
 		break;
 
 	case KEYSPACE_CLEAR_EXPIRIES:
 		Log_Trace("Clearing all expiries");
-		kdata.Writef("!!");
-		table->Prune(transaction, kdata, true);
+		expiryTable->Truncate(transaction);
+		ret = true;
+		break;
+
+	case KEYSPACE_EXPIRE_KEYS:
+		// the keys are read from the expiry table, which is the same
+		// on every replica at this point of the log
+		num = ExpireKeys(transaction, msg.prevExpiryTime, msg.num);
+		Log_Trace("Expired %" PRIi64 " keys", num);
+		expiryAdded = false;
 		ret = true;
 		break;
 
@@ -419,9 +671,49 @@ Transaction* transaction, uint64_t paxosID, uint64_t commandID)
 		ASSERT_FAIL();
 	}
 	
+	if (readCache.IsEnabled())
+		UpdateReadCache(ret);
+	
 	return ret;
 }
 
+void ReplicatedKeyspaceDB::UpdateReadCache(bool ret)
+{
+	// the cached values follow the table on the apply path
+	switch (msg.type)
+	{
+	case KEYSPACE_SET:
+	case KEYSPACE_TEST_AND_SET:
+	case KEYSPACE_ADD:
+		// wdata holds the value the key has now
+		if (ret)
+			readCache.Update(msg.key, wdata);
+		else
+			readCache.Remove(msg.key);
+		break;
+	
+	case KEYSPACE_RENAME:
+		readCache.Remove(msg.key);
+		readCache.Remove(msg.newKey);
+		break;
+	
+	case KEYSPACE_DELETE:
+	case KEYSPACE_REMOVE:
+	case KEYSPACE_EXPIRE:
+		readCache.Remove(msg.key);
+		break;
+	
+	case KEYSPACE_PRUNE:
+		readCache.Clear();
+		break;
+	
+	default:
+		// the expiry commands do not change values, the keys expired by
+		// KEYSPACE_EXPIRE_KEYS are removed in ExpireKeys()
+		break;
+	}
+}
+
 void ReplicatedKeyspaceDB::OnAppendComplete()
 {
 	Log_Trace();
@@ -438,17 +730,29 @@ void ReplicatedKeyspaceDB::OnAppendComplete()
 			it = writeOps.Head();
 			op = *it;
 			writeOps.Remove(op);
+			// the master's own rounds keep the expiry heap up to date
+			if (op->type == KeyspaceOp::SET_EXPIRY)
+				expiryQueue.Add(op->nextExpiryTime, op->key);
+			else if (op->type == KeyspaceOp::EXPIRE_KEYS)
+				expiryQueue.RemoveUntil(expiredUntil);
+			else if (op->type == KeyspaceOp::CLEAR_EXPIRIES)
+				expiryQueue.Clear();
 			if (op->service)
 				op->service->OnComplete(op);
 			else
 			{
-				assert(op->type == KeyspaceOp::EXPIRE);
+				assert(op->type == KeyspaceOp::EXPIRE ||
+					   op->type == KeyspaceOp::EXPIRE_KEYS);
 				delete op;
 			}
 		}
 	}
 	else
+	{
 		Log_Trace("not my append");
+		// rebuilt from the table when this node is the master
+		expiryQueue.Clear();
+	}
 
 	asyncAppenderActive = false;
 	if (RLOG->IsSafeDB())
@@ -459,36 +763,58 @@ void ReplicatedKeyspaceDB::OnAppendComplete()
     else
         ExecuteReadOps();
 
-	RLOG->ContinuePaxos();
-	if (!RLOG->IsAppending() && RLOG->IsMaster() && writeOps.Length() > 0)
-		Append();
+	if (overlapApply)
+		RLOG->ResumePaxos();
+	else
+		RLOG->ContinuePaxos();
+
+	if (writeOps.Length() > 0)
+		Submit();
 }
 
-void ReplicatedKeyspaceDB::Append()
+bool ReplicatedKeyspaceDB::Append()
 {
 	ByteString	bs;
 	KeyspaceOp*	op;
 	KeyspaceOp**it;
 	uint64_t expiryTime;
+	bool		pending;
 
 	Log_Trace();
 	
 	if (writeOps.Length() == 0)
-		return;
+	{
+		batcher.Reset();
+		return false;
+	}
 	
 	pvalue.length = 0;
+	if (binaryCommands)
+		pvalue.buffer[pvalue.length++] = KEYSPACE_MSG_BINARY_V1;
 	bs.Set(pvalue);
+	bs.Advance(pvalue.length);
 
 	unsigned numAppended = 0;
+	pending = false;
 	
 	for (it = writeOps.Head(); it != NULL; it = writeOps.Next(it))
 	{
 		op = *it;
 		
+		// ops of rounds still in the pipeline are at the head
 		if (op->appended)
-			ASSERT_FAIL();
+		{
+			pending = true;
+			continue;
+		}
 		
-		if (op->IsExpiry() && op->type != KeyspaceOp::CLEAR_EXPIRIES)
+		// expiry times are read from the database below, so
+		// wait until the queued rounds have been applied
+		if (op->IsExpiry() && pending)
+			break;
+		
+		if (op->IsExpiry() && op->type != KeyspaceOp::CLEAR_EXPIRIES &&
+			op->type != KeyspaceOp::EXPIRE_KEYS)
 		{
 			// at this point we have up-to-date info on the expiry time
 			expiryTime = GetExpiryTime(op->key);
@@ -497,7 +823,7 @@ void ReplicatedKeyspaceDB::Append()
 
 		
 		msg.FromKeyspaceOp(op);
-		if (msg.Write(bs))
+		if (WriteMsg(bs))
 		{
 			pvalue.length += bs.length;
 			bs.Advance(bs.length);
@@ -513,13 +839,21 @@ void ReplicatedKeyspaceDB::Append()
 			break;
 	}
 	
-	if (pvalue.length > 0)
+	if (numAppended > 0)
 	{
-		estimatedLength -= pvalue.length;
-		if (estimatedLength < 0) estimatedLength = 0;
+		numUnappended -= numAppended;
+		if (estimatedLength > pvalue.length && numUnappended > 0)
+			estimatedLength -= pvalue.length;
+		else
+			estimatedLength = 0;
 		RLOG->Append(pvalue);
+		batcher.OnFlush(pvalue.length, estimatedLength);
 		Log_Trace("appending %d writeOps (length: %d)", numAppended, pvalue.length);
+		return true;
 	}
+	
+	batcher.Reset();
+	return false;
 }
 
 void ReplicatedKeyspaceDB::FailKeyspaceOps()
@@ -565,12 +899,16 @@ void ReplicatedKeyspaceDB::FailWriteOps()
 			op->service->OnComplete(op);
 		else
 		{
-			assert(op->type == KeyspaceOp::EXPIRE);
+			assert(op->type == KeyspaceOp::EXPIRE ||
+				   op->type == KeyspaceOp::EXPIRE_KEYS);
 			delete op;
 		}
 	}
 
 	expiryAdded = false;
+	estimatedLength = 0;
+	numUnappended = 0;
+	batcher.Reset();
 
 	if (writeOps.Length() > 0)
 		ASSERT_FAIL();
@@ -578,6 +916,8 @@ void ReplicatedKeyspaceDB::FailWriteOps()
 
 void ReplicatedKeyspaceDB::OnMasterLease()
 {
+	// another master may have changed the expiries meanwhile
+	expiryQueue.Clear();
 	InitExpiryTimer();
 }
 
@@ -591,6 +931,18 @@ void ReplicatedKeyspaceDB::OnMasterLeaseExpired()
 	Log_Trace("writeOps.size() = %d", writeOps.Length());
 	
 	EventLoop::Remove(&expiryTimer);
+	expiryQueue.Clear();
+}
+
+void ReplicatedKeyspaceDB::OnQueueCleared()
+{
+	Log_Trace("writeOps.size() = %d", writeOps.Length());
+	
+	// the rounds proposed ahead were dropped by the replicated log,
+	// the ops in them may or may not have been chosen; they are
+	// failed with the ops behind them
+	assert(asyncAppenderActive == false);
+	FailWriteOps();
 }
 
 void ReplicatedKeyspaceDB::OnDoCatchup(unsigned nodeID)
@@ -601,16 +953,33 @@ void ReplicatedKeyspaceDB::OnDoCatchup(unsigned nodeID)
 	// database bigger than 1Gb, as confirmed by BDB workers on forums
 	//	if (RLOG->GetPaxosID() != 0)
 	//		RESTART("exiting to truncate database");
+	//
+	// the missing rounds are replayed from the other node's log cache
+	// first, the database is only truncated if that fails
+	catchupNodeID = nodeID;
+	readCache.Clear();
 	if (RLOG->GetPaxosID() > 0)
 	{
-		Log_Message("Truncating database");
-		deleteDB = true;
-		EventLoop::Stop();
+		Log_Message("Catchup of rounds from %" PRIu64 " started from node %d",
+					RLOG->GetPaxosID(), nodeID);
+
+		catchingUp = true;
+		RLOG->StopPaxos();
+		RLOG->StopMasterLease();
+		catchupClient.StartRounds(nodeID, RLOG->GetPaxosID());
+		return;
+	}
+
+	if (snapshotCatchup)
+	{
+		StartSnapshotCatchup();
 		return;
 	}
 
 	Log_Message("Catchup started from node %d", nodeID);
 
+	// the keys are written to the table directly, not by Execute()
+	keyFilter.Disable();
 	catchingUp = true;
 	RLOG->StopPaxos();
 	RLOG->StopMasterLease();
@@ -623,7 +992,11 @@ void ReplicatedKeyspaceDB::OnCatchupComplete()
 
 	Log_Message("Catchup complete");
 
+	readCache.Clear();
+	if (!keyFilter.IsActive())
+		BuildKeyFilter();
 	catchingUp = false;
+	snapshotRounds = false;
 	RLOG->ContinuePaxos();
 	RLOG->ContinueMasterLease();
 }
@@ -634,11 +1007,193 @@ void ReplicatedKeyspaceDB::OnCatchupFailed()
 
 	Log_Message("Catchup failed");
 
+	readCache.Clear();
+	if (shadowTable != NULL)
+	{
+		// the tables were not touched, Paxos will start another catchup
+		database.DeleteShadowTables();
+		shadowTable = NULL;
+		shadowExpiryTable = NULL;
+		
+		if (!keyFilter.IsActive())
+			BuildKeyFilter();
+		catchingUp = false;
+		RLOG->ContinuePaxos();
+		RLOG->ContinueMasterLease();
+		return;
+	}
+	
+	if (snapshotRounds)
+	{
+		// the log cache does not reach back to the snapshot, Paxos will
+		// start another catchup
+		snapshotRounds = false;
+		if (!keyFilter.IsActive())
+			BuildKeyFilter();
+		catchingUp = false;
+		RLOG->ContinuePaxos();
+		RLOG->ContinueMasterLease();
+		return;
+	}
+	
+	if (snapshotCatchup && RLOG->GetPaxosID() > 0)
+	{
+		StartSnapshotCatchup();
+		return;
+	}
+
+	if (shadowCatchup && RLOG->GetPaxosID() > 0)
+	{
+		StartShadowCatchup();
+		return;
+	}
+
 	Log_Message("Truncating database");
 	deleteDB = true;
 	EventLoop::Stop();
 }
 
+void ReplicatedKeyspaceDB::StartShadowCatchup()
+{
+	Log_Trace();
+	
+	// catching up into new tables instead of truncating these ones
+	// avoids the restart and keeps the cache warm
+	shadowTable = database.CreateShadowTable("keyspace");
+	shadowExpiryTable = database.CreateShadowTable("expiry");
+	if (shadowTable == NULL || shadowExpiryTable == NULL)
+		ASSERT_FAIL();
+	
+	Log_Message("Catchup into shadow tables started from node %d",
+				catchupNodeID);
+	
+	catchingUp = true;
+	RLOG->StopPaxos();
+	RLOG->StopMasterLease();
+	catchupClient.StartShadow(catchupNodeID, shadowTable, shadowExpiryTable);
+}
+
+void ReplicatedKeyspaceDB::StartSnapshotCatchup()
+{
+	Log_Trace();
+	
+	// the other node's database files are copied and recovered into
+	// the shadow tables, the rounds after it are replayed then
+	Log_Message("Catchup of snapshot started from node %d", catchupNodeID);
+	
+	catchingUp = true;
+	snapshotting = true;
+	RLOG->StopPaxos();
+	RLOG->StopMasterLease();
+	catchupClient.StartSnapshot(catchupNodeID);
+}
+
+void ReplicatedKeyspaceDB::OnSnapshotCatchupFailed()
+{
+	Log_Trace();
+	
+	Log_Message("Catchup of snapshot failed");
+	
+	snapshotting = false;
+	database.DeleteShadowTables();
+	
+	// an older node, or one without a snapshot, copies the key-values
+	if (RLOG->GetPaxosID() == 0)
+	{
+		Log_Message("Catchup started from node %d", catchupNodeID);
+		keyFilter.Disable();
+		catchupClient.Start(catchupNodeID);
+		return;
+	}
+	
+	if (shadowCatchup)
+	{
+		StartShadowCatchup();
+		return;
+	}
+	
+	Log_Message("Truncating database");
+	deleteDB = true;
+	EventLoop::Stop();
+}
+
+void ReplicatedKeyspaceDB::OnShadowCatchupComplete(uint64_t paxosID_)
+{
+	Log_Trace();
+	
+	shadowTable = NULL;
+	shadowExpiryTable = NULL;
+	
+	// the Paxos state is not in the shadow tables, the paxosID is
+	// written in the transaction that switches them
+	Transaction tx(&database);
+	tx.Begin();
+	PaxosAcceptor::WritePaxosID(database.GetTable("meta"), &tx, paxosID_);
+	if (!database.CommitShadowTables(&tx))
+	{
+		Log_Message("Catchup failed, cannot switch to the shadow tables");
+		
+		catchingUp = false;
+		snapshotting = false;
+		RLOG->ContinuePaxos();
+		RLOG->ContinueMasterLease();
+		return;
+	}
+	
+	Log_Message("Switched to the shadow tables");
+	readCache.Clear();
+	keyFilter.Disable();
+	
+	// this also resets the Paxos state in memory
+	tx.Begin();
+	RLOG->SetPaxosID(&tx, paxosID_);
+	tx.Commit();
+	
+	if (snapshotting)
+	{
+		snapshotting = false;
+		snapshotRounds = true;
+		
+		Log_Message("Catchup of rounds from %" PRIu64 " started from node %d",
+					paxosID_, catchupNodeID);
+		catchupClient.StartRounds(catchupNodeID, paxosID_);
+		return;
+	}
+	
+	OnCatchupComplete();
+}
+
+bool ReplicatedKeyspaceDB::ApplyCatchupRound(Transaction* transaction_,
+uint64_t paxosID_, ByteString value)
+{
+	unsigned	nread;
+	uint64_t	commandID;
+
+	Log_Trace("paxosID = %" PRIu64 ", length: %d", paxosID_, value.length);
+
+	// same as AsyncOnAppend(), but runs synchronously because Paxos
+	// is stopped while catching up
+	readBinary = (value.length > 0 && value.buffer[0] == KEYSPACE_MSG_BINARY_V1);
+	if (readBinary)
+		value.Advance(1);
+
+	commandID = 0;
+	while (value.length > 0)
+	{
+		if (!ReadMsg(value, nread))
+		{
+			Log_Trace("Failed parsing:");
+			Log_Trace("%.*s", value.length, value.buffer);
+			return false;
+		}
+		Execute(transaction_, paxosID_, commandID);
+		commandID++;
+		value.Advance(nread);
+	}
+
+	return true;
+}
+
 void ReplicatedKeyspaceDB::SetProtocolServer(ProtocolServer* pserver)
 {
 	pservers.Append(pserver);
@@ -654,75 +1209,197 @@ void ReplicatedKeyspaceDB::OnExpiryTimer()
 	assert(RLOG->IsMaster());
 	
 	uint64_t	expiryTime;
-	Cursor		cursor;
 	ByteString	key;
 	KeyspaceOp*	op;
 
 	Log_Trace();
 	
-	if (expiryAdded)
+	// the timer is reset in OnAppendComplete()
+	if (expiryAdded || asyncAppenderActive)
 		return;
 	
 	transaction = RLOG->GetTransaction();
 	if (!transaction->IsActive())
 		transaction->Begin();
 	
-	table->Iterate(transaction, cursor);	
-	kdata.Set("!!t:");
-	if (!cursor.Start(kdata))
-		ASSERT_FAIL();
-	cursor.Close();
-	
-	if (kdata.length < 2)
-		ASSERT_FAIL();
-	
-	if (kdata.buffer[0] != '!' || kdata.buffer[1] != '!')
-		ASSERT_FAIL();
-
-	ReadExpiryTime(kdata, expiryTime, key);
+	while (true)
+	{
+		if (expiryQueue.NeedsLoad())
+			expiryQueue.Load(transaction);
+		if (!expiryQueue.Head(expiryTime, key))
+			return;
+		
+		if (expiryTime > EventLoop::Now())
+		{
+			expiryTimer.Set(expiryTime);
+			EventLoop::Add(&expiryTimer);
+			return;
+		}
+		
+		// expiries removed or changed since are still in the heap,
+		// the head is only expired if the table has it
+		WriteExpiryTime(kdata, expiryTime, key);
+		if (expiryTable->Get(transaction, kdata, rdata))
+			break;
+		expiryQueue.RemoveHead();
+	}
 	
 	op = new KeyspaceOp;
 	op->cmdID = 0;
-	op->type = KeyspaceOp::EXPIRE;
-	op->key.Allocate(key.length);
-	op->key.Set(key);
-	// expiryTime is set in Append()
+	if (expiryBatch > 1)
+	{
+		// expire every key that is due in one round
+		op->type = KeyspaceOp::EXPIRE_KEYS;
+		op->prevExpiryTime = EventLoop::Now();
+		op->num = expiryBatch;
+	}
+	else
+	{
+		op->type = KeyspaceOp::EXPIRE;
+		op->key.Allocate(key.length);
+		op->key.Set(key);
+		// expiryTime is set in Append()
+	}
 	op->service = NULL;
 	Add(op);
 	Submit();
 }
 
+int64_t ReplicatedKeyspaceDB::ExpireKeys(
+Transaction* transaction, uint64_t expiryTime, int64_t limit)
+{
+	Cursor		cursor;
+	KeyBuffer	tkey;
+	ByteString	key;
+	uint64_t	t;
+	int64_t		num;
+	bool		ret;
+	
+	// the expiry times are zero padded, so the rows are in time order
+	num = 0;
+	expiredUntil = expiryTime;
+	expiryTable->Iterate(transaction, cursor);
+	tkey.Set("!!t:");
+	ret = cursor.Start(tkey, rdata);
+	while (ret && num < limit)
+	{
+		if (tkey.length < 4 || memcmp(tkey.buffer, "!!t:", 4) != 0)
+			break;
+		
+		ReadExpiryTime(tkey, t, key);
+		if (t > expiryTime)
+			break;
+		
+		// delete !!t:<expirytime>:<key> => NULL
+		cursor.Delete();
+		// delete !!k:<key> => <expiryTime>
+		WriteExpiryKey(kdata, key);
+		expiryTable->Delete(transaction, kdata);
+		// delete actual key
+		if (table->Delete(transaction, key))
+			keyFilter.Remove(key);
+		readCache.Remove(key);
+		num++;
+		
+		// the ones at this time may not all fit
+		if (num == limit)
+			expiredUntil = t - 1;
+		
+		ret = cursor.Next(tkey, rdata);
+	}
+	cursor.Close();
+	
+	return num;
+}
+
+void ReplicatedKeyspaceDB::OnBatchTimeout()
+{
+	Log_Trace();
+	
+	Submit();
+}
+
+void ReplicatedKeyspaceDB::PrintStats(ByteString& text)
+{
+	ByteString catchupStats;
+	ByteString cacheStats;
+	ByteString filterStats;
+	
+	batcher.PrintStats(text);
+	
+	catchupStats.buffer = text.buffer + text.length;
+	catchupStats.size = text.size - text.length;
+	catchupServer.PrintStats(catchupStats);
+	text.length += catchupStats.length;
+	
+	cacheStats.buffer = text.buffer + text.length;
+	cacheStats.size = text.size - text.length;
+	readCache.PrintStats(cacheStats);
+	text.length += cacheStats.length;
+	
+	filterStats.buffer = text.buffer + text.length;
+	filterStats.size = text.size - text.length;
+	keyFilter.PrintStats(filterStats);
+	text.length += filterStats.length;
+}
+
+void ReplicatedKeyspaceDB::BuildKeyFilter()
+{
+	uint64_t	capacity;
+
+	if (keyFilterSize == 0)
+		return;
+	
+	// the table is scanned without a transaction, so this must not be
+	// called while a round is being applied
+	capacity = MAX(keyFilterSize, keyFilter.GetCapacity());
+	while (keyFilter.Init(capacity) && !keyFilter.Build(table))
+		capacity = keyFilter.GetCapacity() * 2;
+	
+	if (keyFilter.IsActive())
+		Log_Message("Key filter built for %" PRIu64 " keys",
+					keyFilter.GetCapacity());
+}
+
+bool ReplicatedKeyspaceDB::KeyExists(Transaction* transaction,
+const ByteString& key)
+{
+	// without the filter the result is not used
+	if (!keyFilter.IsActive())
+		return true;
+	
+	if (!keyFilter.MayContain(key))
+		return false;
+	
+	return table->Exists(transaction, key);
+}
+
 void ReplicatedKeyspaceDB::InitExpiryTimer()
 {
 	uint64_t	expiryTime;
-	Cursor		cursor;
 	ByteString	key;
 
 	Log_Trace();
 	
 	EventLoop::Remove(&expiryTimer);
 	
+	// the expiry table is being written, this is called again
+	// in OnAppendComplete()
+	if (asyncAppenderActive)
+		return;
+	
 	transaction = RLOG->GetTransaction();
 	if (!transaction->IsActive())
 		transaction->Begin();
 
-	table->Iterate(transaction, cursor);
-	
-	kdata.Set("!!t:");
-	if (!cursor.Start(kdata))
-	{
-		cursor.Close();
-		return;
-	}
-	cursor.Close();
+	// the heap is read from the table when this node becomes the
+	// master, the next expiry is known without a seek afterwards
+	if (expiryQueue.NeedsLoad())
+		expiryQueue.Load(transaction);
 	
-	if (kdata.length < 2)
+	if (!expiryQueue.Head(expiryTime, key))
 		return;
 	
-	if (kdata.buffer[0] != '!' || kdata.buffer[1] != '!')
-		return;
-
-	ReadExpiryTime(kdata, expiryTime, key);
 	Log_Trace("Setting expiry for %.*s at %" PRIu64 "", key.length, key.buffer, expiryTime);
 
 	expiryTimer.Set(expiryTime);
@@ -736,7 +1413,7 @@ uint64_t ReplicatedKeyspaceDB::GetExpiryTime(ByteString key)
 	unsigned nread;
 	
 	WriteExpiryKey(kdata, key);
-	if (table->Get(RLOG->GetTransaction(), kdata, rdata))
+	if (expiryTable->Get(RLOG->GetTransaction(), kdata, rdata))
 	{
 		Log_Trace("read %.*s => %.*s", kdata.length, kdata.buffer, rdata.length, rdata.buffer);
 		// the key has an expiry
@@ -761,8 +1438,6 @@ void ReplicatedKeyspaceDB::ExecuteGetOps()
 {
     Log_Trace();
     
-	uint64_t        storedPaxosID, storedCommandID;
-	ByteString      userValue;
     KeyspaceOp**    it;
     KeyspaceOp*     op;
     
@@ -779,21 +1454,44 @@ void ReplicatedKeyspaceDB::ExecuteGetOps()
             op->status = false;
         }
         else
-        {
-            op->value.Allocate(KEYSPACE_VAL_SIZE);
-            op->status = table->Get(NULL, op->key, rdata);
-            if (op->status)
-            {
-                ReadValue(rdata, storedPaxosID, storedCommandID, userValue);
-                op->value.Set(userValue);
-            }
-        }
+            ExecuteGet(op);
 
         it = getOps.Remove(it);
 		op->service->OnComplete(op);
     }
 }
 
+void ReplicatedKeyspaceDB::ExecuteGet(KeyspaceOp* op)
+{
+	uint64_t	storedPaxosID, storedCommandID;
+	ByteString	userValue;
+	
+	// the cache has the values of the table, this is only called when
+	// no round is being applied
+	if (readCache.Get(op->key, userValue))
+	{
+		op->status = true;
+		op->value.Set(userValue);
+		return;
+	}
+	
+	// the filter also follows the table, it has no false negatives
+	if (!keyFilter.MayContain(op->key))
+	{
+		op->status = false;
+		return;
+	}
+	
+	op->value.Allocate(KEYSPACE_VAL_SIZE);
+	op->status = table->Get(NULL, op->key, rdata);
+	if (op->status)
+	{
+		ReadValue(rdata, storedPaxosID, storedCommandID, userValue);
+		op->value.Set(userValue);
+		readCache.Add(op->key, userValue);
+	}
+}
+
 void ReplicatedKeyspaceDB::ExecuteListWorkers()
 {
     Log_Trace();
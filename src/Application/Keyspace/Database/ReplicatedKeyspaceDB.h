@@ -13,6 +13,10 @@
 #include "Application/Keyspace/Catchup/CatchupReader.h"
 #include "KeyspaceMsg.h"
 #include "KeyspaceDB.h"
+#include "WriteBatcher.h"
+#include "ExpiryQueue.h"
+#include "ReadCache.h"
+#include "KeyFilter.h"
 
 class ReplicatedKeyspaceDB : public ReplicatedDB, public KeyspaceDB
 {
@@ -40,16 +44,24 @@ public:
 	
 	void			OnCatchupComplete();	// called by CatchupClient
 	void			OnCatchupFailed();		// called by CatchupClient
+	void			OnShadowCatchupComplete(uint64_t paxosID);
+	void			OnSnapshotCatchupFailed();
+	bool			ApplyCatchupRound(Transaction* transaction,
+									  uint64_t paxosID, ByteString value);
 	void			OnExpiryTimer();
+	void			OnBatchTimeout();
+	void			PrintStats(ByteString& text);
 	
 // ReplicatedDB interface:
 	virtual void	OnAppend(Transaction* transaction, uint64_t paxosID,
 							 ByteString value, bool ownAppend);
 	virtual void	OnMasterLease();
 	virtual void	OnMasterLeaseExpired();
+	virtual void	OnQueueCleared();
 	virtual void	OnDoCatchup(unsigned nodeID);
 	
 	void			AsyncOnAppend();
+	void			AsyncOnAppendSorted(ByteString value);
 	void			OnAppendComplete();
 
 	bool			IsCatchingUp();
@@ -58,15 +70,26 @@ public:
 	
 private:
 	bool			AddWithoutReplicatedLog(KeyspaceOp* op);
+	void			StartShadowCatchup();
+	void			StartSnapshotCatchup();
 	bool			Execute(Transaction* transaction,
 							uint64_t paxosID, uint64_t commandID);
-	void			Append();
+	bool			Append();
+	bool			ReadMsg(ByteString& data, unsigned& nread);
+	bool			WriteMsg(ByteString& data);
+	void			SetOpResult(KeyspaceOp* op, bool ret);
 	void			FailKeyspaceOps();
 	void			InitExpiryTimer();
 	uint64_t		GetExpiryTime(ByteString key);
+	int64_t			ExpireKeys(Transaction* transaction,
+						   uint64_t expiryTime, int64_t limit);
 
     void            ExecuteReadOps();
     void            ExecuteGetOps();
+	void			ExecuteGet(KeyspaceOp* op);
+	void			UpdateReadCache(bool ret);
+	void			BuildKeyFilter();
+	bool			KeyExists(Transaction* transaction, const ByteString& key);
     void            ExecuteListWorkers();
     void            ExecuteListWorker(KeyspaceOp** it);
     void            FailReadOps();
@@ -74,12 +97,24 @@ private:
     void            OnListWorkerTimeout();
 	
 	bool			asyncAppenderActive;
+	bool			overlapApply;
+	bool			sortedApply;
+	bool			binaryCommands;
+	bool			readBinary;
 	bool			catchingUp;
+	bool			shadowCatchup;
+	bool			snapshotCatchup;
+	bool			snapshotting;		// receiving or recovering a snapshot
+	bool			snapshotRounds;		// replaying the rounds after it
+	unsigned		catchupNodeID;
+	Table*			shadowTable;
+	Table*			shadowExpiryTable;
 	OpList			writeOps;
 	OpList			getOps;
 	OpList			listOps;
 
 	Table*			table;
+	Table*			expiryTable;
 	KeyspaceMsg		msg;
 	KeyspaceMsg		tmp;
 	PaxosBuffer		pvalue;
@@ -100,12 +135,21 @@ private:
 	unsigned		numOps;
 	ServerList		pservers;
 	unsigned		estimatedLength;
+	unsigned		numUnappended;		// writeOps not yet in a round
 	bool			deleteDB;
 	Func			onExpiryTimer;
 	Timer			expiryTimer;
+	ExpiryQueue		expiryQueue;
+	ReadCache		readCache;
+	KeyFilter		keyFilter;
+	uint64_t		keyFilterSize;
 	bool			expiryAdded;
+	int64_t			expiryBatch;
+	uint64_t		expiredUntil;
     Func            onListWorkerTimeout;
     CdownTimer      listTimer;	
+	Func			onBatchTimeout;
+	WriteBatcher	batcher;
 };
 
 #endif
@@ -5,6 +5,7 @@
 #include "System/Log.h"
 #include "System/Common.h"
 #include "System/Events/EventLoop.h"
+#include "System/Config.h"
 //#include "Framework/AsyncDatabase/AsyncDatabase.h"
 #include "SyncListVisitor.h"
 
@@ -21,7 +22,11 @@ bool SingleKeyspaceDB::Init()
 	Log_Trace();
 	
 	table = database.GetTable("keyspace");
+	expiryTable = database.GetTable("expiry");
+	metaTable = database.GetTable("meta");
 	writePaxosID = true;
+	InitValueFormat();
+	readCache.Init(MAX(0, Config::GetIntValue("keyspace.readCacheSize", 0)));
 	
 	InitExpiryTimer();
 	
@@ -61,6 +66,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 	unsigned		nread;
 	uint64_t		storedPaxosID, storedCommandID, expiryTime;
 	ByteString		userValue;
+	ByteArray<32>	numBuffer;
 		
 	isWrite = op->IsWrite();
 	
@@ -73,18 +79,24 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 	op->status = true;
 	if (op->IsWrite() && writePaxosID)
 	{
-		if (table->Set(&transaction, "@@paxosID", "1"))
+		if (metaTable->Set(&transaction, "@@paxosID", "1"))
 			writePaxosID = false;
 	}
 	
 	if (op->IsGet())
 	{
-		op->value.Allocate(KEYSPACE_VAL_SIZE);
-		op->status &= table->Get(NULL, op->key, vdata);
-		if (op->status)
-		{
-			ReadValue(vdata, storedPaxosID, storedCommandID, userValue);
+		if (readCache.Get(op->key, userValue))
 			op->value.Set(userValue);
+		else
+		{
+			op->value.Allocate(KEYSPACE_VAL_SIZE);
+			op->status &= table->Get(NULL, op->key, vdata);
+			if (op->status)
+			{
+				ReadValue(vdata, storedPaxosID, storedCommandID, userValue);
+				op->value.Set(userValue);
+				readCache.Add(op->key, userValue);
+			}
 		}
 		op->service->OnComplete(op);
 	}
@@ -100,6 +112,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 	{
 		WriteValue(vdata, 1, 0, op->value);
 		op->status &= table->Set(&transaction, op->key, vdata);
+		UpdateReadCache(op);
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::TEST_AND_SET)
@@ -116,6 +129,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 			else
 				op->value.Set(userValue);
 		}
+		UpdateReadCache(op);
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::ADD)
@@ -131,17 +145,18 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 			{
 				num = num + op->num;
 				 // print number:
-				vdata.length = snwritef(vdata.buffer, vdata.size, "1:0:%I", num);
+				numBuffer.length = snwritef(numBuffer.buffer, numBuffer.size, "%I", num);
+				WriteValue(vdata, 1, 0, numBuffer);
 				 // write number:
 				op->status &= table->Set(&transaction, op->key, vdata);
 				// returned to the user:
-				vdata.length = snwritef(vdata.buffer, vdata.size, "%I", num);
-				op->value.Allocate(vdata.length);
-				op->value.Set(vdata);
+				op->value.Allocate(numBuffer.length);
+				op->value.Set(numBuffer);
 			}
 			else
 				op->status = false;
 		}
+		UpdateReadCache(op);
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::RENAME)
@@ -154,11 +169,14 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 			if (op->status)
 				op->status &= table->Delete(&transaction, op->key);
 		}
+		readCache.Remove(op->key);
+		readCache.Remove(op->newKey);
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::DELETE)
 	{
 		op->status &= table->Delete(&transaction, op->key);
+		readCache.Remove(op->key);
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::REMOVE)
@@ -171,12 +189,14 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 			op->value.Set(userValue);
 			op->status &= table->Delete(&transaction, op->key);
 		}
+		readCache.Remove(op->key);
 		op->service->OnComplete(op);
 	}
 
 	else if (op->type == KeyspaceOp::PRUNE)
 	{
 		op->status &= table->Prune(&transaction, op->prefix);
+		readCache.Clear();
 		op->service->OnComplete(op);
 	}
 	else if (op->type == KeyspaceOp::SET_EXPIRY)
@@ -184,7 +204,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 		Log_Trace("Setting expiry for key: %.*s", op->key.length, op->key.buffer);
 		// check old expiry
 		WriteExpiryKey(kdata, op->key);
-		if (table->Get(&transaction, kdata, vdata))
+		if (expiryTable->Get(&transaction, kdata, vdata))
 		{
 			// this key already had an expiry
 			expiryTime = strntouint64(vdata.buffer, vdata.length, &nread);
@@ -192,15 +212,15 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 				ASSERT_FAIL();
 			// delete old value
 			WriteExpiryTime(kdata, expiryTime, op->key);
-			table->Delete(&transaction, kdata);
+			expiryTable->Delete(&transaction, kdata);
 		}
 		// write !!t:<expirytime>:<key> => NULL
 		WriteExpiryTime(kdata, op->nextExpiryTime, op->key);
 		op->value.Clear();
-		table->Set(&transaction, kdata, op->value);
+		expiryTable->Set(&transaction, kdata, op->value);
 		// write !!k:<key> => <expiryTime>
 		WriteExpiryKey(kdata, op->key);
-		table->Set(&transaction, kdata, op->nextExpiryTime);
+		expiryTable->Set(&transaction, kdata, op->nextExpiryTime);
 		InitExpiryTimer();
 		op->status = true;
 		op->service->OnComplete(op);
@@ -210,7 +230,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 		Log_Trace("Removing expiry for key: %.*s", op->key.length, op->key.buffer);
 		// check old expiry
 		WriteExpiryKey(kdata, op->key);
-		if (table->Get(&transaction, kdata, vdata))
+		if (expiryTable->Get(&transaction, kdata, vdata))
 		{
 			// this key already had an expiry
 			expiryTime = strntouint64(vdata.buffer, vdata.length, &nread);
@@ -218,10 +238,10 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 				ASSERT_FAIL();
 			// delete old value
 			WriteExpiryTime(kdata, expiryTime, op->key);
-			table->Delete(&transaction, kdata);
+			expiryTable->Delete(&transaction, kdata);
 		}
 		WriteExpiryKey(kdata, op->key);
-		table->Delete(&transaction, kdata);
+		expiryTable->Delete(&transaction, kdata);
 		InitExpiryTimer();
 		op->status = true;
 		op->service->OnComplete(op);
@@ -229,8 +249,7 @@ bool SingleKeyspaceDB::Add(KeyspaceOp* op)
 	else if (op->type == KeyspaceOp::CLEAR_EXPIRIES)
 	{
 		Log_Trace("Clearing all expiries");
-		kdata.Writef("!!");
-		table->Prune(&transaction, kdata, true);
+		expiryTable->Truncate(&transaction);
 		InitExpiryTimer();
 		op->status = true;
 		op->service->OnComplete(op);		
@@ -251,6 +270,20 @@ bool SingleKeyspaceDB::Submit()
 	return true;
 }
 
+void SingleKeyspaceDB::UpdateReadCache(KeyspaceOp* op)
+{
+	// op->value holds the value the key has now
+	if (op->status)
+		readCache.Update(op->key, op->value);
+	else
+		readCache.Remove(op->key);
+}
+
+void SingleKeyspaceDB::PrintStats(ByteString& text)
+{
+	readCache.PrintStats(text);
+}
+
 void SingleKeyspaceDB::InitExpiryTimer()
 {
 	uint64_t	expiryTime;
@@ -260,7 +293,7 @@ void SingleKeyspaceDB::InitExpiryTimer()
 	Log_Trace();
 	EventLoop::Remove(&expiryTimer);	
 	
-	table->Iterate(NULL, cursor);
+	expiryTable->Iterate(NULL, cursor);
 	
 	kdata.Set("!!t:");
 	if (!cursor.Start(kdata))
@@ -287,7 +320,7 @@ void SingleKeyspaceDB::OnExpiryTimer()
 
 	Log_Trace();
 	
-	table->Iterate(NULL, cursor);	
+	expiryTable->Iterate(NULL, cursor);	
 	kdata.Set("!!t:");
 	if (!cursor.Start(kdata))
 		ASSERT_FAIL();
@@ -300,11 +333,12 @@ void SingleKeyspaceDB::OnExpiryTimer()
 		ASSERT_FAIL();
 
 	ReadExpiryTime(kdata, expiryTime, key);
-	table->Delete(NULL, kdata);
+	expiryTable->Delete(NULL, kdata);
 	table->Delete(NULL, key);
+	readCache.Remove(key);
 
 	WriteExpiryKey(kdata, key);
-	table->Delete(NULL, kdata);
+	expiryTable->Delete(NULL, kdata);
 	
 	Log_Trace("Expiring key: %.*s", key.length, key.buffer);
 
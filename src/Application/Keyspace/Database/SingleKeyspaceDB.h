@@ -4,6 +4,7 @@
 #include "Framework/Database/Database.h"
 #include "Framework/Database/Transaction.h"
 #include "KeyspaceDB.h"
+#include "ReadCache.h"
 
 class SingleKeyspaceDB : public KeyspaceDB
 {
@@ -29,19 +30,24 @@ public:
 	void				Stop() {}
 	void				Continue() {}
 	void				OnExpiryTimer();
+	void				PrintStats(ByteString& text);
 	
 private:
 	bool				writePaxosID;
 	KBuffer				kdata;
 	VBuffer				vdata;
 	Table*				table;
+	Table*				expiryTable;
+	Table*				metaTable;
 	Transaction			transaction;
 	Func				onExpiryTimer;
 	Timer				expiryTimer;
 	OpList              listOps;
     Func                onListWorkerTimeout;
     CdownTimer          listTimer;
+	ReadCache			readCache;
 
+	void				UpdateReadCache(KeyspaceOp* op);
     void                ExecuteListWorkers();
     void                ExecuteListWorker(KeyspaceOp** it);
     void                OnListWorkerTimeout();
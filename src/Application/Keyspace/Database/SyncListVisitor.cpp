@@ -60,12 +60,6 @@ bool SyncListVisitor::Accept(const ByteString &key,
         return false;
     }
     
-	// don't list system keys
-	if (key.length >= 2 && key.buffer[0] == '@' && key.buffer[1] == '@')
-		return true;
-	if (key.length >= 2 && key.buffer[0] == '!' && key.buffer[1] == '!')
-		return true;
-	
 	if (num == 0 && startKey != key && offset > 0)
 	{
 		offset--;
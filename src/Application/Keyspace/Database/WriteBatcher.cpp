@@ -0,0 +1,183 @@
+#include "WriteBatcher.h"
+#include "System/Config.h"
+#include "System/Events/EventLoop.h"
+#include "Framework/Paxos/PaxosConsts.h"
+
+WriteBatcher::WriteBatcher(Callable* onTimeout)
+:	timer(onTimeout)
+{
+	maxDelay = BATCHER_DEFAULT_DELAY;
+	maxSize = PAXOS_SIZE;
+	firstAdded = 0;
+	deadline = 0;
+	reason = UNBATCHED;
+	rate = 0;
+	rateStarted = 0;
+	rateBytes = 0;
+	numOnSize = 0;
+	numOnTimeout = 0;
+	numOnLowLoad = 0;
+	numUnbatched = 0;
+}
+
+void WriteBatcher::Init()
+{
+	int size;
+
+	maxDelay = MAX(0, Config::GetIntValue("rlog.batchDelay",
+										  BATCHER_DEFAULT_DELAY));
+
+	size = Config::GetIntValue("rlog.batchSize", PAXOS_SIZE);
+	if (size <= 0 || size > PAXOS_SIZE)
+		size = PAXOS_SIZE;
+	maxSize = size;
+}
+
+void WriteBatcher::Shutdown()
+{
+	EventLoop::Remove(&timer);
+}
+
+void WriteBatcher::OnAdd(unsigned length)
+{
+	uint64_t now;
+
+	now = EventLoop::Now();
+	UpdateRate(now);
+	rateBytes += length;
+
+	if (firstAdded == 0)
+		firstAdded = now;
+}
+
+bool WriteBatcher::ShouldFlush(unsigned length, uint64_t roundTime)
+{
+	uint64_t now;
+	uint64_t wait;
+
+	if (maxDelay == 0)
+	{
+		reason = UNBATCHED;
+		return true;
+	}
+
+	if (length >= maxSize)
+	{
+		reason = ON_SIZE;
+		return true;
+	}
+
+	now = EventLoop::Now();
+	if (firstAdded == 0)
+		firstAdded = now;
+
+	if (deadline == 0)
+	{
+		// waiting longer than a round takes gains nothing
+		wait = MIN((uint64_t) maxDelay, roundTime);
+		UpdateRate(now);
+		if (wait == 0 || rate * wait * BATCHER_MIN_GROWTH < length)
+		{
+			reason = ON_LOW_LOAD;
+			return true;
+		}
+		deadline = firstAdded + wait;
+	}
+
+	if (now >= deadline)
+	{
+		reason = ON_TIMEOUT;
+		return true;
+	}
+
+	if (!timer.IsActive())
+	{
+		timer.Set(deadline);
+		EventLoop::Add(&timer);
+	}
+
+	return false;
+}
+
+void WriteBatcher::OnFlush(unsigned length, unsigned remaining)
+{
+	uint64_t now;
+
+	now = EventLoop::Now();
+	sizes.Add(length);
+	waits.Add(firstAdded == 0 || now < firstAdded ? 0 : now - firstAdded);
+
+	if (reason == ON_SIZE)
+		numOnSize++;
+	else if (reason == ON_TIMEOUT)
+		numOnTimeout++;
+	else if (reason == ON_LOW_LOAD)
+		numOnLowLoad++;
+	else
+		numUnbatched++;
+
+	deadline = 0;
+	EventLoop::Remove(&timer);
+
+	// the rest was added later than the first write of this batch,
+	// so it keeps its start time
+	if (remaining == 0)
+		firstAdded = 0;
+}
+
+void WriteBatcher::Reset()
+{
+	firstAdded = 0;
+	deadline = 0;
+	EventLoop::Remove(&timer);
+}
+
+void WriteBatcher::PrintStats(ByteString& text)
+{
+	text.Writef(
+		"Write batches: %U, size avg/p50/p90/p99/max: %U/%U/%U/%U/%U bytes\n"
+		"Batch wait avg/p50/p90/p99/max: %U/%U/%U/%U/%U msec\n"
+		"Batches flushed on size: %U, on timeout: %U, at low load: %U, unbatched: %U\n",
+		sizes.GetCount(),
+		sizes.GetMean(),
+		sizes.GetPercentile(50),
+		sizes.GetPercentile(90),
+		sizes.GetPercentile(99),
+		sizes.GetMax(),
+		waits.GetMean(),
+		waits.GetPercentile(50),
+		waits.GetPercentile(90),
+		waits.GetPercentile(99),
+		waits.GetMax(),
+		numOnSize,
+		numOnTimeout,
+		numOnLowLoad,
+		numUnbatched);
+}
+
+void WriteBatcher::UpdateRate(uint64_t now)
+{
+	uint64_t	elapsed;
+	double		sample;
+
+	if (rateStarted == 0 || now < rateStarted)
+	{
+		rateStarted = now;
+		rateBytes = 0;
+		return;
+	}
+
+	elapsed = now - rateStarted;
+	if (elapsed < BATCHER_RATE_INTERVAL)
+		return;
+
+	sample = (double) rateBytes / elapsed;
+	// after an idle period the old rate says nothing
+	if (elapsed >= 4 * BATCHER_RATE_INTERVAL)
+		rate = sample;
+	else
+		rate = (3 * rate + sample) / 4;
+
+	rateStarted = now;
+	rateBytes = 0;
+}
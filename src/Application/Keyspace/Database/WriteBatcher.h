@@ -0,0 +1,68 @@
+#ifndef WRITEBATCHER_H
+#define WRITEBATCHER_H
+
+#include "System/Buffer.h"
+#include "System/Histogram.h"
+#include "System/Events/Callable.h"
+#include "System/Events/Timer.h"
+
+#define BATCHER_DEFAULT_DELAY		0		// msec, 0 means no batching
+#define BATCHER_RATE_INTERVAL		10		// msec between rate samples
+#define BATCHER_MIN_GROWTH			4		// wait only if the batch grows by 1/4
+
+/*
+ * WriteBatcher decides when the writes collected by the master are
+ * appended to the replicated log: at once if rlog.batchSize bytes are
+ * waiting, otherwise after at most rlog.batchDelay msec, but never
+ * longer than the last replication round took. If the observed arrival
+ * rate is too low for the batch to grow meaningfully in that time, the
+ * writes are appended at once.
+ */
+
+class WriteBatcher
+{
+public:
+	WriteBatcher(Callable* onTimeout);
+
+	void			Init();
+	void			Shutdown();
+
+	void			OnAdd(unsigned length);
+	bool			ShouldFlush(unsigned length, uint64_t roundTime);
+	void			OnFlush(unsigned length, unsigned remaining);
+	void			Reset();
+
+	unsigned		GetMaxSize() { return maxSize; }
+
+	void			PrintStats(ByteString& text);
+
+private:
+	enum Reason {
+		UNBATCHED,
+		ON_SIZE,
+		ON_TIMEOUT,
+		ON_LOW_LOAD
+	};
+
+	void			UpdateRate(uint64_t now);
+
+	unsigned		maxDelay;
+	unsigned		maxSize;
+	uint64_t		firstAdded;
+	uint64_t		deadline;
+	Timer			timer;
+	Reason			reason;
+
+	double			rate;			// bytes per msec
+	uint64_t		rateStarted;
+	uint64_t		rateBytes;
+
+	Histogram		sizes;
+	Histogram		waits;
+	uint64_t		numOnSize;
+	uint64_t		numOnTimeout;
+	uint64_t		numOnLowLoad;
+	uint64_t		numUnbatched;
+};
+
+#endif
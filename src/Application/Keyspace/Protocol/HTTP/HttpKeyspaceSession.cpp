@@ -177,6 +177,7 @@ bool HttpKeyspaceSession::HandleRequest(const HttpRequest& request)
 void HttpKeyspaceSession::PrintHello()
 {
 	ByteArray<10*KB> text;
+	ByteString stats;
 
 	if (kdb->IsReplicated())
 	{
@@ -197,12 +198,31 @@ void HttpKeyspaceSession::PrintHello()
 			(int)RLOG->GetLastRound_Length(),
 			(int)RLOG->GetLastRound_Time(),
 			(int)RLOG->GetLastRound_Thruput()/1000 + 1);
+		
+		stats.buffer = text.buffer + text.length + 1;
+		stats.size = text.size - text.length - 1;
+		kdb->PrintStats(stats);
+		if (stats.length > 0)
+		{
+			text.buffer[text.length] = '\n';
+			text.length += stats.length + 1;
+		}
 	}
 	else
 	{
 		text.length = snprintf(text.buffer, text.size,
 			"Keyspace v" VERSION_STRING " running\n\n" \
 			"Running in single mode");
+		
+		stats.buffer = text.buffer + text.length + 2;
+		stats.size = text.size - text.length - 2;
+		kdb->PrintStats(stats);
+		if (stats.length > 0)
+		{
+			text.buffer[text.length] = '\n';
+			text.buffer[text.length + 1] = '\n';
+			text.length += stats.length + 2;
+		}
 	}
 	
 	conn->Response(HTTP_STATUS_CODE_OK, text.buffer, text.length);
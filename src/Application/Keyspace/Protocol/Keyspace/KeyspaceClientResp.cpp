@@ -79,3 +79,17 @@ bool KeyspaceClientResp::Write(ByteString& data)
 		return data.Writef("%c:%U",
 					       type, cmdID);
 }
+
+// same as Write(), but stops before the bytes of the value,
+// which are to follow it
+bool KeyspaceClientResp::WriteHeader(ByteString& data)
+{
+	if (key.length > 0 && sendValue)
+		return data.Writef("%c:%U:%M:%u:",
+					       type, cmdID, &key, value.length);
+	else if (sendValue)
+		return data.Writef("%c:%U:%u:",
+					       type, cmdID, value.length);
+	else
+		return Write(data);
+}
@@ -29,6 +29,7 @@ public:
 	void		ListEnd(uint64_t cmdID_);
 	
 	bool		Write(ByteString& data);
+	bool		WriteHeader(ByteString& data);
 };
 
 #endif
@@ -6,6 +6,13 @@ KeyspaceConn::KeyspaceConn()
 	server = NULL;
 }
 
+KeyspaceConn::~KeyspaceConn()
+{
+	// ~TCPConn() closes too late to call OnRefReleased() on this class,
+	// the ops of the unwritten values are given back here
+	Close();
+}
+
 void KeyspaceConn::Init(KeyspaceDB* kdb_, KeyspaceServer* server_)
 {
 	Log_Trace();
@@ -31,7 +38,10 @@ void KeyspaceConn::OnComplete(KeyspaceOp* op, bool final)
 {
 //	Log_Trace();
 	
+	bool referenced;
+	
 	data.Clear();
+	referenced = false;
 	
 	if (state != DISCONNECTED)
 	{
@@ -55,7 +65,17 @@ void KeyspaceConn::OnComplete(KeyspaceOp* op, bool final)
 				else
 					resp.Failed(op->cmdID);
 
-				resp.Write(data);
+				if (final && resp.sendValue &&
+				op->value.length >= KEYSPACE_REF_VALUE_SIZE)
+				{
+					// the op is deleted by OnRefReleased()
+					resp.WriteHeader(data);
+					WriteRef(data, op);
+					data.Clear();
+					referenced = true;
+				}
+				else
+					resp.Write(data);
 			}
 			else if (op->type == KeyspaceOp::SET ||
 					 op->type == KeyspaceOp::SET_EXPIRY ||
@@ -130,7 +150,8 @@ void KeyspaceConn::OnComplete(KeyspaceOp* op, bool final)
 	if (final)
 	{
 		numpending--;
-		delete op;
+		if (!referenced)
+			delete op;
 	}
 
 	if (state == DISCONNECTED && numpending == 0)
@@ -161,7 +182,7 @@ void KeyspaceConn::OnMessageRead(const ByteString& message)
 
 void KeyspaceConn::Write(ByteString &bs)
 {
-	static ByteArray<64> prefix;
+	ByteArray<64> prefix;
 	
 	prefix.length = snwritef(prefix.buffer, prefix.size, "%d:", bs.length);
 
@@ -169,9 +190,21 @@ void KeyspaceConn::Write(ByteString &bs)
 	TCPConn<KEYSPACE_BUF_SIZE>::Write(bs.buffer, bs.length);
 }
 
+void KeyspaceConn::WriteRef(ByteString &header, KeyspaceOp* op)
+{
+	ByteArray<64> prefix;
+	
+	prefix.length = snwritef(prefix.buffer, prefix.size, "%d:",
+	 header.length + op->value.length);
+
+	TCPConn<KEYSPACE_BUF_SIZE>::Write(prefix.buffer, prefix.length, false);
+	TCPConn<KEYSPACE_BUF_SIZE>::Write(header.buffer, header.length, false);
+	TCPConn<KEYSPACE_BUF_SIZE>::WriteRef(op->value.buffer, op->value.length, op);
+}
+
 void KeyspaceConn::ProcessMsg()
 {
-	static ByteArray<32> ba;
+	ByteArray<32> ba;
 	
 	if (req.type == KEYSPACECLIENT_GET_MASTER)
 	{
@@ -225,6 +258,8 @@ void KeyspaceConn::OnClose()
 		
 	Log_Message("[%s] Keyspace: client disconnected", endpointString);
 
+	// the pending ops may be executed on the main loop
+	Abort();
 	Close();
 	if (numpending == 0)
 		server->DeleteConn(this);
@@ -238,3 +273,8 @@ void KeyspaceConn::OnWrite()
 	if (closeAfterSend && !tcpwrite.active)
 		OnClose();
 }
+
+void KeyspaceConn::OnRefReleased(void* ref)
+{
+	delete (KeyspaceOp*) ref;
+}
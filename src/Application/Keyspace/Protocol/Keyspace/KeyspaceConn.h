@@ -10,6 +10,9 @@
 
 #define KEYSPACE_CONN_TIMEOUT 3000
 
+// values at least this long are written from the op instead of copied
+#define KEYSPACE_REF_VALUE_SIZE	(4*KB)
+
 class KeyspaceServer;
 
 class KeyspaceConn : public MessageConn<KEYSPACE_BUF_SIZE>,
@@ -20,6 +23,7 @@ typedef MFunc<KeyspaceConn>				Func;
 typedef ByteArray<KEYSPACE_BUF_SIZE>	Buffer;
 public:
 	KeyspaceConn();
+	~KeyspaceConn();
 	
 	void				Init(KeyspaceDB* kdb_, KeyspaceServer* server_);
 
@@ -30,11 +34,13 @@ public:
 	// TCPConn interface
 	virtual void		OnClose();
 	virtual void		OnWrite();
+	virtual void		OnRefReleased(void* ref);
 	virtual void		OnMessageRead(const ByteString& message);
 
 private:
 
 	void				Write(ByteString &bs);
+	void				WriteRef(ByteString &header, KeyspaceOp* op);
 	void				ProcessMsg();
 	void				AppendOps();
 
@@ -0,0 +1,244 @@
+#include "KeyspaceReactor.h"
+#include "System/IO/IOProcessor.h"
+#include "System/Events/EventLoop.h"
+#include "System/Atomic.h"
+
+void ReactorService::OnComplete(KeyspaceOp* op, bool final)
+{
+	KeyspaceOp* item;
+
+	// the connection may check the master when it gets the op
+	reactor->PublishMaster();
+
+	if (final)
+	{
+		reactor->Complete(op);
+		return;
+	}
+
+	// the items of a list are passed in the same op one after the other,
+	// so each one is copied; a copy has no origin
+	item = new KeyspaceOp;
+	item->type = op->type;
+	item->cmdID = op->cmdID;
+	item->status = op->status;
+	item->key.Set(op->key);
+	if (op->IsListKeyValues())
+		item->value.Set(op->value);
+	item->service = op->origin;
+
+	reactor->Complete(item);
+}
+
+KeyspaceReactor::KeyspaceReactor() :
+masterTimer(KEYSPACE_REACTOR_MASTER_INTERVAL, &onMasterTimeout),
+onRun(this, &KeyspaceReactor::Run),
+onStop(this, &KeyspaceReactor::OnStop),
+onOps(this, &KeyspaceReactor::OnOps),
+onCompletions(this, &KeyspaceReactor::OnCompletions),
+onMasterTimeout(this, &KeyspaceReactor::OnMasterTimeout)
+{
+	kdb = NULL;
+	nodeID = 0;
+	replicated = false;
+	masterState = NULL;
+	publishedState = 0;
+	thread = NULL;
+	loopID = -1;
+	service.reactor = this;
+}
+
+KeyspaceReactor::~KeyspaceReactor()
+{
+	Stop();
+}
+
+bool KeyspaceReactor::Start(KeyspaceDB* kdb_, int port)
+{
+	kdb = kdb_;
+	nodeID = kdb->GetNodeID();
+	replicated = kdb->IsReplicated();
+	publishedState = -1;
+	PublishMaster();
+	EventLoop::Reset(&masterTimer);
+
+	loopID = IOProcessor::CreateLoop();
+	if (loopID < 0)
+		return false;
+
+	// the listener is added to the reactor's loop before its thread runs
+	IOProcessor::SetThreadLoop(loopID);
+	server.Init(this, port, true);
+	IOProcessor::SetThreadLoop(IO_MAIN_LOOP);
+
+	thread = ThreadPool::Create(1);
+	thread->Start();
+	thread->Execute(&onRun);
+
+	return true;
+}
+
+void KeyspaceReactor::Stop()
+{
+	if (thread == NULL)
+		return;
+
+	EventLoop::Remove(&masterTimer);
+	IOProcessor::Complete(&onStop, loopID);
+	thread->Stop();
+	delete thread;
+	thread = NULL;
+
+	IOProcessor::DeleteLoop(loopID);
+	loopID = -1;
+}
+
+bool KeyspaceReactor::Add(KeyspaceOp* op)
+{
+	if (ops.Push(op))
+		IOProcessor::Complete(&onOps);
+
+	return true;
+}
+
+bool KeyspaceReactor::Submit()
+{
+	KeyspaceOp* op;
+
+	// an op without a service tells the main loop to submit the ones
+	// added before it
+	op = new KeyspaceOp;
+	op->service = NULL;
+
+	return Add(op);
+}
+
+unsigned KeyspaceReactor::GetNodeID()
+{
+	return nodeID;
+}
+
+bool KeyspaceReactor::IsMasterKnown()
+{
+	return (GetMaster() != -1);
+}
+
+int KeyspaceReactor::GetMaster()
+{
+	return (int) (((intptr_t) AtomicLoad(&masterState) >> 1) - 1);
+}
+
+bool KeyspaceReactor::IsMaster()
+{
+	return (((intptr_t) AtomicLoad(&masterState) & 1) != 0);
+}
+
+bool KeyspaceReactor::IsReplicated()
+{
+	return replicated;
+}
+
+void KeyspaceReactor::Run()
+{
+	Log_Trace();
+
+	IOProcessor::SetThreadLoop(loopID);
+	EventLoop::InitThread();
+
+	EventLoop::Run();
+
+	server.Shutdown();
+	EventLoop::ShutdownThread();
+}
+
+void KeyspaceReactor::OnStop()
+{
+	EventLoop::Stop();
+}
+
+void KeyspaceReactor::OnOps()
+{
+	KeyspaceOp*	op;
+	KeyspaceOp*	next;
+	bool		submit;
+
+	// on the main loop
+	PublishMaster();
+
+	submit = false;
+	for (op = ops.Get(); op != NULL; op = next)
+	{
+		next = op->next;
+		op->next = NULL;
+
+		if (op->service == NULL)
+		{
+			submit = true;
+			delete op;
+			continue;
+		}
+
+		op->origin = op->service;
+		op->service = &service;
+		if (!kdb->Add(op))
+		{
+			op->status = false;
+			Complete(op);
+		}
+	}
+
+	if (submit)
+		kdb->Submit();
+}
+
+void KeyspaceReactor::OnCompletions()
+{
+	KeyspaceOp*	op;
+	KeyspaceOp*	next;
+
+	// on the reactor's loop
+	for (op = completions.Get(); op != NULL; op = next)
+	{
+		next = op->next;
+		op->next = NULL;
+
+		if (op->origin == NULL)
+		{
+			op->service->OnComplete(op, false);
+			delete op;
+			continue;
+		}
+
+		op->service = op->origin;
+		op->origin = NULL;
+		op->service->OnComplete(op, true);
+	}
+}
+
+void KeyspaceReactor::Complete(KeyspaceOp* op)
+{
+	if (completions.Push(op))
+		IOProcessor::Complete(&onCompletions, loopID);
+}
+
+void KeyspaceReactor::PublishMaster()
+{
+	intptr_t state;
+
+	// on the main loop
+	state = ((intptr_t) kdb->GetMaster() + 1) << 1;
+	if (kdb->IsMaster())
+		state |= 1;
+
+	if (state != publishedState)
+	{
+		AtomicExchange(&masterState, (void*) state);
+		publishedState = state;
+	}
+}
+
+void KeyspaceReactor::OnMasterTimeout()
+{
+	PublishMaster();
+	EventLoop::Reset(&masterTimer);
+}
@@ -0,0 +1,96 @@
+#ifndef KEYSPACEREACTOR_H
+#define KEYSPACEREACTOR_H
+
+#include "System/ThreadPool.h"
+#include "System/Events/Callable.h"
+#include "System/Events/Timer.h"
+#include "System/Containers/MPSCQueue.h"
+#include "Application/Keyspace/Database/KeyspaceDB.h"
+#include "Application/Keyspace/Database/KeyspaceService.h"
+#include "KeyspaceServer.h"
+
+#define KEYSPACE_REACTOR_MASTER_INTERVAL	100	// msec
+
+/*
+ * KeyspaceReactor serves clients of the keyspace port on an event loop
+ * thread of its own, so that reading requests and writing responses is
+ * spread over keyspace.numReactors cores. Every reactor listens on the
+ * port with SO_REUSEPORT and the kernel spreads the connections.
+ *
+ * For its connections the reactor is the KeyspaceDB: their ops are
+ * passed to the main loop, which executes them on the real one. There
+ * the reactor is the service of the ops, and passes the completions
+ * back to the connections' loop. Both ways the ops go through lock-free
+ * queues, and the other loop is only woken up if the queue was empty.
+ *
+ * The connections do not read the replication state of the main loop.
+ * The main loop publishes who the master is in one atomic value when
+ * ops pass through it, and every KEYSPACE_REACTOR_MASTER_INTERVAL msec.
+ */
+
+class KeyspaceReactor;
+
+class ReactorService : public KeyspaceService
+{
+public:
+	KeyspaceReactor*	reactor;
+
+	// called on the main loop
+	virtual void		OnComplete(KeyspaceOp* op, bool final);
+	virtual bool		IsAborted() { return false; }
+};
+
+class KeyspaceReactor : public KeyspaceDB
+{
+friend class ReactorService;
+typedef MFunc<KeyspaceReactor>						Func;
+typedef MPSCQueue<KeyspaceOp, &KeyspaceOp::next>	OpQueue;
+
+public:
+	KeyspaceReactor();
+	~KeyspaceReactor();
+
+	bool				Start(KeyspaceDB* kdb, int port);
+	void				Stop();
+
+	// KeyspaceDB interface, called on the reactor's loop
+	virtual bool		Init() { return true; }
+	virtual void		Shutdown() {}
+	virtual bool		Add(KeyspaceOp* op);
+	virtual bool		Submit();
+	virtual unsigned	GetNodeID();
+	virtual bool		IsMasterKnown();
+	virtual int			GetMaster();
+	virtual bool		IsMaster();
+	virtual bool		IsReplicated();
+	virtual void		SetProtocolServer(ProtocolServer*) {}
+
+private:
+	void				Run();
+	void				OnStop();
+	void				OnOps();
+	void				OnCompletions();
+	void				Complete(KeyspaceOp* op);
+	void				PublishMaster();
+	void				OnMasterTimeout();
+
+	KeyspaceDB*			kdb;
+	unsigned			nodeID;
+	bool				replicated;
+	void* volatile		masterState;	// (master + 1) << 1 | isMaster
+	intptr_t			publishedState;
+	CdownTimer			masterTimer;
+	KeyspaceServer		server;
+	ReactorService		service;
+	ThreadPool*			thread;
+	int					loopID;
+	OpQueue				ops;
+	OpQueue				completions;
+	Func				onRun;
+	Func				onStop;
+	Func				onOps;
+	Func				onCompletions;
+	Func				onMasterTimeout;
+};
+
+#endif
@@ -11,10 +11,10 @@ thruputTimeout(1000, &onThruputTimeout)
 {
 }
 
-void KeyspaceServer::Init(KeyspaceDB* kdb_, int port_)
+void KeyspaceServer::Init(KeyspaceDB* kdb_, int port_, bool reusePort)
 {
 	if (!TCPServerT<KeyspaceServer, KeyspaceConn, KEYSPACE_BUF_SIZE>
-	::Init(port_, CONN_BACKLOG))
+	::Init(port_, CONN_BACKLOG, reusePort))
 		STOP_FAIL("Cannot initialize KeyspaceServer", 1);
 	kdb = kdb_;
 	kdb->SetProtocolServer(this);
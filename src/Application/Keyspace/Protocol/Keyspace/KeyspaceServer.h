@@ -19,7 +19,7 @@ typedef MFunc<KeyspaceServer>	Func;
 public:
 	KeyspaceServer();
 	
-	void				Init(KeyspaceDB* kdb, int port);
+	void				Init(KeyspaceDB* kdb, int port, bool reusePort = false);
 	void				Shutdown();
 	
 	void				InitConn(KeyspaceConn* conn);
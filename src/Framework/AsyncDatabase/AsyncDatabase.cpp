@@ -25,3 +25,10 @@ void AsyncDatabase::Add(MultiDatabaseOp* dbop)
 	
 	threadPool->Execute(dbop->GetOperation());
 }
+
+void AsyncDatabase::Execute(Callable* callable)
+{
+	// runs on the same thread(s) as the MultiDatabaseOps,
+	// in the order they were added
+	threadPool->Execute(callable);
+}
@@ -14,6 +14,7 @@ public:
 	void		Shutdown();
 
 	void		Add(MultiDatabaseOp* dbop);
+	void		Execute(Callable* callable);
 
 private:
 	ThreadPool*	threadPool;
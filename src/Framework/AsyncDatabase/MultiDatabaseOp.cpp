@@ -78,6 +78,33 @@ bool MultiDatabaseOp::Set(Table* table, const char* key, const char* value)
 	return MultiDatabaseOp::Set(table, bsKey, bsValue);
 }
 
+bool MultiDatabaseOp::Delete(Table* table, const ByteString& key)
+{
+	DatabaseOp* op;
+
+	if (numop >= SIZE(ops))
+		return false;
+	
+	op = &ops[numop];
+	op->type = DatabaseOp::DELETE;
+	op->table = table;
+	op->key.Set(key);
+	
+	numop++;
+	
+	return true;
+}
+
+bool MultiDatabaseOp::Delete(Table* table, const char* key)
+{
+	int len;
+	
+	len = strlen(key);
+	const ByteString bsKey(len, len, key);
+	
+	return MultiDatabaseOp::Delete(table, bsKey);
+}
+
 bool MultiDatabaseOp::Visit(Table* table, TableVisitor& tv)
 {
 	DatabaseOp* op;
@@ -151,6 +178,8 @@ void MultiDatabaseOp::Operation()
 			op->ret = op->table->Get(tx, op->key, op->value);
 		else if (op->type == DatabaseOp::SET)
 			op->ret = op->table->Set(tx, op->key, op->value);
+		else if (op->type == DatabaseOp::DELETE)
+			op->ret = op->table->Delete(tx, op->key);
 		else if (op->type == DatabaseOp::VISIT)
 			op->ret = op->table->Visit(*op->visitor);
 	}
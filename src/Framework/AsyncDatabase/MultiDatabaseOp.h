@@ -16,6 +16,7 @@ public:
 	enum Type {
 		GET,
 		SET,
+		DELETE,
 		VISIT
 	};
 	
@@ -41,6 +42,8 @@ public:
 	bool			Set(Table* table, const ByteString& key, ByteString& value);
 	bool			Set(Table* table, const char* key, ByteString &value);
 	bool			Set(Table* table, const char* key, const char* value);
+	bool			Delete(Table* table, const ByteString& key);
+	bool			Delete(Table* table, const char* key);
 	bool			Visit(Table* table, TableVisitor &tv);
 	bool			Add(DatabaseOp& op);
 
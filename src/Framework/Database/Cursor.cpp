@@ -72,6 +72,28 @@ bool Cursor::Prev(ByteString &key, ByteString &value)
 		return false;
 }
 
+bool Cursor::Last(ByteString &key, ByteString &value)
+{
+	Dbt dbkey, dbvalue;
+	
+	if (cursor->get(&dbkey, &dbvalue, DB_LAST) == 0)
+	{
+		if (key.Set((char*)dbkey.get_data(), dbkey.get_size()) &&
+			value.Set((char*)dbvalue.get_data(), dbvalue.get_size()))
+				return true;
+		else
+			return false;
+	}
+	else
+		return false;
+}
+
+void Cursor::SetReadOnce()
+{
+	// pages read by this cursor are evicted from the cache first
+	cursor->set_priority(DB_PRIORITY_VERY_LOW);
+}
+
 bool Cursor::Close()
 {
 	return (cursor->close() == 0);
@@ -17,6 +17,9 @@ public:
 
 	bool	Next(ByteString &key, ByteString &value);
 	bool	Prev(ByteString &key, ByteString &value);
+	bool	Last(ByteString &key, ByteString &value);
+	
+	void	SetReadOnce();
 
 	bool	Close();
 
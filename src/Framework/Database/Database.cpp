@@ -1,13 +1,21 @@
 #include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "System/Events/Callable.h"
 #include "System/Events/EventLoop.h"
 #include "System/Time.h"
 #include "System/Log.h"
+#include "System/IO/IOProcessor.h"
 #include "Database.h"
 #include "Table.h"
+#include "Transaction.h"
 #ifdef _WIN32
 #include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
 #endif
 
 #define DATABASE_DEFAULT_CACHESIZE	(256*1024)
@@ -15,6 +23,40 @@
 // the global database
 Database database;
 
+#define SHADOW_SUFFIX	".shadow"
+#define OLD_SUFFIX		".old"
+#define RESTORE_DIRNAME	"restore"
+
+#define RESTORE_CACHESIZE	(64*MB)
+
+// the keys of older versions are moved this many, or this many
+// bytes at a time
+#define MIGRATE_BATCH_SIZE	1000
+#define MIGRATE_BATCH_BYTES	(4*MB)
+
+// each table is a file of its own
+enum
+{
+	KEYSPACE_TABLE,
+	EXPIRY_TABLE,
+	META_TABLE,
+	LOGCACHE_TABLE
+};
+
+static const char* tableNames[DATABASE_NUM_TABLES] =
+{
+	"keyspace",
+	"expiry",
+	"meta",
+	"logcache"
+};
+
+// a backup has the tables before this, the rounds in the log cache
+// are the node's own
+#define NUM_BACKUP_TABLES	LOGCACHE_TABLE
+
+static void RemoveFiles(const char* dir);
+
 #define LOG_BUFFER_ALLOC_ERROR "Unable to allocate memory for the log buffer"
 
 static void DatabaseError(const DbEnv* /*dbenv*/,
@@ -34,9 +76,13 @@ static void DatabaseTrace(const DbEnv* /*dbenv*/, const char* msg)
 
 Database::Database() :
 checkpoint(this, &Database::Checkpoint),
+removeOldTables(this, &Database::RemoveOldTables),
+backup(this, &Database::Backup),
 checkpointTimeout(&onCheckpointTimeout),
 onCheckpointTimeout(this, &Database::OnCheckpointTimeout)
 {
+	onBackupStarted = NULL;
+	backupActive = false;
 }
 
 Database::~Database()
@@ -50,6 +96,8 @@ bool Database::Init(const DatabaseConfig& config_)
 	DB_INIT_TXN | DB_RECOVER | DB_PRIVATE;
 	int mode = 0;
 	int ret;
+	int i;
+	char name[64];
 
 	env = new DbEnv(DB_CXX_NO_EXCEPTIONS);
 
@@ -123,7 +171,13 @@ bool Database::Init(const DatabaseConfig& config_)
 	ret = env->set_flags(DB_TXN_WRITE_NOSYNC, config.txnWriteNoSync);
 #endif
 
-	keyspace = new Table(this, "keyspace", config.pageSize);
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		tables[i] = new Table(this, tableNames[i], GetPageSize(i));
+		shadows[i] = NULL;
+	}
+	
+	MigrateTables();
 
 	Checkpoint();
 	
@@ -136,18 +190,34 @@ bool Database::Init(const DatabaseConfig& config_)
 	cpThread = ThreadPool::Create(1);
 	cpThread->Start();
 	
+	// left behind by an interrupted catchup or switch
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		snprintf(name, SIZE(name), "%s" SHADOW_SUFFIX, tableNames[i]);
+		env->dbremove(NULL, name, NULL, DB_AUTO_COMMIT);
+	}
+	snprintf(restoreDir, SIZE(restoreDir), "%s/%s", config.dir, RESTORE_DIRNAME);
+	RemoveFiles(restoreDir);
+	cpThread->Execute(&removeOldTables);
+	
 	return true;
 }
 
 void Database::Shutdown()
 {
+	int i;
+	
 	if (!running)
 		return;
 
 	running = false;
 	cpThread->Stop();
 	delete cpThread;
-	delete keyspace;	
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		delete shadows[i];
+		delete tables[i];
+	}
 	env->close(0);
 
 	// Bug #222: On Windows deleting the BDB environment object causes crash
@@ -159,10 +229,419 @@ void Database::Shutdown()
 
 Table* Database::GetTable(const char* name)
 {
-	if (strcmp(name, "keyspace") == 0)
-		return keyspace;
+	int i;
+	
+	i = GetTableIndex(name);
+	if (i < 0)
+		return NULL;
 		
-	return NULL;
+	return tables[i];
+}
+
+Table* Database::CreateShadowTable(const char* name)
+{
+	int		i;
+	char	filename[64];
+	
+	i = GetTableIndex(name);
+	if (i < 0)
+		return NULL;
+
+	DeleteShadowTable(name);
+	snprintf(filename, SIZE(filename), "%s" SHADOW_SUFFIX, tableNames[i]);
+	shadows[i] = new Table(this, filename, GetPageSize(i));
+	
+	return shadows[i];
+}
+
+Table* Database::GetShadowTable(const char* name)
+{
+	int i;
+	
+	i = GetTableIndex(name);
+	if (i < 0)
+		return NULL;
+	
+	return shadows[i];
+}
+
+bool Database::CommitShadowTables(Transaction* transaction)
+{
+	char	shadowName[64];
+	char	oldName[64];
+	int		i;
+	int		ret;
+	
+	Log_Trace();
+	
+	// the handles cannot be open while the files are renamed, so
+	// no other thread may use the tables until this returns
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		if (shadows[i] == NULL)
+			continue;
+		tables[i]->Close();
+		shadows[i]->Close();
+	}
+	
+	// the renames are committed together with what the caller
+	// wrote in the transaction
+	ret = 0;
+	for (i = 0; ret == 0 && i < DATABASE_NUM_TABLES; i++)
+	{
+		if (shadows[i] == NULL)
+			continue;
+		snprintf(shadowName, SIZE(shadowName), "%s" SHADOW_SUFFIX, tableNames[i]);
+		snprintf(oldName, SIZE(oldName), "%s" OLD_SUFFIX, tableNames[i]);
+		ret = env->dbrename(transaction->txn, tableNames[i], NULL, oldName, 0);
+		if (ret == 0)
+			ret = env->dbrename(transaction->txn, shadowName, NULL, tableNames[i], 0);
+	}
+	if (ret == 0)
+		ret = transaction->Commit() ? 0 : -1;
+	else
+		transaction->Rollback();
+	
+	// the Table objects stay the same, so pointers held by others
+	// see the new files
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		if (shadows[i] == NULL)
+			continue;
+		tables[i]->Open(tableNames[i]);
+		delete shadows[i];
+		shadows[i] = NULL;
+	}
+	
+	if (ret != 0)
+	{
+		Log_Trace("ret = %d", ret);
+		return false;
+	}
+	
+	cpThread->Execute(&removeOldTables);
+	return true;
+}
+
+void Database::DeleteShadowTable(const char* name)
+{
+	int		i;
+	char	filename[64];
+	
+	i = GetTableIndex(name);
+	if (i < 0 || shadows[i] == NULL)
+		return;
+	
+	delete shadows[i];
+	shadows[i] = NULL;
+	snprintf(filename, SIZE(filename), "%s" SHADOW_SUFFIX, tableNames[i]);
+	env->dbremove(NULL, filename, NULL, DB_AUTO_COMMIT);
+}
+
+void Database::DeleteShadowTables()
+{
+	int i;
+	
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+		DeleteShadowTable(tableNames[i]);
+}
+
+bool Database::StartBackup(Callable* onStarted)
+{
+	if (backupActive)
+		return false;
+	
+	backupActive = true;
+	onBackupStarted = onStarted;
+	cpThread->Execute(&backup);
+	
+	return true;
+}
+
+void Database::EndBackup()
+{
+	if (!backupActive)
+		return;
+	
+	backupActive = false;
+	
+#ifdef DB_HOTBACKUP_IN_PROGRESS
+	env->set_flags(DB_HOTBACKUP_IN_PROGRESS, 0);
+#endif
+
+#ifdef DB_LOG_AUTOREMOVE
+	env->set_flags(DB_LOG_AUTOREMOVE, 1);
+#else
+	env->log_set_config(DB_LOG_AUTO_REMOVE, 1);
+#endif
+}
+
+// runs on cpThread, so no other checkpoint removes logs meanwhile
+void Database::Backup()
+{
+	int ret;
+
+	Log_Trace("started");
+	
+	// the copy is recovered from the logs written after this
+	// checkpoint, they are kept until the backup ends
+	ret = env->txn_checkpoint(0, 0, DB_FORCE);
+	if (ret < 0)
+		ASSERT_FAIL();
+
+#ifdef DB_LOG_AUTOREMOVE
+	env->set_flags(DB_LOG_AUTOREMOVE, 0);
+#else
+	env->log_set_config(DB_LOG_AUTO_REMOVE, 0);
+#endif
+
+#ifdef DB_HOTBACKUP_IN_PROGRESS
+	// pages moved while the file is copied are logged in full
+	env->set_flags(DB_HOTBACKUP_IN_PROGRESS, 1);
+#endif
+
+	Log_Trace("finished");
+	IOProcessor::Complete(onBackupStarted);
+}
+
+bool Database::GetBackupFiles(ByteBuffer& names)
+{
+	char	buf[256];
+	int		len;
+	int		i;
+	
+	len = 0;
+	for (i = 0; i < NUM_BACKUP_TABLES; i++)
+		len += snprintf(buf + len, SIZE(buf) - len, "%s\n", tableNames[i]);
+	
+	return names.Writef("%s", buf);
+}
+
+bool Database::GetLogFiles(ByteBuffer& names)
+{
+	char**		list;
+	char**		it;
+	unsigned	size;
+	int			len;
+	
+	if (env->log_archive(&list, DB_ARCH_LOG) != 0)
+		return false;
+	
+	names.length = 0;
+	if (list == NULL)
+		return true;
+	
+	size = 0;
+	for (it = list; *it != NULL; it++)
+		size += strlen(*it) + 16;
+	
+	if (!names.Reallocate(size))
+	{
+		free(list);
+		return false;
+	}
+	
+	for (it = list; *it != NULL; it++)
+	{
+		len = snwritef(names.buffer + names.length, names.size - names.length,
+					   "%s\n", *it);
+		names.length += len;
+	}
+	
+	free(list);
+	return true;
+}
+
+const char* Database::BeginRestore()
+{
+	RemoveFiles(restoreDir);
+	
+#ifdef _WIN32
+	_mkdir(restoreDir);
+#else
+	mkdir(restoreDir, 0700);
+#endif
+	if (!IsFolder(restoreDir))
+		return NULL;
+	
+	return restoreDir;
+}
+
+// runs on a background thread, the tables are not used by others
+bool Database::RestoreShadowTables()
+{
+	DbEnv*		restoreEnv;
+	u_int32_t	flags;
+	char		src[4096];
+	char		dst[4096];
+	int			ret;
+	int			i;
+	
+	for (i = 0; i < NUM_BACKUP_TABLES; i++)
+	{
+		if (shadows[i] != NULL)
+			return false;
+	}
+	
+	Log_Trace("started");
+	
+	// catastrophic recovery replays all logs of the backup, the table
+	// files are consistent as of the end of the last one
+	flags = DB_CREATE | DB_INIT_MPOOL | DB_INIT_TXN |
+	DB_RECOVER_FATAL | DB_PRIVATE;
+	restoreEnv = new DbEnv(DB_CXX_NO_EXCEPTIONS);
+	restoreEnv->set_cachesize(0, RESTORE_CACHESIZE, 1);
+	ret = restoreEnv->open(restoreDir, flags, 0);
+	if (ret == 0)
+		ret = restoreEnv->txn_checkpoint(0, 0, DB_FORCE);
+	
+	// the pages refer to the logs of the backup, they are reset so
+	// that the files can be used in this environment
+	for (i = 0; ret == 0 && i < NUM_BACKUP_TABLES; i++)
+	{
+		ret = restoreEnv->lsn_reset(tableNames[i], 0);
+		if (ret == 0)
+			ret = restoreEnv->fileid_reset(tableNames[i], 0);
+	}
+	restoreEnv->close(0);
+#ifndef PLATFORM_WINDOWS
+	delete restoreEnv;
+#endif
+	
+	for (i = 0; ret == 0 && i < NUM_BACKUP_TABLES; i++)
+	{
+		if (snprintf(src, SIZE(src), "%s/%s", restoreDir, tableNames[i]) >= (int) SIZE(src) ||
+			snprintf(dst, SIZE(dst), "%s/%s" SHADOW_SUFFIX, config.dir, tableNames[i]) >= (int) SIZE(dst))
+		{
+			ret = ENAMETOOLONG;
+			break;
+		}
+		ret = rename(src, dst);
+	}
+	
+	RemoveFiles(restoreDir);
+	
+	if (ret != 0)
+	{
+		Log_Trace("ret = %d", ret);
+		for (i = 0; i < NUM_BACKUP_TABLES; i++)
+		{
+			snprintf(dst, SIZE(dst), "%s" SHADOW_SUFFIX, tableNames[i]);
+			env->dbremove(NULL, dst, NULL, DB_AUTO_COMMIT);
+		}
+		return false;
+	}
+	
+	for (i = 0; i < NUM_BACKUP_TABLES; i++)
+	{
+		snprintf(dst, SIZE(dst), "%s" SHADOW_SUFFIX, tableNames[i]);
+		shadows[i] = new Table(this, dst, GetPageSize(i));
+	}
+	
+	Log_Trace("finished");
+	return true;
+}
+
+void Database::RemoveOldTables()
+{
+	int		i;
+	char	filename[64];
+	
+	Log_Trace("started");
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		snprintf(filename, SIZE(filename), "%s" OLD_SUFFIX, tableNames[i]);
+		env->dbremove(NULL, filename, NULL, DB_AUTO_COMMIT);
+	}
+	Log_Trace("finished");
+}
+
+int Database::GetTableIndex(const char* name)
+{
+	int i;
+	
+	for (i = 0; i < DATABASE_NUM_TABLES; i++)
+	{
+		if (strcmp(name, tableNames[i]) == 0)
+			return i;
+	}
+	
+	return -1;
+}
+
+int Database::GetPageSize(int i)
+{
+	// the keyspace is iterated, the expiry index and the Paxos state
+	// are small records written at random, the rounds are large ones
+	// appended in order
+	switch (i)
+	{
+	case EXPIRY_TABLE:
+		return config.expiryPageSize;
+	case META_TABLE:
+		return config.metaPageSize;
+	case LOGCACHE_TABLE:
+		return config.logCachePageSize;
+	default:
+		return config.pageSize;
+	}
+}
+
+// older versions kept the Paxos state, the log cache and the expiry
+// index in the keyspace table, they are moved to their own tables
+void Database::MigrateTables()
+{
+	// only the keys older versions wrote, user keys that are
+	// just "@@" or "!!" stay where they are
+	static const char*	prefixes[] = {
+		"@@pround:",
+		"@@paxosID",
+		"@@accepted",		// also @@acceptedProposalID, @@acceptedValue
+		"@@promisedProposalID",
+		"@@acceptorState",
+		"@@restartCounter",
+		"!!t:",
+		"!!k:"
+	};
+	static const int	targets[] = {
+		LOGCACHE_TABLE,
+		META_TABLE,
+		META_TABLE,
+		META_TABLE,
+		META_TABLE,
+		META_TABLE,
+		EXPIRY_TABLE,
+		EXPIRY_TABLE
+	};
+	Transaction			transaction(this);
+	unsigned			i;
+	unsigned			total;
+	int					num;
+	
+	total = 0;
+	for (i = 0; i < SIZE(prefixes); i++)
+	{
+		ByteString prefix(strlen(prefixes[i]), strlen(prefixes[i]),
+						  (char*) prefixes[i]);
+		do
+		{
+			if (!transaction.Begin())
+				STOP_FAIL("Could not migrate the database", 1);
+			num = tables[KEYSPACE_TABLE]->Move(&transaction, prefix,
+				tables[targets[i]], MIGRATE_BATCH_SIZE, MIGRATE_BATCH_BYTES);
+			if (num < 0)
+			{
+				transaction.Rollback();
+				STOP_FAIL("Could not migrate the database", 1);
+			}
+			if (!transaction.Commit())
+				STOP_FAIL("Could not migrate the database", 1);
+			total += num;
+		} while (num > 0);
+	}
+	
+	if (total > 0)
+		Log_Message("Moved %u internal keys out of the keyspace table", total);
 }
 
 void Database::OnCheckpointTimeout()
@@ -183,6 +662,50 @@ void Database::Checkpoint()
 	Log_Trace("finished");
 }
 
+static void RemoveFiles(const char* dir)
+{
+	char buf[4096];
+
+#ifdef _WIN32
+	BOOL next;
+	WIN32_FIND_DATA FindFileData;
+	HANDLE hFind;
+
+	snprintf(buf, SIZE(buf), "%s/*", dir);
+	strrep(buf, '/', '\\');
+	hFind = FindFirstFile(buf, &FindFileData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	next = true;
+	while (next)
+	{
+		if (!(FindFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			snprintf(buf, SIZE(buf), "%s/%s", dir, FindFileData.cFileName);
+			strrep(buf, '/', '\\');
+			DeleteFile(buf);
+		}
+		next = FindNextFile(hFind, &FindFileData);
+	}
+	FindClose(hFind);
+#else
+	DIR*			d;
+	struct dirent*	entry;
+	
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	while ((entry = readdir(d)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(buf, SIZE(buf), "%s/%s", dir, entry->d_name);
+		unlink(buf);
+	}
+	closedir(d);
+#endif
+}
+
 static void WarmFileCache(char* filepath, unsigned cacheSize)
 {
 	int i, num;
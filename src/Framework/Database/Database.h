@@ -6,8 +6,11 @@
 #include "System/ThreadPool.h"
 #include "System/Events/Timer.h"
 #include "System/Events/Callable.h"
+#include "System/Buffer.h"
 #include "DatabaseConfig.h"
 
+#define DATABASE_NUM_TABLES		4
+
 class Table;
 class Transaction;
 
@@ -24,18 +27,54 @@ public:
 	bool			Init(const DatabaseConfig& config);
 	void			Shutdown();
 	
+	// "keyspace" holds the user's keys, "expiry" the expiry index,
+	// "meta" the Paxos state and "logcache" the chosen rounds
 	Table*			GetTable(const char* name);
 	
+	// a shadow table is filled while the table is in use, the shadows
+	// replace their tables atomically in the given transaction, the
+	// old files are removed in the background
+	Table*			CreateShadowTable(const char* name);
+	Table*			GetShadowTable(const char* name);
+	bool			CommitShadowTables(Transaction* transaction);
+	void			DeleteShadowTable(const char* name);
+	void			DeleteShadowTables();
+	
+	// a hot backup is the table files and the log files listed after
+	// they were copied, onStarted is called after a checkpoint
+	bool			StartBackup(Callable* onStarted);
+	void			EndBackup();
+	bool			GetBackupFiles(ByteBuffer& names);
+	bool			GetLogFiles(ByteBuffer& names);
+	const char*		GetDir() { return config.dir; }
+	
+	// a hot backup is received into the restore folder, after recovery
+	// its tables become the shadow tables
+	const char*		BeginRestore();
+	bool			RestoreShadowTables();
+	
 	void			OnCheckpointTimeout();
 	void			Checkpoint();
+	void			RemoveOldTables();
+	void			Backup();
 
 private:
+	int				GetTableIndex(const char* name);
+	int				GetPageSize(int i);
+	void			MigrateTables();
+
 	DatabaseConfig	config;
 	DbEnv*			env;
-	Table*			keyspace;
+	Table*			tables[DATABASE_NUM_TABLES];
+	Table*			shadows[DATABASE_NUM_TABLES];
 	ThreadPool*		cpThread;
 	bool			running;
 	Func			checkpoint;
+	Func			removeOldTables;
+	Func			backup;
+	Callable*		onBackupStarted;
+	bool			backupActive;
+	char			restoreDir[4096];
 	CdownTimer		checkpointTimeout;
 	Func			onCheckpointTimeout;
 };
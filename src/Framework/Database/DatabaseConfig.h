@@ -3,6 +3,9 @@
 
 #define DATABASE_CONFIG_DIR					"."
 #define DATABASE_CONFIG_PAGE_SIZE			65536
+#define DATABASE_CONFIG_EXPIRY_PAGE_SIZE	8192
+#define DATABASE_CONFIG_META_PAGE_SIZE		4096
+#define DATABASE_CONFIG_LOGCACHE_PAGE_SIZE	65536
 #define DATABASE_CONFIG_CACHE_SIZE			500*MB
 #define DATABASE_CONFIG_LOG_BUFFER_SIZE		250*MB
 #define DATABASE_CONFIG_LOG_MAX_FILE		0
@@ -20,6 +23,9 @@ public:
 	{
 		dir = DATABASE_CONFIG_DIR;
 		pageSize = DATABASE_CONFIG_PAGE_SIZE;
+		expiryPageSize = DATABASE_CONFIG_EXPIRY_PAGE_SIZE;
+		metaPageSize = DATABASE_CONFIG_META_PAGE_SIZE;
+		logCachePageSize = DATABASE_CONFIG_LOGCACHE_PAGE_SIZE;
 		cacheSize = DATABASE_CONFIG_CACHE_SIZE;
 		logBufferSize = DATABASE_CONFIG_LOG_BUFFER_SIZE;
 		logMaxFile = DATABASE_CONFIG_LOG_MAX_FILE;
@@ -33,6 +39,9 @@ public:
 	
 	const char*	dir;
 	int			pageSize;
+	int			expiryPageSize;
+	int			metaPageSize;
+	int			logCachePageSize;
 	int			cacheSize;
 	int			logBufferSize;
 	int			logMaxFile;
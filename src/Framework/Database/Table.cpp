@@ -10,7 +10,19 @@
 #endif
 
 Table::Table(Database* database, const char *name, int pageSize) :
-database(database)
+database(database),
+pageSize(pageSize)
+{
+	db = NULL;
+	Open(name);
+}
+
+Table::~Table()
+{
+	Close();
+}
+
+void Table::Open(const char* name)
 {
 	DbTxn *txnid = NULL;
 	const char *filename = name;
@@ -41,8 +53,11 @@ database(database)
 	Log_Trace();
 }
 
-Table::~Table()
+void Table::Close()
 {
+	if (db == NULL)
+		return;
+
 	db->close(0);
 
 	// Bug #222: On Windows deleting the BDB database object causes crash
@@ -50,6 +65,7 @@ Table::~Table()
 #ifndef PLATFORM_WINDOWS
 	delete db;
 #endif
+	db = NULL;
 }
 
 bool Table::Iterate(Transaction* tx, Cursor& cursor)
@@ -101,6 +117,34 @@ bool Table::Get(Transaction* tx,
 	return true;
 }
 
+bool Table::Exists(Transaction* tx, const ByteString &key)
+{
+	Dbt dbtKey;
+	Dbt dbtValue;
+	DbTxn* txn = NULL;
+	char dummy;
+	int ret;
+	
+	if (tx)
+		txn = tx->txn;
+
+	dbtKey.set_flags(DB_DBT_USERMEM);
+	dbtKey.set_data(key.buffer);
+	dbtKey.set_ulen(key.length);
+	dbtKey.set_size(key.length);
+	
+	// a partial read of zero bytes, the value is not copied
+	dbtValue.set_flags(DB_DBT_USERMEM | DB_DBT_PARTIAL);
+	dbtValue.set_data(&dummy);
+	dbtValue.set_ulen(0);
+	dbtValue.set_dlen(0);
+	dbtValue.set_doff(0);
+	
+	ret = db->get(txn, &dbtKey, &dbtValue, 0);
+
+	return (ret == 0);
+}
+
 bool Table::Get(Transaction* tx, const char* key, ByteString &value)
 {
 	int len;
@@ -202,7 +246,7 @@ bool Table::Delete(Transaction* tx, const ByteString &key)
 	return true;
 }
 
-bool Table::Prune(Transaction* tx, const ByteString &prefix, bool pruneExpiries)
+bool Table::Prune(Transaction* tx, const ByteString &prefix)
 {
 	Dbc* cursor = NULL;
 	u_int32_t flags = DB_NEXT;
@@ -235,16 +279,6 @@ bool Table::Prune(Transaction* tx, const ByteString &prefix, bool pruneExpiries)
 
 		flags = DB_NEXT;
 		
-		// don't delete keys starting with @@
-		if (key.get_size() >= 2 &&
-			((char*)key.get_data())[0] == '@' && ((char*)key.get_data())[1] == '@')
-				continue;
-		
-		// don't delete keys starting with !!
-		if (!pruneExpiries && key.get_size() >= 2 &&
-			((char*)key.get_data())[0] == '!' && ((char*)key.get_data())[1] == '!')
-				continue;
-
 		cursor->del(0);
 	}
 	
@@ -254,6 +288,51 @@ bool Table::Prune(Transaction* tx, const ByteString &prefix, bool pruneExpiries)
 	return true;
 }
 
+int Table::Move(Transaction* tx, const ByteString &prefix, Table* target,
+unsigned limit, unsigned maxBytes)
+{
+	Dbc* cursor = NULL;
+	u_int32_t flags = DB_SET_RANGE;
+	unsigned num;
+	unsigned bytes;
+	DbTxn* txn;
+	
+	txn = tx ? tx->txn : NULL;
+	
+	if (db->cursor(txn, &cursor, 0) != 0)
+		return -1;
+	
+	Dbt key, value;
+	key.set_data(prefix.buffer);
+	key.set_size(prefix.length);
+	
+	num = 0;
+	bytes = 0;
+	while (num < limit && bytes < maxBytes &&
+		   cursor->get(&key, &value, flags) == 0)
+	{
+		if (key.get_size() < prefix.length)
+			break;
+		
+		if (memcmp(prefix.buffer, key.get_data(), prefix.length) != 0)
+			break;
+		
+		flags = DB_NEXT;
+		
+		if (target->db->put(txn, &key, &value, 0) != 0 || cursor->del(0) != 0)
+		{
+			cursor->close();
+			return -1;
+		}
+		num++;
+		bytes += key.get_size() + value.get_size();
+	}
+	
+	cursor->close();
+	
+	return num;
+}
+
 bool Table::Truncate(Transaction* tx)
 {
 	Log_Trace();
@@ -270,6 +349,16 @@ bool Table::Truncate(Transaction* tx)
 	return true;
 }
 
+unsigned Table::GetPageSize()
+{
+	u_int32_t pagesize;
+	
+	if (db->get_pagesize(&pagesize) != 0)
+		return 0;
+	
+	return pagesize;
+}
+
 bool Table::Visit(TableVisitor &tv)
 {
 	if (!tv.IsForward())
@@ -306,20 +395,7 @@ bool Table::Visit(TableVisitor &tv)
 		if (!ret)
 			break;
 		
-		if (bsKey.length > 2 && bsKey.buffer[0] == '@' && bsKey.buffer[1] == '@')
-		{
-			key.set_data((void*)"@@~");
-			key.set_size(3);
-			flags = DB_SET_RANGE;
-		}
-		if (bsKey.length > 2 && bsKey.buffer[0] == '!' && bsKey.buffer[1] == '!')
-		{
-			key.set_data((void*)"!!~");
-			key.set_size(3);
-			flags = DB_SET_RANGE;
-		}
-        else
-            flags = DB_NEXT;
+		flags = DB_NEXT;
 	}
 	
 	cursor->close();	
@@ -17,6 +17,7 @@ public:
 
 class Table
 {
+	friend class Database;
 	friend class Transaction;
 	
 public:
@@ -28,6 +29,7 @@ public:
 	bool		Get(Transaction* tx, const ByteString &key, ByteString &value);
 	bool		Get(Transaction* tx, const char* key, ByteString &value);
 	bool		Get(Transaction* tx, const char* key, uint64_t &value);
+	bool		Exists(Transaction* tx, const ByteString &key);
 	
 	bool		Set(Transaction* tx, const ByteString &key, const ByteString &value);
 	bool		Set(Transaction* tx, const char* key, const ByteString &value);
@@ -35,15 +37,25 @@ public:
 	bool		Set(Transaction* tx, const ByteString &key, uint64_t value);
 	
 	bool		Delete(Transaction* tx, const ByteString &key);
-	bool		Prune(Transaction* tx, const ByteString &prefix, bool pruneExpiries = false);
+	bool		Prune(Transaction* tx, const ByteString &prefix);
+	// moves keys starting with prefix to the target table until limit
+	// keys or maxBytes of keys and values are moved, returns the number
+	// of keys moved or -1 on error
+	int			Move(Transaction* tx, const ByteString &prefix, Table* target,
+					 unsigned limit, unsigned maxBytes);
 	bool		Truncate(Transaction* tx = NULL);
 	
 	bool		Visit(TableVisitor &tv);
 	
+	unsigned	GetPageSize();
+	
 private:
 	Database*	database;
 	Db*			db;
+	int			pageSize;
 	
+	void		Open(const char* name);
+	void		Close();
 	bool		VisitBackward(TableVisitor &tv);
 };
 
@@ -7,6 +7,7 @@
 class Transaction
 {
 	friend class Table;
+	friend class Database;
 	
 public:
 	Transaction();
@@ -8,16 +8,27 @@
 #include "Framework/ReplicatedLog/ReplicatedConfig.h"
 #include "Framework/ReplicatedLog/ReplicatedLog.h"
 
+#define ACCEPTOR_STATE_KEY			"@@acceptorState"
+#define ACCEPTOR_AHEAD_KEY			"@@acceptorState:"
+
 PaxosAcceptor::PaxosAcceptor() :
 	onDBComplete(this, &PaxosAcceptor::OnDBComplete)
 {
+	ahead = NULL;
 }
 
-void PaxosAcceptor::Init(Writers writers_)
+PaxosAcceptor::~PaxosAcceptor()
 {
+	delete[] ahead;
+}
+
+void PaxosAcceptor::Init(Writers writers_, unsigned windowSize_)
+{
+	unsigned i;
+	
 	writers = writers_;
 	
-	table = database.GetTable("keyspace");
+	table = database.GetTable("meta");
 	if (table == NULL)
 		ASSERT_FAIL();
 	transaction.Set(table);
@@ -25,9 +36,17 @@ void PaxosAcceptor::Init(Writers writers_)
 	paxosID = 0;
 	state.Init();
     isWriting = false;
+	legacyKeys = false;
+	
+	windowSize = windowSize_;
+	ahead = new Ahead[windowSize];
+	for (i = 0; i < windowSize; i++)
+		ahead[i].Init();
 
 	if (!ReadState())
 		Log_Message("Database is empty");
+	
+	ReadAheadState();
 }
 
 void PaxosAcceptor::Shutdown()
@@ -39,32 +58,37 @@ void PaxosAcceptor::Shutdown()
 bool PaxosAcceptor::Persist(Transaction* transaction)
 {
 	Log_Trace();
-
-	bool ret;
+	
+	bool		ret;
+	ByteBuffer	buffer;
+	AheadKey	key;
+	uint64_t*	it;
 	
 	if (table == NULL)
 		return false;
 	
+	if (!WriteRecord(buffer, paxosID, state))
+		return false;
+	
 	ret = true;
-	ret &= table->Set(transaction,
-					  "@@paxosID",
-					  rprintf("%" PRIu64 "", paxosID));
-					  
-	ret &= table->Set(transaction,
-					  "@@accepted",
-					  rprintf("%d", state.accepted));
-	
-	ret &= table->Set(transaction,
-					  "@@promisedProposalID",
-					  rprintf("%" PRIu64 "", state.promisedProposalID));
-					  
-	ret &= table->Set(transaction,
-					  "@@acceptedProposalID",
-					  rprintf("%" PRIu64 "", state.acceptedProposalID));
-					  
-	ret &= table->Set(transaction,
-					  "@@acceptedValue",
-					  state.acceptedValue);
+	ret &= table->Set(transaction, ACCEPTOR_STATE_KEY, buffer);
+	
+	for (it = obsoleteIDs.Head(); it != NULL; it = obsoleteIDs.Next(it))
+	{
+		WriteAheadKey(key, *it);
+		table->Delete(transaction, key);
+	}
+	obsoleteIDs.Clear();
+	
+	if (legacyKeys)
+	{
+		table->Delete(transaction, "@@paxosID");
+		table->Delete(transaction, "@@accepted");
+		table->Delete(transaction, "@@promisedProposalID");
+		table->Delete(transaction, "@@acceptedProposalID");
+		table->Delete(transaction, "@@acceptedValue");
+		legacyKeys = false;
+	}
 	
 	if (!ret)
 		return false;
@@ -72,18 +96,75 @@ bool PaxosAcceptor::Persist(Transaction* transaction)
 	return true;
 }
 
+bool PaxosAcceptor::ReadPaxosID(Table* table, uint64_t& paxosID)
+{
+	ByteBuffer	buffer;
+	unsigned	pos;
+	
+	if (!buffer.Reallocate(ACCEPTOR_STATE_HEADER_SIZE + RLOG_SIZE))
+		return false;
+	
+	if (!table->Get(NULL, ACCEPTOR_STATE_KEY, buffer))
+		return table->Get(NULL, "@@paxosID", paxosID);
+	
+	if (buffer.length < 2 || buffer.buffer[0] != ACCEPTOR_STATE_V1)
+		return false;
+	
+	pos = 2;
+	return ReadVarint(buffer, pos, paxosID);
+}
+
+bool PaxosAcceptor::WritePaxosID(Table* table, Transaction* transaction,
+uint64_t paxosID)
+{
+	ByteArray<ACCEPTOR_STATE_HEADER_SIZE> buffer;
+	
+	// the state of a new round, nothing accepted or promised
+	buffer.buffer[0] = ACCEPTOR_STATE_V1;
+	buffer.buffer[1] = 0;
+	buffer.length = 2;
+	
+	if (!WriteVarint(buffer, paxosID) ||
+		!WriteVarint(buffer, 0) ||
+		!WriteVarint(buffer, 0))
+			return false;
+	
+	return table->Set(transaction, ACCEPTOR_STATE_KEY, buffer);
+}
+
 bool PaxosAcceptor::ReadState()
 {
 	Log_Trace();
 	
-	bool ret;
-	unsigned nread = 0;
-	
 	if (table == NULL)
 		return false;
 		
-	state.acceptedValue.Allocate(PAXOS_SIZE + 10*KB);
+	state.acceptedValue.Allocate(ACCEPTOR_STATE_HEADER_SIZE + RLOG_SIZE);
+	
+	if (!table->Get(NULL, ACCEPTOR_STATE_KEY, state.acceptedValue))
+	{
+		legacyKeys = true;
+		return ReadLegacyState();
+	}
+	
+	if (!ReadRecord(state.acceptedValue, paxosID, state))
+	{
+		Log_Trace();
+		paxosID = 0;
+		state.Init();
+		return false;
+	}
+	
+	return (paxosID > 0);
+}
 
+bool PaxosAcceptor::ReadLegacyState()
+{
+	Log_Trace();
+	
+	bool ret;
+	unsigned nread = 0;
+	
 	ret = table->Get(NULL, "@@paxosID", buffers[0]);
 	if (!ret)
 		return false;
@@ -148,31 +229,196 @@ bool PaxosAcceptor::ReadState()
 	return (paxosID > 0);
 }
 
-bool PaxosAcceptor::WriteState()
+void PaxosAcceptor::ReadAheadState()
 {
-	Log_Trace();
+	Cursor			cursor;
+	DynArray<128>	key;
+	ByteBuffer		value;
+	State			tmp;
+	uint64_t		id;
+	Ahead*			round;
+	bool			found;
+	
+	if (table == NULL)
+		return;
+	
+	// the rounds after paxosID are loaded, the ones before it were
+	// chosen and are deleted; the record of the current round is kept
+	// until the state record is written with it
+	transaction.Begin();
+	table->Iterate(&transaction, cursor);
+	key.Set(ACCEPTOR_AHEAD_KEY, sizeof(ACCEPTOR_AHEAD_KEY) - 1);
+	for (found = cursor.Start(key, value); found;
+		 found = cursor.Next(key, value))
+	{
+		if (key.length < sizeof(ACCEPTOR_AHEAD_KEY) - 1 ||
+			strncmp(key.buffer, ACCEPTOR_AHEAD_KEY,
+					sizeof(ACCEPTOR_AHEAD_KEY) - 1) != 0)
+				break;
+		
+		if (!ReadRecord(value, id, tmp) || id < paxosID)
+		{
+			cursor.Delete();
+			continue;
+		}
+		
+		if (id == paxosID)
+		{
+			if (!state.accepted)
+			{
+				state.promisedProposalID = tmp.promisedProposalID;
+				state.accepted = tmp.accepted;
+				state.acceptedProposalID = tmp.acceptedProposalID;
+				state.acceptedValue.Set(value);
+			}
+			obsoleteIDs.Append(id);
+			continue;
+		}
+		
+		if (!IsAhead(id))
+		{
+			Log_Message("Round %" PRIu64 " was accepted ahead of"
+						" rlog.appendQueueDepth, it is not loaded", id);
+			continue;
+		}
+		
+		round = &ahead[id % windowSize];
+		round->paxosID = id;
+		round->written = true;
+		round->state.promisedProposalID = tmp.promisedProposalID;
+		round->state.accepted = tmp.accepted;
+		round->state.acceptedProposalID = tmp.acceptedProposalID;
+		round->state.acceptedValue.Set(value);
+	}
+	cursor.Close();
+	transaction.Commit();
+}
+
+// the state is one record: version, accepted flag, paxosID,
+// promisedProposalID and acceptedProposalID as varints (see
+// System/Binary.h), then the accepted value up to the end; a round
+// accepted ahead has a record of the same format under its own key
 
+bool PaxosAcceptor::WriteRecord(ByteBuffer& buffer, uint64_t paxosID_,
+State& state_)
+{
 	bool ret;
 	
+	if (!buffer.Reallocate(ACCEPTOR_STATE_HEADER_SIZE +
+						   state_.acceptedValue.length))
+		return false;
+	
+	buffer.buffer[0] = ACCEPTOR_STATE_V1;
+	buffer.buffer[1] = state_.accepted ? 1 : 0;
+	buffer.length = 2;
+	
+	ret = true;
+	ret &= WriteVarint(buffer, paxosID_);
+	ret &= WriteVarint(buffer, state_.promisedProposalID);
+	ret &= WriteVarint(buffer, state_.acceptedProposalID);
+	if (!ret)
+		return false;
+	
+	memcpy(buffer.buffer + buffer.length,
+		   state_.acceptedValue.buffer, state_.acceptedValue.length);
+	buffer.length += state_.acceptedValue.length;
+	
+	return true;
+}
+
+bool PaxosAcceptor::ReadRecord(ByteBuffer& buffer, uint64_t& paxosID_,
+State& state_)
+{
+	unsigned pos;
+	
+	// the value is moved to the start of the buffer in place
+	if (buffer.length < 2 || buffer.buffer[0] != ACCEPTOR_STATE_V1)
+		return false;
+	
+	pos = 2;
+	if (!ReadVarint(buffer, pos, paxosID_) ||
+		!ReadVarint(buffer, pos, state_.promisedProposalID) ||
+		!ReadVarint(buffer, pos, state_.acceptedProposalID))
+			return false;
+	
+	state_.accepted = (buffer.buffer[1] != 0);
+	memmove(buffer.buffer, buffer.buffer + pos, buffer.length - pos);
+	buffer.length -= pos;
+	
+	return true;
+}
+
+void PaxosAcceptor::WriteAheadKey(ByteString& key, uint64_t paxosID_)
+{
+	// 2^64 is at most 20 digits
+	key.length = snprintf(key.buffer, key.size,
+						  ACCEPTOR_AHEAD_KEY "%020" PRIu64, paxosID_);
+}
+
+bool PaxosAcceptor::WriteState(uint64_t paxosID_)
+{
+	Log_Trace();
+
+	bool		ret;
+	unsigned	i;
+	uint64_t*	it;
+	Ahead*		round;
+	ByteString	key;
+	
 	if (table == NULL)
 		return false;
 	
-	writtenPaxosID = paxosID;
+	writtenPaxosID = paxosID_;
 	
-	buffers[0].Set(rprintf("%" PRIu64 "",	paxosID));
-	buffers[1].Set(rprintf("%d",			state.accepted));
-	buffers[2].Set(rprintf("%" PRIu64 "",	state.promisedProposalID));
-	buffers[3].Set(rprintf("%" PRIu64 "",	state.acceptedProposalID));
+	// the state record goes with every write, the rounds applied
+	// before paxosID are committed with it
+	if (!WriteRecord(record, paxosID, state))
+		return false;
 	
 	mdbop.Init();
 	mdbop.SetCallback(&onDBComplete);
 	
 	ret = true;
-	ret &= mdbop.Set(table, "@@paxosID",			buffers[0]);
-	ret &= mdbop.Set(table, "@@accepted",			buffers[1]);
-	ret &= mdbop.Set(table, "@@promisedProposalID",	buffers[2]);
-	ret &= mdbop.Set(table, "@@acceptedProposalID",	buffers[3]);
-	ret &= mdbop.Set(table, "@@acceptedValue",		state.acceptedValue);
+	ret &= mdbop.Set(table, ACCEPTOR_STATE_KEY, record);
+	
+	if (paxosID_ != paxosID)
+	{
+		round = &ahead[paxosID_ % windowSize];
+		if (!WriteRecord(aheadRecord, paxosID_, round->state))
+			return false;
+		WriteAheadKey(aheadKey, paxosID_);
+		ret &= mdbop.Set(table, aheadKey, aheadRecord);
+		round->written = true;
+	}
+	
+	// the ops only point to the keys
+	if (obsoleteIDs.Length() > 0)
+	{
+		if (!obsoleteKeys.Reallocate(obsoleteIDs.Length() *
+									 ACCEPTOR_AHEAD_KEY_SIZE))
+			return false;
+		i = 0;
+		for (it = obsoleteIDs.Head(); it != NULL; it = obsoleteIDs.Next(it))
+		{
+			key.Init();
+			key.buffer = obsoleteKeys.buffer + i * ACCEPTOR_AHEAD_KEY_SIZE;
+			key.size = ACCEPTOR_AHEAD_KEY_SIZE;
+			WriteAheadKey(key, *it);
+			ret &= mdbop.Delete(table, key);
+			i++;
+		}
+		obsoleteIDs.Clear();
+	}
+	
+	if (legacyKeys)
+	{
+		ret &= mdbop.Delete(table, "@@paxosID");
+		ret &= mdbop.Delete(table, "@@accepted");
+		ret &= mdbop.Delete(table, "@@promisedProposalID");
+		ret &= mdbop.Delete(table, "@@acceptedProposalID");
+		ret &= mdbop.Delete(table, "@@acceptedValue");
+		legacyKeys = false;
+	}
 
 	if (!ret)
 		return false;
@@ -188,7 +434,7 @@ bool PaxosAcceptor::WriteState()
 
 void PaxosAcceptor::SendReply(unsigned nodeID)
 {
-	msg.Write(msgbuf);
+	msg.Write(msgbuf, writers[nodeID]->IsBinary());
 
 	writers[nodeID]->Write(msgbuf);
 }
@@ -232,12 +478,15 @@ void PaxosAcceptor::OnPrepareRequest(PaxosMsg& msg_)
 			state.acceptedProposalID,
 			state.acceptedValue);
 	
-	WriteState();
+	WriteState(paxosID);
 	RLOG->StopPaxos();
 }
 
 void PaxosAcceptor::OnProposeRequest(PaxosMsg& msg_)
 {
+	State*	st;
+	Ahead*	round;
+	
 	Log_Trace();
 	
 	if (mdbop.IsActive())
@@ -246,12 +495,29 @@ void PaxosAcceptor::OnProposeRequest(PaxosMsg& msg_)
 	msg = msg_;
 	
 	senderID = msg.nodeID;
+	
+	// a round ahead of paxosID is not prepared, only the leader
+	// proposes it with proposal 0
+	if (msg.paxosID == paxosID)
+		st = &state;
+	else
+	{
+		round = &ahead[msg.paxosID % windowSize];
+		if (round->paxosID != msg.paxosID)
+		{
+			if (round->written)
+				obsoleteIDs.Append(round->paxosID);
+			round->Init();
+			round->paxosID = msg.paxosID;
+		}
+		st = &round->state;
+	}
 
 	Log_Trace("state.promisedProposalID: %" PRIu64 " "
 				"msg.proposalID: %" PRIu64 "",
-				state.promisedProposalID, msg.proposalID);
+				st->promisedProposalID, msg.proposalID);
 	
-	if (msg.proposalID < state.promisedProposalID)
+	if (msg.proposalID < st->promisedProposalID)
 	{
 		msg.ProposeRejected(msg.paxosID,
 			RCONF->GetNodeID(),
@@ -261,15 +527,15 @@ void PaxosAcceptor::OnProposeRequest(PaxosMsg& msg_)
 		return;
 	}
 
-	state.accepted = true;
-	state.acceptedProposalID = msg.proposalID;
-	if (!state.acceptedValue.Set(msg.value))
+	st->accepted = true;
+	st->acceptedProposalID = msg.proposalID;
+	if (!st->acceptedValue.Set(msg.value))
 		ASSERT_FAIL();
 	msg.ProposeAccepted(msg.paxosID,
 		RCONF->GetNodeID(),
 		msg.proposalID);
 	
-	WriteState();
+	WriteState(msg.paxosID);
 	RLOG->StopPaxos();
 }
 
@@ -279,8 +545,78 @@ void PaxosAcceptor::OnDBComplete()
 
     isWriting = false;
 
+	// replied first, ContinuePaxos() may process the next messages
+	if (writtenPaxosID >= paxosID)
+		SendReply(senderID); // TODO: check that the transaction commited
+
 	RLOG->ContinuePaxos();
+}
 
-	if (writtenPaxosID == paxosID)
-		SendReply(senderID); // TODO: check that the transaction commited
+bool PaxosAcceptor::IsAhead(uint64_t paxosID_)
+{
+	return (paxosID_ > paxosID && paxosID_ < paxosID + windowSize);
+}
+
+bool PaxosAcceptor::GetAheadValue(uint64_t paxosID_, uint64_t proposalID,
+ByteString& value)
+{
+	Ahead* round;
+	
+	round = &ahead[paxosID_ % windowSize];
+	if (round->paxosID != paxosID_ || !round->state.accepted ||
+		round->state.acceptedProposalID != proposalID)
+			return false;
+	
+	value.Set(round->state.acceptedValue);
+	return true;
+}
+
+void PaxosAcceptor::NewPaxosRound()
+{
+	Ahead* round;
+	
+	paxosID++;
+	state.Init();
+	
+	// its record is deleted when the state record includes it
+	round = &ahead[paxosID % windowSize];
+	if (round->paxosID == paxosID)
+	{
+		state.promisedProposalID = round->state.promisedProposalID;
+		state.accepted = round->state.accepted;
+		state.acceptedProposalID = round->state.acceptedProposalID;
+		state.acceptedValue.Swap(round->state.acceptedValue);
+		if (round->written)
+			obsoleteIDs.Append(round->paxosID);
+		round->Init();
+	}
+}
+
+void PaxosAcceptor::SetPaxosID(uint64_t paxosID_)
+{
+	unsigned	i;
+	Ahead*		round;
+	
+	paxosID = paxosID_;
+	state.Init();
+	
+	// the rounds accepted ahead of the new paxosID are kept, the
+	// state is written by Persist()
+	for (i = 0; i < windowSize; i++)
+	{
+		round = &ahead[i];
+		if (round->paxosID == 0 || IsAhead(round->paxosID))
+			continue;
+		
+		if (round->paxosID == paxosID)
+		{
+			state.promisedProposalID = round->state.promisedProposalID;
+			state.accepted = round->state.accepted;
+			state.acceptedProposalID = round->state.acceptedProposalID;
+			state.acceptedValue.Swap(round->state.acceptedValue);
+		}
+		if (round->written)
+			obsoleteIDs.Append(round->paxosID);
+		round->Init();
+	}
 }
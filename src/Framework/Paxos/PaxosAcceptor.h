@@ -2,33 +2,59 @@
 #define PAXOSACCEPTOR_H
 
 #include "System/Common.h"
+#include "System/Binary.h"
+#include "System/Containers/List.h"
 #include "Framework/Transport/TransportTCPWriter.h"
 #include "Framework/AsyncDatabase/AsyncDatabase.h"
 #include "Framework/Database/Transaction.h"
+#include "PaxosConsts.h"
 #include "PaxosMsg.h"
 #include "PaxosState.h"
 
+#define ACCEPTOR_STATE_V1			1
+#define ACCEPTOR_STATE_HEADER_SIZE	(2 + 3 * VARINT_MAX_LENGTH)
+#define ACCEPTOR_AHEAD_KEY_SIZE		40
+
 class PaxosAcceptor
 {
 	friend class ReplicatedLog;
 	typedef TransportTCPWriter**	Writers;
 	typedef PaxosAcceptorState		State;
+	typedef PaxosAcceptorAhead		Ahead;
 	typedef	MFunc<PaxosAcceptor>	Func;
+	typedef ByteArray<ACCEPTOR_AHEAD_KEY_SIZE>	AheadKey;
 public:
 	PaxosAcceptor();
+	~PaxosAcceptor();
 	
-	void			Init(Writers writer_);
+	void			Init(Writers writer_, unsigned windowSize_);
 	void			Shutdown();
 	bool			Persist(Transaction* transaction);
+	
+	static bool		ReadPaxosID(Table* table, uint64_t& paxosID);
+	static bool		WritePaxosID(Table* table, Transaction* transaction,
+								 uint64_t paxosID);
 	bool			IsWriting() { return isWriting; }
 
 protected:
-	bool			WriteState();
+	bool			WriteState(uint64_t paxosID_);
 	bool			ReadState();
+	bool			ReadLegacyState();
+	void			ReadAheadState();
+	bool			WriteRecord(ByteBuffer& buffer, uint64_t paxosID_,
+								State& state_);
+	bool			ReadRecord(ByteBuffer& buffer, uint64_t& paxosID_,
+							   State& state_);
+	static void		WriteAheadKey(ByteString& key, uint64_t paxosID_);
 	void			SendReply(unsigned nodeID);
 	void			OnPrepareRequest(PaxosMsg& msg_);
 	void			OnProposeRequest(PaxosMsg& msg_);
 	void			OnDBComplete();
+	bool			IsAhead(uint64_t paxosID_);
+	bool			GetAheadValue(uint64_t paxosID_, uint64_t proposalID,
+								  ByteString& value);
+	void			NewPaxosRound();
+	void			SetPaxosID(uint64_t paxosID_);
 
 	Writers			writers;
 	ByteBuffer		msgbuf;
@@ -40,6 +66,14 @@ protected:
 	Transaction		transaction;
 	MultiDatabaseOp	mdbop;
 	ByteArray<128>	buffers[4];
+	ByteBuffer		record;
+	unsigned		windowSize;
+	Ahead*			ahead;			// the rounds accepted ahead of paxosID
+	ByteBuffer		aheadRecord;
+	AheadKey		aheadKey;
+	List<uint64_t>	obsoleteIDs;	// ahead records to delete
+	ByteBuffer		obsoleteKeys;
+	bool			legacyKeys;
 	uint64_t		writtenPaxosID;
 	Func			onDBComplete;
     bool            isWriting;
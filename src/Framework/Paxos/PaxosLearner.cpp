@@ -9,14 +9,27 @@
 
 PaxosLearner::PaxosLearner()
 {
+	ahead = NULL;
 }
 
-void PaxosLearner::Init(Writers writers_)
+PaxosLearner::~PaxosLearner()
 {
+	delete[] ahead;
+}
+
+void PaxosLearner::Init(Writers writers_, unsigned windowSize_)
+{
+	unsigned i;
+	
 	writers = writers_;
 	lastRequestChosenTime = 0;
 	lastRequestChosenPaxosID = 0;
 	state.Init();
+	
+	windowSize = windowSize_;
+	ahead = new Ahead[windowSize];
+	for (i = 0; i < windowSize; i++)
+		ahead[i].Init();
 }
 
 bool PaxosLearner::RequestChosen(unsigned nodeID)
@@ -32,7 +45,7 @@ bool PaxosLearner::RequestChosen(unsigned nodeID)
 	
 	msg.RequestChosen(paxosID, RCONF->GetNodeID());
 	
-	msg.Write(wdata);
+	msg.Write(wdata, writers[nodeID]->IsBinary());
 
 	writers[nodeID]->Write(wdata);
 	
@@ -47,7 +60,7 @@ bool PaxosLearner::SendChosen(unsigned nodeID,
 	
 	msg.LearnValue(paxosID, RCONF->GetNodeID(), value);
 	
-	msg.Write(wdata);
+	msg.Write(wdata, writers[nodeID]->IsBinary());
 
 	writers[nodeID]->Write(wdata);
 	
@@ -61,7 +74,7 @@ bool PaxosLearner::SendStartCatchup(unsigned nodeID,
 	
 	msg.StartCatchup(paxosID, RCONF->GetNodeID());
 	
-	msg.Write(wdata);
+	msg.Write(wdata, writers[nodeID]->IsBinary());
 
 	writers[nodeID]->Write(wdata);
 	
@@ -72,8 +85,20 @@ void PaxosLearner::OnLearnChosen(PaxosMsg& msg_)
 {
 	Log_Trace();
 
+	Ahead* round;
+
 	msg = msg_;
 
+	// a later round is kept until the ones before it are learned
+	if (msg.paxosID != paxosID)
+	{
+		round = &ahead[msg.paxosID % windowSize];
+		round->paxosID = msg.paxosID;
+		round->state.learned = true;
+		round->state.value.Set(msg.value);
+		return;
+	}
+
 	state.learned = true;
 	state.value.Set(msg.value);
 
@@ -83,14 +108,69 @@ void PaxosLearner::OnLearnChosen(PaxosMsg& msg_)
 
 void PaxosLearner::OnRequestChosen(PaxosMsg& msg_)
 {
+	Ahead* round;
+	
 	Log_Trace();
 
 	msg = msg_;
 
+	if (msg.paxosID != paxosID)
+	{
+		round = &ahead[msg.paxosID % windowSize];
+		if (round->paxosID == msg.paxosID && round->state.learned)
+			SendChosen(msg.nodeID, msg.paxosID, round->state.value);
+		return;
+	}
+
 	if (state.learned)
 		SendChosen(msg.nodeID, paxosID, state.value);
 }
 
+void PaxosLearner::NewPaxosRound()
+{
+	Ahead* round;
+	
+	paxosID++;
+	state.Init();
+	
+	// the buffers are swapped, the caller may still read the value
+	// of the previous round
+	round = &ahead[paxosID % windowSize];
+	if (round->paxosID == paxosID)
+	{
+		state.learned = round->state.learned;
+		state.value.Swap(round->state.value);
+		round->Init();
+	}
+}
+
+void PaxosLearner::SetPaxosID(uint64_t paxosID_)
+{
+	unsigned	i;
+	Ahead*		round;
+	
+	paxosID = paxosID_;
+	state.Init();
+	
+	// the rounds learned ahead of the new paxosID are kept
+	for (i = 0; i < windowSize; i++)
+	{
+		round = &ahead[i];
+		if (round->paxosID == paxosID && round->state.learned)
+		{
+			state.learned = true;
+			state.value.Swap(round->state.value);
+		}
+		if (!IsAhead(round->paxosID))
+			round->Init();
+	}
+}
+
+bool PaxosLearner::IsAhead(uint64_t paxosID_)
+{
+	return (paxosID_ > paxosID && paxosID_ < paxosID + windowSize);
+}
+
 bool PaxosLearner::Learned()
 {
 	return state.learned;	
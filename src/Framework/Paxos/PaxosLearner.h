@@ -14,11 +14,13 @@ class PaxosLearner
 	friend class ReplicatedLog;
 	typedef	TransportTCPWriter**	Writers;
 	typedef PaxosLearnerState		State;
+	typedef PaxosLearnerAhead		Ahead;
 
 protected:
 	PaxosLearner();
+	~PaxosLearner();
 	
-	void		Init(TransportTCPWriter** writers_);
+	void		Init(TransportTCPWriter** writers_, unsigned windowSize_);
 	
 	bool		RequestChosen(unsigned nodeID);
 	bool		SendChosen(unsigned nodeID,
@@ -28,10 +30,13 @@ protected:
 								 uint64_t paxosID);	
 	bool		Learned();
 	ByteString	Value();
+	bool		IsAhead(uint64_t paxosID_);
 
 protected:
 	void		OnLearnChosen(PaxosMsg& msg_);
 	void		OnRequestChosen(PaxosMsg& msg_);
+	void		NewPaxosRound();
+	void		SetPaxosID(uint64_t paxosID_);
 
 	Writers		writers;
 	ByteBuffer	wdata;
@@ -40,6 +45,8 @@ protected:
 	State		state;
 	uint64_t	lastRequestChosenTime;
 	uint64_t	lastRequestChosenPaxosID;
+	unsigned	windowSize;
+	Ahead*		ahead;		// the rounds learned ahead of paxosID
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include "PaxosMsg.h"
 #include "System/Common.h"
+#include "System/Binary.h"
 
 void PaxosMsg::Init(uint64_t paxosID_, char type_, unsigned nodeID_)
 {
@@ -145,6 +146,9 @@ bool PaxosMsg::Read(const ByteString& data)
 	
 	if (data.length < 1)
 		return false;
+	
+	if (data.buffer[0] == PAXOS_MSG_BINARY_V1)
+		return ReadBinary(data);
 
 	switch (data.buffer[0])
 	{
@@ -256,3 +260,116 @@ bool PaxosMsg::Write(ByteString& data)
 			return false;
 	}
 }
+
+bool PaxosMsg::Write(ByteBuffer& data, bool binary)
+{
+	if (binary)
+		return WriteBinary(data);
+	
+	return Write(data);
+}
+
+// the binary format has the fields of the text format in the same
+// order, see System/Binary.h; the value is not copied when reading
+
+bool PaxosMsg::ReadBinary(const ByteString& data)
+{
+	unsigned	pos;
+	bool		ret;
+	
+	if (data.length < 2)
+		return false;
+	
+	type = data.buffer[1];
+	pos = 2;
+	ret = ReadVarint(data, pos, paxosID);
+	ret = ret && ReadVarint(data, pos, nodeID);
+	
+	switch (type)
+	{
+		case PAXOS_PREPARE_REQUEST:
+		case PAXOS_PREPARE_CURRENTLY_OPEN:
+		case PAXOS_PROPOSE_REJECTED:
+		case PAXOS_PROPOSE_ACCEPTED:
+		case PAXOS_LEARN_PROPOSAL:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			break;
+		case PAXOS_PREPARE_REJECTED:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadVarint(data, pos, promisedProposalID);
+			break;
+		case PAXOS_PREPARE_PREVIOUSLY_ACCEPTED:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadVarint(data, pos, acceptedProposalID);
+			ret = ret && ReadBytesNoCopy(data, pos, value);
+			break;
+		case PAXOS_PROPOSE_REQUEST:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadBytesNoCopy(data, pos, value);
+			break;
+		case PAXOS_LEARN_VALUE:
+			ret = ret && ReadBytesNoCopy(data, pos, value);
+			break;
+		case PAXOS_REQUEST_CHOSEN:
+		case PAXOS_START_CATCHUP:
+			break;
+		default:
+			return false;
+	}
+	
+	return (ret && pos == data.length);
+}
+
+bool PaxosMsg::WriteBinary(ByteBuffer& data)
+{
+	unsigned	size;
+	bool		ret;
+	
+	size = 2 + 5 * VARINT_MAX_LENGTH;
+	if (type == PAXOS_PREPARE_PREVIOUSLY_ACCEPTED ||
+		type == PAXOS_PROPOSE_REQUEST ||
+		type == PAXOS_LEARN_VALUE)
+			size += value.length;
+	if (data.size < size && !data.Reallocate(size))
+		return false;
+	
+	data.buffer[0] = PAXOS_MSG_BINARY_V1;
+	data.buffer[1] = type;
+	data.length = 2;
+	ret = WriteVarint(data, paxosID);
+	ret = ret && WriteVarint(data, nodeID);
+	
+	switch (type)
+	{
+		case PAXOS_PREPARE_REQUEST:
+		case PAXOS_PREPARE_CURRENTLY_OPEN:
+		case PAXOS_PROPOSE_REJECTED:
+		case PAXOS_PROPOSE_ACCEPTED:
+		case PAXOS_LEARN_PROPOSAL:
+			ret = ret && WriteVarint(data, proposalID);
+			break;
+		case PAXOS_PREPARE_REJECTED:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteVarint(data, promisedProposalID);
+			break;
+		case PAXOS_PREPARE_PREVIOUSLY_ACCEPTED:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteVarint(data, acceptedProposalID);
+			ret = ret && WriteBytes(data, value);
+			break;
+		case PAXOS_PROPOSE_REQUEST:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteBytes(data, value);
+			break;
+		case PAXOS_LEARN_VALUE:
+			ret = ret && WriteBytes(data, value);
+			break;
+		case PAXOS_REQUEST_CHOSEN:
+		case PAXOS_START_CATCHUP:
+			break;
+		default:
+			return false;
+	}
+	
+	return ret;
+}
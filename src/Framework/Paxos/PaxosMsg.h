@@ -15,6 +15,9 @@
 #define PAXOS_REQUEST_CHOSEN				'0'
 #define PAXOS_START_CATCHUP					'c'
 
+// first byte of a binary message, text messages start with the type
+#define PAXOS_MSG_BINARY_V1					1
+
 class PaxosMsg
 {
 public:
@@ -58,6 +61,11 @@ public:
 
 	bool		Read(const ByteString& data);
 	bool		Write(ByteString& data);
+	bool		Write(ByteBuffer& data, bool binary);
+
+private:
+	bool		ReadBinary(const ByteString& data);
+	bool		WriteBinary(ByteBuffer& data);
 };
 
 #endif
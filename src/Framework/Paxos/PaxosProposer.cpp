@@ -7,19 +7,35 @@ onProposeTimeout(this, &PaxosProposer::OnProposeTimeout),
 prepareTimeout(PAXOS_TIMEOUT, &onPrepareTimeout),
 proposeTimeout(PAXOS_TIMEOUT, &onProposeTimeout)
 {
+	ahead = NULL;
 }
 
-void PaxosProposer::Init(Writers writers_)
+PaxosProposer::~PaxosProposer()
 {
+	delete[] ahead;
+}
+
+void PaxosProposer::Init(Writers writers_, unsigned windowSize_)
+{
+	unsigned i;
+	
 	writers = writers_;
 	
 	// Paxos variables
 	paxosID = 0;
 	state.Init();
+	
+	fastPaxosID = 0;
+	windowSize = windowSize_;
+	ahead = new Ahead[windowSize];
+	for (i = 0; i < windowSize; i++)
+		ahead[i].Init();
 }
 
 bool PaxosProposer::Propose(ByteString& value)
 {
+	Ahead* round;
+	
 	Log_Trace();
 	
 	if (IsActive())
@@ -34,10 +50,19 @@ bool PaxosProposer::Propose(ByteString& value)
 		return false;
 	}
 	
-	if (state.leader && state.numProposals == 0)
+	// a previous leader may have used proposal 0 for the rounds it
+	// proposed ahead, those are before fastPaxosID
+	if (state.leader && state.numProposals == 0 &&
+		fastPaxosID > 0 && paxosID >= fastPaxosID)
 	{
 		state.numProposals++;
-		StartProposing();
+		round = &ahead[paxosID % windowSize];
+		if (!round->proposed || round->paxosID != paxosID)
+			StartProposing();
+		else if (round->value.buffer == value.buffer)
+			ContinueAhead(round);
+		else
+			StartPreparing();
 	}
 	else
 		StartPreparing();
@@ -45,13 +70,45 @@ bool PaxosProposer::Propose(ByteString& value)
 	return true;
 }
 
+bool PaxosProposer::ProposeAhead(uint64_t paxosID_, ByteString& value)
+{
+	Ahead* round;
+	
+	Log_Trace("paxosID = %" PRIu64, paxosID_);
+	
+	if (!state.leader || fastPaxosID == 0 || paxosID_ < fastPaxosID ||
+		!IsAhead(paxosID_))
+			return false;
+	
+	round = &ahead[paxosID_ % windowSize];
+	if (round->proposed && round->paxosID == paxosID_)
+		return false;
+	
+	// the value stays in the LogQueue until its round is learned
+	round->Init();
+	round->paxosID = paxosID_;
+	round->proposed = true;
+	round->proposing = true;
+	round->value.Set(value);
+	
+	msg.ProposeRequest(paxosID_, RCONF->GetNodeID(), 0, value);
+	Broadcast();
+	
+	return true;
+}
+
 void PaxosProposer::Stop()
 {
+	unsigned i;
+	
 	state.value.Init();
 	state.preparing = false;
 	state.proposing = false;
 	EventLoop::Remove(&prepareTimeout);
 	EventLoop::Remove(&proposeTimeout);
+	
+	for (i = 0; i < windowSize; i++)
+		ahead[i].Init();
 }
 
 bool PaxosProposer::IsActive()
@@ -59,6 +116,15 @@ bool PaxosProposer::IsActive()
 	return (state.preparing || state.proposing);
 }
 
+void PaxosProposer::Broadcast()
+{
+	msg.Write(wdata,
+			  TransportTCPWriter::IsBinary(writers, RCONF->GetNumNodes()));
+	
+	for (unsigned nodeID = 0; nodeID < RCONF->GetNumNodes(); nodeID++)
+		writers[nodeID]->Write(wdata);
+}
+
 void PaxosProposer::BroadcastMessage()
 {
 	Log_Trace();
@@ -67,10 +133,7 @@ void PaxosProposer::BroadcastMessage()
 	numAccepted = 0;
 	numRejected = 0;
 	
-	msg.Write(wdata);
-	
-	for (unsigned nodeID = 0; nodeID < RCONF->GetNumNodes(); nodeID++)
-		writers[nodeID]->Write(wdata);
+	Broadcast();
 }
 
 void PaxosProposer::OnPrepareResponse(PaxosMsg& msg_)
@@ -138,6 +201,113 @@ void PaxosProposer::OnProposeResponse(PaxosMsg& msg_)
 		StartPreparing();
 }
 
+void PaxosProposer::OnProposeAheadResponse(PaxosMsg& msg_)
+{
+	Ahead* round;
+	
+	Log_Trace("msg.nodeID = %u", msg_.nodeID);
+	
+	round = &ahead[msg_.paxosID % windowSize];
+	if (!round->proposing || round->paxosID != msg_.paxosID ||
+		msg_.proposalID != 0)
+			return;
+	
+	round->numReceived++;
+	
+	if (msg_.type == PAXOS_PROPOSE_ACCEPTED)
+		round->numAccepted++;
+	
+	// the learners apply it after the rounds before it; if it is not
+	// chosen it is proposed again when it is the current round
+	if (round->numAccepted >= RCONF->MinMajority())
+	{
+		round->proposing = false;
+		msg.LearnProposal(round->paxosID, RCONF->GetNodeID(), 0);
+		Broadcast();
+	}
+}
+
+bool PaxosProposer::IsAhead(uint64_t paxosID_)
+{
+	return (paxosID_ > paxosID && paxosID_ < paxosID + windowSize);
+}
+
+bool PaxosProposer::IsProposingAhead()
+{
+	unsigned i;
+	
+	for (i = 0; i < windowSize; i++)
+	{
+		if (ahead[i].proposed && ahead[i].paxosID >= paxosID)
+			return true;
+	}
+	
+	return false;
+}
+
+bool PaxosProposer::GetAheadValue(uint64_t paxosID_, uint64_t proposalID,
+ByteString& value)
+{
+	Ahead* round;
+	
+	round = &ahead[paxosID_ % windowSize];
+	if (!round->proposed || round->paxosID != paxosID_ || proposalID != 0)
+		return false;
+	
+	value.Set(round->value);
+	return true;
+}
+
+void PaxosProposer::ContinueAhead(Ahead* round)
+{
+	Log_Trace();
+	
+	// the round was proposed ahead with the same value and proposal,
+	// the replies to that are counted on
+	state.proposing = true;
+	numReceived = round->numReceived;
+	numAccepted = round->numAccepted;
+	numRejected = 0;
+	round->Init();
+	
+	EventLoop::Reset(&proposeTimeout);
+	
+	if (numAccepted >= RCONF->MinMajority())
+	{
+		// chosen already, the learners that could not learn it ahead
+		// learn it now
+		StopProposing();
+		msg.LearnProposal(paxosID, RCONF->GetNodeID(), state.proposalID);
+		BroadcastMessage();
+	}
+	else if (numReceived == RCONF->GetNumNodes())
+		StartPreparing();
+}
+
+void PaxosProposer::NewPaxosRound()
+{
+	Ahead* round;
+	
+	EventLoop::Remove(&prepareTimeout);
+	EventLoop::Remove(&proposeTimeout);
+	
+	// a round learned before it was the current one
+	round = &ahead[paxosID % windowSize];
+	if (round->paxosID == paxosID)
+		round->Init();
+	
+	paxosID++;
+	state.Init();
+}
+
+void PaxosProposer::SetPaxosID(uint64_t paxosID_)
+{
+	Stop();
+	paxosID = paxosID_;
+	state.Init();
+	fastPaxosID = 0;
+}
+
 void PaxosProposer::StopPreparing()
 {
 	Log_Trace();
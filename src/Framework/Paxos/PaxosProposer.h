@@ -15,22 +15,34 @@ friend class ReplicatedLog;
 typedef TransportTCPWriter**	Writers;
 typedef MFunc<PaxosProposer>	Func;
 typedef PaxosProposerState		State;
+typedef PaxosProposerAhead		Ahead;
 
 public:
 	PaxosProposer();
+	~PaxosProposer();
 
-	void		Init(TransportTCPWriter** writers_);
+	void		Init(TransportTCPWriter** writers_, unsigned windowSize_);
 		
 	void		OnPrepareTimeout();
 	void		OnProposeTimeout();
 	bool		IsActive();	
 	bool		Propose(ByteString& value);
+	bool		ProposeAhead(uint64_t paxosID_, ByteString& value);
 	void		Stop();
 
 protected:
+	void		Broadcast();
 	void		BroadcastMessage();
 	void		OnPrepareResponse(PaxosMsg& msg_);
 	void		OnProposeResponse(PaxosMsg& msg_);
+	void		OnProposeAheadResponse(PaxosMsg& msg_);
+	bool		IsAhead(uint64_t paxosID_);
+	bool		IsProposingAhead();
+	bool		GetAheadValue(uint64_t paxosID_, uint64_t proposalID,
+							  ByteString& value);
+	void		ContinueAhead(Ahead* round);
+	void		NewPaxosRound();
+	void		SetPaxosID(uint64_t paxosID_);
 	void		StopPreparing();
 	void		StopProposing();
 	void		StartPreparing();
@@ -49,6 +61,10 @@ protected:
 	unsigned	numReceived;
 	unsigned	numAccepted;
 	unsigned	numRejected;
+// the rounds proposed ahead of paxosID
+	uint64_t	fastPaxosID;	// proposal 0 is used from here on
+	unsigned	windowSize;
+	Ahead*		ahead;
 };
 
 #endif
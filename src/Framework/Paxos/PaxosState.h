@@ -69,4 +69,59 @@ public:
 	ByteBuffer	value;
 };
 
+// the rounds after the current one, see rlog.appendQueueDepth; a slot
+// holds the round paxosID % appendQueueDepth
+
+class PaxosProposerAhead
+{
+public:
+	void Init()
+	{
+		paxosID = 0;
+		proposed = false;
+		proposing = false;
+		numReceived = 0;
+		numAccepted = 0;
+		value.Init();
+	}
+
+public:
+	uint64_t	paxosID;
+	bool		proposed;
+	bool		proposing;
+	unsigned	numReceived;
+	unsigned	numAccepted;
+	ByteString	value;		// points into the LogQueue
+};
+
+class PaxosAcceptorAhead
+{
+public:
+	void Init()
+	{
+		paxosID = 0;
+		written = false;
+		state.Init();
+	}
+
+public:
+	uint64_t			paxosID;
+	bool				written;	// has a record in the database
+	PaxosAcceptorState	state;
+};
+
+class PaxosLearnerAhead
+{
+public:
+	void Init()
+	{
+		paxosID = 0;
+		state.Init();
+	}
+
+public:
+	uint64_t			paxosID;
+	PaxosLearnerState	state;
+};
+
 #endif
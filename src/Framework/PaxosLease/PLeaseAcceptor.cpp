@@ -25,7 +25,7 @@ void PLeaseAcceptor::Init(Writers writers_)
 
 void PLeaseAcceptor::SendReply(unsigned nodeID)
 {
-	msg.Write(wdata);
+	msg.Write(wdata, writers[nodeID]->IsBinary());
 
 	writers[nodeID]->Write(wdata);
 }
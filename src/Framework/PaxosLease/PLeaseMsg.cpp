@@ -1,4 +1,5 @@
 #include "PLeaseMsg.h"
+#include "System/Binary.h"
 
 void PLeaseMsg::Init(char type_, unsigned nodeID_)
 {
@@ -114,6 +115,9 @@ bool PLeaseMsg::Read(const ByteString& data)
 	if (data.length < 1)
 		return false;
 	
+	if (data.buffer[0] == PLEASE_MSG_BINARY_V1)
+		return ReadBinary(data);
+	
 	switch (data.buffer[0])
 	{
 		case PLEASE_PREPARE_REQUEST:
@@ -201,3 +205,110 @@ bool PLeaseMsg::Write(ByteString& data)
 			return false;
 	}
 }
+
+bool PLeaseMsg::Write(ByteBuffer& data, bool binary)
+{
+	if (binary)
+		return WriteBinary(data);
+	
+	return Write(data);
+}
+
+// the binary format has the fields of the text format in the same
+// order, see System/Binary.h
+
+bool PLeaseMsg::ReadBinary(const ByteString& data)
+{
+	unsigned	pos;
+	bool		ret;
+	
+	if (data.length < 2)
+		return false;
+	
+	type = data.buffer[1];
+	pos = 2;
+	ret = ReadVarint(data, pos, nodeID);
+	
+	switch (type)
+	{
+		case PLEASE_PREPARE_REQUEST:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadVarint(data, pos, paxosID);
+			break;
+		case PLEASE_PREPARE_REJECTED:
+		case PLEASE_PREPARE_CURRENTLY_OPEN:
+		case PLEASE_PROPOSE_REJECTED:
+		case PLEASE_PROPOSE_ACCEPTED:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			break;
+		case PLEASE_PREPARE_PREVIOUSLY_ACCEPTED:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadVarint(data, pos, acceptedProposalID);
+			ret = ret && ReadVarint(data, pos, leaseOwner);
+			ret = ret && ReadVarint(data, pos, duration);
+			break;
+		case PLEASE_PROPOSE_REQUEST:
+			ret = ret && ReadVarint(data, pos, proposalID);
+			ret = ret && ReadVarint(data, pos, leaseOwner);
+			ret = ret && ReadVarint(data, pos, duration);
+			break;
+		case PLEASE_LEARN_CHOSEN:
+			ret = ret && ReadVarint(data, pos, leaseOwner);
+			ret = ret && ReadVarint(data, pos, duration);
+			ret = ret && ReadVarint(data, pos, localExpireTime);
+			break;
+		default:
+			return false;
+	}
+	
+	return (ret && pos == data.length);
+}
+
+bool PLeaseMsg::WriteBinary(ByteBuffer& data)
+{
+	unsigned	size;
+	bool		ret;
+	
+	size = 2 + 5 * VARINT_MAX_LENGTH;
+	if (data.size < size && !data.Reallocate(size))
+		return false;
+	
+	data.buffer[0] = PLEASE_MSG_BINARY_V1;
+	data.buffer[1] = type;
+	data.length = 2;
+	ret = WriteVarint(data, nodeID);
+	
+	switch (type)
+	{
+		case PLEASE_PREPARE_REQUEST:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteVarint(data, paxosID);
+			break;
+		case PLEASE_PREPARE_REJECTED:
+		case PLEASE_PREPARE_CURRENTLY_OPEN:
+		case PLEASE_PROPOSE_REJECTED:
+		case PLEASE_PROPOSE_ACCEPTED:
+			ret = ret && WriteVarint(data, proposalID);
+			break;
+		case PLEASE_PREPARE_PREVIOUSLY_ACCEPTED:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteVarint(data, acceptedProposalID);
+			ret = ret && WriteVarint(data, leaseOwner);
+			ret = ret && WriteVarint(data, duration);
+			break;
+		case PLEASE_PROPOSE_REQUEST:
+			ret = ret && WriteVarint(data, proposalID);
+			ret = ret && WriteVarint(data, leaseOwner);
+			ret = ret && WriteVarint(data, duration);
+			break;
+		case PLEASE_LEARN_CHOSEN:
+			ret = ret && WriteVarint(data, leaseOwner);
+			ret = ret && WriteVarint(data, duration);
+			ret = ret && WriteVarint(data, localExpireTime);
+			break;
+		default:
+			return false;
+	}
+	
+	return ret;
+}
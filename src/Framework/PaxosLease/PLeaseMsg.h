@@ -12,6 +12,9 @@
 #define PLEASE_PROPOSE_ACCEPTED				'7'
 #define PLEASE_LEARN_CHOSEN					'8'
 
+// first byte of a binary message, text messages start with the type
+#define PLEASE_MSG_BINARY_V1				1
+
 class PLeaseMsg
 {
 public:
@@ -50,6 +53,11 @@ public:
 	
 	bool			Read(const ByteString& data);
 	bool			Write(ByteString& data);	
+	bool			Write(ByteBuffer& data, bool binary);
+
+private:
+	bool			ReadBinary(const ByteString& data);
+	bool			WriteBinary(ByteBuffer& data);
 };
 
 #endif
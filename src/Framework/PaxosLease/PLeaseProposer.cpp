@@ -70,7 +70,8 @@ void PLeaseProposer::BroadcastMessage()
 	numAccepted = 0;
 	numRejected = 0;
 	
-	msg.Write(wdata);
+	msg.Write(wdata,
+			  TransportTCPWriter::IsBinary(writers, RCONF->GetNumNodes()));
 	
 	for (nodeID = 0; nodeID < RCONF->GetNumNodes(); nodeID++)
 		writers[nodeID]->Write(wdata);
@@ -3,6 +3,7 @@
 #include "System/Common.h"
 #include "Framework/Transport/TransportUDPReader.h"
 #include "Framework/Transport/TransportUDPWriter.h"
+#include "System/Config.h"
 
 PaxosLease::PaxosLease() :
 onRead(this, &PaxosLease::OnRead),
@@ -52,6 +53,7 @@ void PaxosLease::InitTransport()
 	reader->Stop();
 	EventLoop::Reset(&startupTimeout);
 	reader->SetOnRead(&onRead);
+	reader->SetBinary(Config::GetBoolValue("rlog.binaryMessages", false));
 	
 	writers = (Writers)
 		Alloc(sizeof(TransportTCPWriter*) * RCONF->GetNumNodes());
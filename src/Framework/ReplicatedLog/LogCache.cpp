@@ -49,17 +49,29 @@ void LogCache::DeleteOldRounds(uint64_t paxosID)
 
 LogCache::LogCache()
 {
+	rounds = NULL;
+	numRounds = 0;
+	lastPushed = 0;
+	nextPersisted = 0;
+	hasPushed = false;
 }
 
 LogCache::~LogCache()
 {
+	delete[] rounds;
 }
 
 bool LogCache::Init(uint64_t paxosID)
 {
-	table = database.GetTable("keyspace");
+	table = database.GetTable("logcache");
 	
 	logCacheSize = Config::GetIntValue("rlog.cacheSize", LOGCACHE_DEFAULT_SIZE);
+	
+	// a batch is half the ring, so the rounds not yet written are
+	// never overwritten
+	numRounds = MAX(2, Config::GetIntValue("rlog.memoryCacheSize",
+										   LOGCACHE_DEFAULT_MEMORY_SIZE));
+	rounds = new Round[numRounds];
 
 	if ((int64_t)(paxosID - logCacheSize) >= 0)
 		DeleteOldRounds(paxosID - logCacheSize);
@@ -67,11 +79,28 @@ bool LogCache::Init(uint64_t paxosID)
 	return true;
 }
 
-bool LogCache::Push(uint64_t paxosID, ByteString value, bool commit)
+void LogCache::Shutdown()
 {
-	ByteArray<128> buf;
 	Transaction* transaction;
 	
+	if (!hasPushed || nextPersisted > lastPushed)
+		return;
+	
+	// an active transaction belongs to a round still being applied
+	transaction = RLOG->GetTransaction();
+	if (transaction->IsActive())
+		return;
+	
+	transaction->Begin();
+	Persist(transaction, lastPushed);
+	transaction->Commit();
+}
+
+bool LogCache::Push(uint64_t paxosID, ByteString value, bool commit)
+{
+	Transaction*	transaction;
+	Round*			round;
+	
 	Log_Trace("Storing paxosID %" PRIu64 " with length %d", paxosID, value.length);
 	
 	transaction = RLOG->GetTransaction();
@@ -79,16 +108,27 @@ bool LogCache::Push(uint64_t paxosID, ByteString value, bool commit)
 	if (!transaction->IsActive())
 		transaction->Begin();
 	
-	WriteRoundID(buf, paxosID);
-	table->Set(transaction, buf, value);
-	
-	// delete old
-	if ((int64_t)(paxosID - logCacheSize) >= 0)
+	// after a catchup the rounds in memory are not contiguous with
+	// this one, so they are written first
+	if (hasPushed && paxosID != lastPushed + 1)
 	{
-		paxosID -= logCacheSize;
-		WriteRoundID(buf, paxosID);
-		table->Delete(transaction, buf);
+		if (nextPersisted <= lastPushed)
+			Persist(transaction, lastPushed);
+		hasPushed = false;
 	}
+	if (!hasPushed)
+		nextPersisted = paxosID;
+	
+	round = &rounds[paxosID % numRounds];
+	if (!round->value.Set(value))
+		ASSERT_FAIL();
+	round->paxosID = paxosID;
+	round->used = true;
+	lastPushed = paxosID;
+	hasPushed = true;
+	
+	if (paxosID + 1 - nextPersisted >= numRounds / 2)
+		Persist(transaction, paxosID);
 	
 	if (commit)
 		transaction->Commit();
@@ -96,9 +136,49 @@ bool LogCache::Push(uint64_t paxosID, ByteString value, bool commit)
 	return true;
 }
 
+// writes the rounds from nextPersisted up to paxosID to the database
+void LogCache::Persist(Transaction* transaction, uint64_t paxosID)
+{
+	ByteArray<128>	buf;
+	Round*			round;
+	uint64_t		id;
+	
+	Log_Trace("Writing paxosID %" PRIu64 " to %" PRIu64, nextPersisted, paxosID);
+	
+	for (id = nextPersisted; id <= paxosID; id++)
+	{
+		round = &rounds[id % numRounds];
+		if (!round->used || round->paxosID != id)
+			ASSERT_FAIL();
+		
+		WriteRoundID(buf, id);
+		table->Set(transaction, buf, round->value);
+		
+		// delete old
+		if ((int64_t)(id - logCacheSize) >= 0)
+		{
+			WriteRoundID(buf, id - logCacheSize);
+			table->Delete(transaction, buf);
+		}
+	}
+	
+	nextPersisted = paxosID + 1;
+}
+
 bool LogCache::Get(uint64_t paxosID, ByteString& value_)
 {
-	ByteArray<128> buf;
+	ByteArray<128>	buf;
+	Round*			round;
+	
+	if (numRounds > 0)
+	{
+		round = &rounds[paxosID % numRounds];
+		if (round->used && round->paxosID == paxosID)
+		{
+			value_.Set(round->value);
+			return true;
+		}
+	}
 
 	WriteRoundID(buf, paxosID);
 	if (table->Get(NULL, buf, value))
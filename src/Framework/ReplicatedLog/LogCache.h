@@ -3,9 +3,18 @@
 
 #include "System/Buffer.h"
 #include "Framework/Database/Table.h"
+#include "Framework/Database/Transaction.h"
 #include "Framework/Paxos/PaxosConsts.h"
 
 #define LOGCACHE_DEFAULT_SIZE	(100*1000)	// # of Paxos rounds cached in db
+#define LOGCACHE_DEFAULT_MEMORY_SIZE	100	// # of Paxos rounds cached in memory
+
+/*
+ * The most recent rounds are kept in a ring in memory, lagging nodes
+ * are served from it. They are written to the database in batches of
+ * half the ring, so at most that many are lost from the cache when
+ * the node is killed.
+ */
 
 class LogCache
 {
@@ -14,15 +23,31 @@ public:
 	~LogCache();
 
 	bool			Init(uint64_t paxosID);
+	void			Shutdown();
 	bool			Push(uint64_t paxosID, ByteString value, bool commit);
 	bool			Get(uint64_t paxosID, ByteString& value);
 
 private:
+	struct Round
+	{
+		Round() { paxosID = 0; used = false; }
+
+		uint64_t	paxosID;
+		bool		used;
+		ByteBuffer	value;
+	};
+
 	void			DeleteOldRounds(uint64_t paxosID);
+	void			Persist(Transaction* transaction, uint64_t paxosID);
 
 	Table*			table;
 	ByteArray<RLOG_SIZE> value;
 	uint64_t		logCacheSize;
+	Round*			rounds;
+	unsigned		numRounds;
+	uint64_t		lastPushed;
+	uint64_t		nextPersisted;	// rounds from this on are only in memory
+	bool			hasPushed;
 };
 
 #endif
@@ -15,10 +15,18 @@ LogQueue::~LogQueue()
 
 bool LogQueue::Push(ByteString& value)
 {
-	ByteString* bs = new ByteString();
+	ByteBuffer* buf = new ByteBuffer();
+	ByteString* bs;
 
-	bs->Set(value);
+	// the queue may hold several rounds, so it cannot point
+	// into the caller's buffer
+	if (!buf->Set(value))
+	{
+		delete buf;
+		return false;
+	}
 
+	bs = buf;
 	queue.Add(bs);
 	
 	return true;
@@ -54,9 +62,24 @@ ByteString* LogQueue::Pop()
 	return bs;
 }
 
+// the values are added at the head, the oldest one is the tail
+
+ByteString** LogQueue::Oldest()
+{
+	return queue.Tail();
+}
+
+ByteString** LogQueue::Newer(ByteString** it)
+{
+	return queue.Prev(it);
+}
+
 void LogQueue::Clear()
 {
-	queue.Clear();
+	ByteString*	bs;
+	
+	while ((bs = Pop()) != NULL)
+		delete bs;
 }
 
 int LogQueue::Length()
@@ -12,6 +12,8 @@ public:
 	bool				Push(ByteString& value);
 	ByteString*			Next();
 	ByteString*			Pop();
+	ByteString**		Oldest();
+	ByteString**		Newer(ByteString** it);
 	void				Clear();
 	int					Length();
 	
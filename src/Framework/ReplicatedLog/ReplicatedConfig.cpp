@@ -51,7 +51,7 @@ void ReplicatedConfig::InitRestartCounter()
 	ByteArray<32>	buf;
 	Table*			table;
 	
-	table = database.GetTable("keyspace");
+	table = database.GetTable("meta");
 	if (table == NULL)
 	{
 		restartCounter = 0;
@@ -15,6 +15,7 @@ public:
 						  ByteString value, bool ownAppend) = 0;					
 	virtual void OnMasterLease() = 0;
 	virtual void OnMasterLeaseExpired() = 0;
+	virtual void OnQueueCleared() = 0;
 	virtual void OnDoCatchup(unsigned nodeID) = 0;
 
 	virtual bool IsCatchingUp() = 0;
@@ -5,6 +5,7 @@
 #include "Framework/Transport/TransportTCPWriter.h"
 #include "Framework/Transport/TransportUDPReader.h"
 #include "Framework/Transport/TransportUDPWriter.h"
+#include "System/Config.h"
 #include <stdlib.h>
 
 ReplicatedLog* replicatedLog = NULL;
@@ -31,12 +32,21 @@ bool ReplicatedLog::Init(bool useSoftClock)
 	Log_Trace();
 	
 	replicatedDB = NULL;
+	paused = false;
+	stopRequested = false;
+	hasDeferred = false;
 	
 	InitTransport();
+	
+	// the rounds after the current one are accepted and learned
+	// ahead within the same window on every node
+	appendQueueDepth = MAX(1, Config::GetIntValue("rlog.appendQueueDepth",
+												  RLOG_DEFAULT_APPEND_QUEUE_DEPTH));
+	appendQueueDepth = MIN(appendQueueDepth, RLOG_MAX_APPEND_QUEUE_DEPTH);
 
-	proposer.Init(writers);
-	acceptor.Init(writers);
-	learner.Init(writers);
+	proposer.Init(writers, appendQueueDepth);
+	acceptor.Init(writers, appendQueueDepth);
+	learner.Init(writers, appendQueueDepth);
 	
 	highestPaxosID = 0;
 	lastStarted = EventLoop::Now();
@@ -67,6 +77,7 @@ void ReplicatedLog::InitTransport()
 	if (!reader->Init(RCONF->GetPort()))
 		STOP_FAIL("cannot bind Paxos port", 1);
 	reader->SetOnRead(&onRead);
+	reader->SetBinary(Config::GetBoolValue("rlog.binaryMessages", false));
 
 	writers =
 			(TransportTCPWriter**)
@@ -85,6 +96,7 @@ void ReplicatedLog::InitTransport()
 
 void ReplicatedLog::Shutdown()
 {
+	logCache.Shutdown();
 	masterLease.Shutdown();
 	acceptor.Shutdown();
 
@@ -104,9 +116,20 @@ void ReplicatedLog::StopPaxos()
 {
 	Log_Trace();
 	
+	stopRequested = true;
 	reader->Stop();
 }
 
+void ReplicatedLog::PausePaxos()
+{
+	Log_Trace();
+	
+	// unlike StopPaxos() the reader keeps running: messages that only
+	// drive the proposer and the acceptor of the next round are
+	// processed, the first one that needs the database is deferred
+	paused = true;
+}
+
 void ReplicatedLog::StopMasterLease()
 {
 	masterLease.Stop();
@@ -116,9 +139,37 @@ void ReplicatedLog::ContinuePaxos()
 {
 	Log_Trace();
 	
+	// a round learned ahead is applied before the next message
+	if (!paused && !acceptor.IsWriting() && learner.Learned())
+	{
+		stopRequested = false;
+		ProcessLearned(pmsg.nodeID);
+		if (paused || stopRequested)
+			return;
+	}
+	
+	if (hasDeferred)
+	{
+		ProcessDeferred();
+		return;
+	}
+	
 	reader->Continue();
 }
 
+void ReplicatedLog::ResumePaxos()
+{
+	Log_Trace();
+	
+	paused = false;
+	
+	// the acceptor continues when its write completes
+	if (acceptor.IsWriting())
+		return;
+	
+	ContinuePaxos();
+}
+
 void ReplicatedLog::ContinueMasterLease()
 {
 	masterLease.Continue();
@@ -139,31 +190,30 @@ bool ReplicatedLog::Append(ByteString &value_)
 {
 	Log_Trace();
 	
-	if (!logQueue.Push(value_))
+	// queued as it is proposed, a round proposed ahead is proposed
+	// again with the same bytes when it is the current one
+	if (!rmsg.Init(RCONF->GetNodeID(),
+				   RCONF->GetRestartCounter(),
+				   masterLease.GetLeaseEpoch(), value_))
+	{	
+		ASSERT_FAIL();
+		return false;
+	}
+	
+	if (!rmsg.Write(value, IsBinaryValue()))
 	{
 		ASSERT_FAIL();
 		return false;
 	}
 	
-	if (!proposer.IsActive())
+	if (!logQueue.Push(value))
 	{
-		if (!rmsg.Init(RCONF->GetNodeID(),
-					   RCONF->GetRestartCounter(),
-					   masterLease.GetLeaseEpoch(), *logQueue.Next()))
-		{	
-			ASSERT_FAIL();
-			return false;
-		}
-		
-		if (!rmsg.Write(value))
-		{
-			ASSERT_FAIL();
-			return false;
-		}
-		
-		return proposer.Propose(value);
+		ASSERT_FAIL();
+		return false;
 	}
 	
+	ProposeQueued();
+	
 	return true;
 }
 
@@ -179,17 +229,17 @@ uint64_t ReplicatedLog::GetPaxosID()
 
 void ReplicatedLog::SetPaxosID(Transaction* transaction, uint64_t paxosID)
 {
-	EventLoop::Remove(&(proposer.prepareTimeout));
-	EventLoop::Remove(&(proposer.proposeTimeout));
-	proposer.paxosID = paxosID;
-	proposer.state.Init();
+	proposer.SetPaxosID(paxosID);
 
-	acceptor.paxosID = paxosID;
-	acceptor.state.Init();
+	acceptor.SetPaxosID(paxosID);
 	acceptor.Persist(transaction);
 
-	learner.paxosID = paxosID;
-	learner.state.Init();
+	learner.SetPaxosID(paxosID);
+}
+
+bool ReplicatedLog::GetCachedValue(uint64_t paxosID, ByteString& value)
+{
+	return logCache.Get(paxosID, value);
 }
 
 bool ReplicatedLog::IsMaster()
@@ -222,9 +272,65 @@ void ReplicatedLog::OnRead()
 	
 	Log_Trace("Received paxos msg: %.*s", bs.length, bs.buffer);
 	
+	if (paused && !IsProcessableWhilePaused())
+	{
+		Log_Trace("deferring paxos msg until the apply completes");
+		deferred.Set(bs);
+		hasDeferred = true;
+		reader->Stop();
+		return;
+	}
+	
 	ProcessMsg();
 }
 
+bool ReplicatedLog::IsProcessableWhilePaused()
+{
+	// the proposer does not touch the database
+	if (pmsg.IsPrepareResponse() || pmsg.IsProposeResponse())
+		return true;
+	
+	// the acceptor's writes go to dbWriter, after the apply
+	if ((pmsg.type == PAXOS_PREPARE_REQUEST ||
+		 pmsg.type == PAXOS_PROPOSE_REQUEST) &&
+		 pmsg.paxosID == acceptor.paxosID)
+		return true;
+	
+	if (pmsg.type == PAXOS_PROPOSE_REQUEST && acceptor.IsAhead(pmsg.paxosID))
+		return true;
+	
+	// the rounds learned ahead are only kept
+	if (pmsg.IsLearn() && learner.IsAhead(pmsg.paxosID))
+		return true;
+	
+	return false;
+}
+
+bool ReplicatedLog::IsBinaryValue()
+{
+	// values are stored and passed on by every node, so they are
+	// only written in binary once all of them read it
+	return TransportTCPWriter::IsAllBinary(writers, RCONF->GetNumNodes());
+}
+
+void ReplicatedLog::ProcessDeferred()
+{
+	ByteString bs;
+	
+	if (paused || acceptor.IsWriting())
+		return;
+	
+	hasDeferred = false;
+	bs.Set(deferred);
+	pmsg.Read(bs);
+	
+	stopRequested = false;
+	ProcessMsg();
+	
+	if (!stopRequested)
+		reader->Continue();
+}
+
 void ReplicatedLog::ProcessMsg()
 {
 	if (pmsg.paxosID > highestPaxosID)
@@ -270,7 +376,7 @@ void ReplicatedLog::OnProposeRequest()
 {
 	Log_Trace();
 	
-	if (pmsg.paxosID == acceptor.paxosID)
+	if (pmsg.paxosID == acceptor.paxosID || acceptor.IsAhead(pmsg.paxosID))
 		return acceptor.OnProposeRequest(pmsg);
 	
 	OnRequest();
@@ -282,18 +388,19 @@ void ReplicatedLog::OnProposeResponse()
 
 	if (pmsg.paxosID == proposer.paxosID)
 		proposer.OnProposeResponse(pmsg);
+	else if (proposer.IsAhead(pmsg.paxosID))
+		proposer.OnProposeAheadResponse(pmsg);
 }
 
 void ReplicatedLog::OnLearnChosen()
 {
 	Log_Trace();
 
-	uint64_t	paxosID;
-	bool		ownAppend, clientAppend, commit;
-    ByteString* bs;
-
 	if (pmsg.paxosID > learner.paxosID)
 	{
+		if (learner.IsAhead(pmsg.paxosID))
+			return OnLearnAhead();
+		
 		//	I am lagging and need to catch-up
 		learner.RequestChosen(pmsg.nodeID);
 		return;
@@ -316,6 +423,44 @@ void ReplicatedLog::OnLearnChosen()
 		return;
 	}
 	
+	ProcessLearned(pmsg.nodeID);
+}
+
+void ReplicatedLog::OnLearnAhead()
+{
+	ByteString value_;
+	
+	Log_Trace();
+	
+	// kept by the learner until the rounds before it are learned; if
+	// the value is not here the round is requested when it is the
+	// current one
+	if (pmsg.type == PAXOS_LEARN_PROPOSAL &&
+		(acceptor.GetAheadValue(pmsg.paxosID, pmsg.proposalID, value_) ||
+		 proposer.GetAheadValue(pmsg.paxosID, pmsg.proposalID, value_)))
+		pmsg.LearnValue(pmsg.paxosID, GetNodeID(), value_);
+	
+	if (pmsg.type == PAXOS_LEARN_VALUE)
+		learner.OnLearnChosen(pmsg);
+}
+
+void ReplicatedLog::ProcessLearned(unsigned nodeID)
+{
+	// the rounds learned ahead are applied in order, the apply of
+	// each one pauses or stops Paxos until ContinuePaxos()
+	while (learner.Learned())
+	{
+		if (OnLearned(nodeID))
+			return;
+	}
+}
+
+bool ReplicatedLog::OnLearned(unsigned nodeID)
+{
+	uint64_t	paxosID;
+	bool		ownAppend, clientAppend, commit, queued;
+    ByteString* bs;
+
 	// save it in the logCache (includes the epoch info)
 	commit = learner.paxosID == (highestPaxosID - 1);
 	logCache.Push(learner.paxosID, learner.state.value, commit);
@@ -324,11 +469,16 @@ void ReplicatedLog::OnLearnChosen()
 	paxosID = learner.paxosID;		// this is the value we
 									// pass to the ReplicatedDB
 	
+	// the rounds may be chosen in another order than they were queued
+	queued = logQueue.Next() != NULL &&
+			 *logQueue.Next() == learner.state.value;
+	
 	NewPaxosRound();
 	// increments paxosID, clears proposer, acceptor, learner
 	
-	if (highestPaxosID > paxosID)
-		learner.RequestChosen(pmsg.nodeID);
+	// the rounds within the window are on their way
+	if (!learner.Learned() && highestPaxosID > paxosID + appendQueueDepth - 1)
+		learner.RequestChosen(nodeID);
 
 	Log_Trace("%d %d %" PRIu64 " %" PRIu64 "",
 		rmsg.nodeID, GetNodeID(),
@@ -337,11 +487,13 @@ void ReplicatedLog::OnLearnChosen()
 	if (rmsg.nodeID == GetNodeID()
 	 && rmsg.restartCounter == RCONF->GetRestartCounter()
 	 && rmsg.leaseEpoch == masterLease.GetLeaseEpoch()
-	 && IsMaster())
+	 && IsMaster() && queued)
 	{
 		bs = logQueue.Pop(); // we just appended this
         delete bs;
 		proposer.state.leader = true;
+		if (proposer.fastPaxosID == 0)
+			proposer.fastPaxosID = paxosID + appendQueueDepth;
 		ownAppend = true;
 		Log_Trace("Multi paxos enabled");
 		
@@ -352,8 +504,14 @@ void ReplicatedLog::OnLearnChosen()
 	else
 	{
 		proposer.state.leader = false;
+		proposer.fastPaxosID = 0;
 		ownAppend = false;
 		Log_Trace("Multi paxos disabled");
+		
+		// a round proposed ahead may still be chosen, after this one
+		// and before the ones queued in front of it
+		if (proposer.IsProposingAhead())
+			ClearQueue();
 	}
 	
 	if (!GetTransaction()->IsActive())
@@ -370,28 +528,57 @@ void ReplicatedLog::OnLearnChosen()
 		
 		replicatedDB->OnAppend(GetTransaction(), paxosID, 
 							   rmsg.value, clientAppend);
+		ProposeQueued();
+		return true;
 	}
 
-	if (!proposer.IsActive() && logQueue.Length() > 0)
+	ProposeQueued();
+	return false;
+}
+
+void ReplicatedLog::ProposeQueued()
+{
+	ByteString**	it;
+	uint64_t		paxosID;
+	
+	it = logQueue.Oldest();
+	if (it == NULL)
+		return;
+	
+	// the oldest value goes to the current round, unless that is
+	// learned already
+	if (!proposer.IsActive() && !learner.Learned())
+		proposer.Propose(**it);
+	
+	// the leader proposes the rest ahead, one round each
+	paxosID = proposer.paxosID;
+	for (it = logQueue.Newer(it); it != NULL; it = logQueue.Newer(it))
 	{
-		if (!rmsg.Init(RCONF->GetNodeID(), RCONF->GetRestartCounter(),
-		masterLease.GetLeaseEpoch(), *(logQueue.Next())))
-			ASSERT_FAIL();
-		
-		if (!rmsg.Write(value))
-			ASSERT_FAIL();
-		
-		proposer.Propose(value);
+		paxosID++;
+		if (!proposer.IsAhead(paxosID))
+			break;
+		proposer.ProposeAhead(paxosID, **it);
 	}
 }
 
+void ReplicatedLog::ClearQueue()
+{
+	Log_Message("Rounds of another node were chosen, "
+				"the queued rounds are dropped");
+	
+	logQueue.Clear();
+	proposer.Stop();
+	if (replicatedDB)
+		replicatedDB->OnQueueCleared();
+}
+
 void ReplicatedLog::OnRequestChosen()
 {
 	Log_Trace();
 
 	ByteString value_;
 	
-	if (pmsg.paxosID == learner.paxosID)
+	if (pmsg.paxosID == learner.paxosID || learner.IsAhead(pmsg.paxosID))
 		return learner.OnRequestChosen(pmsg);
 	
 	// same as OnRequest but with the learner's message
@@ -454,16 +641,9 @@ void ReplicatedLog::NewPaxosRound()
 	thruput = (uint64_t)(lastLength / (lastTook / 1000.0));
 	lastStarted = now;
 	
-	EventLoop::Remove(&(proposer.prepareTimeout));
-	EventLoop::Remove(&(proposer.proposeTimeout));
-	proposer.paxosID++;
-	proposer.state.Init();
-
-	acceptor.paxosID++;
-	acceptor.state.Init();
-
-	learner.paxosID++;
-	learner.state.Init();
+	proposer.NewPaxosRound();
+	acceptor.NewPaxosRound();
+	learner.NewPaxosRound();
 	
 	masterLease.OnNewPaxosRound();
 }
@@ -485,6 +665,7 @@ void ReplicatedLog::OnLearnLease()
 void ReplicatedLog::OnLeaseTimeout()
 {
 	proposer.state.leader = false;
+	proposer.fastPaxosID = 0;
 	
 	if (replicatedDB)
 	{
@@ -499,6 +680,25 @@ bool ReplicatedLog::IsAppending()
 	return IsMaster() && proposer.state.numProposals > 0;
 }
 
+bool ReplicatedLog::CanAppend()
+{
+	if (!IsMaster())
+		return false;
+	
+	if (appendQueueDepth <= 1)
+		return !IsAppending();
+	
+	// the rounds queued behind the current one are proposed ahead of
+	// it, the acceptors accept them in any order and the learners
+	// apply them in order
+	return logQueue.Length() < (int) appendQueueDepth;
+}
+
+unsigned ReplicatedLog::GetNumPending()
+{
+	return logQueue.Length();
+}
+
 Transaction* ReplicatedLog::GetTransaction()
 {
 	return &acceptor.transaction;
@@ -16,6 +16,9 @@
 
 #define CATCHUP_TIMEOUT	5000
 
+#define RLOG_DEFAULT_APPEND_QUEUE_DEPTH	1	// # of rounds the master may queue
+#define RLOG_MAX_APPEND_QUEUE_DEPTH		64
+
 #define	RLOG (ReplicatedLog::Get())
 
 class ReplicatedLog
@@ -36,17 +39,22 @@ public:
 	Transaction*		GetTransaction();
 	uint64_t			GetPaxosID();
 	void				SetPaxosID(Transaction* transaction, uint64_t paxosID);
+	bool				GetCachedValue(uint64_t paxosID, ByteString& value);
 	bool				IsMaster();
 	int					GetMaster();
 	unsigned			GetNumNodes();
 	unsigned 			GetNodeID();
 	void				StopPaxos();
+	void				PausePaxos();
 	void				StopMasterLease();
 	void				ContinuePaxos();
+	void				ResumePaxos();
 	void				ContinueMasterLease();
 	bool				IsPaxosActive();
 	bool				IsMasterLeaseActive();
 	bool				IsAppending();
+	bool				CanAppend();
+	unsigned			GetNumPending();
 	bool				IsSafeDB();
     bool                IsWriting() { return acceptor.IsWriting(); }
 	void				OnPaxosLeaseMsg(uint64_t paxosID, unsigned nodeID);
@@ -59,11 +67,19 @@ private:
 
 	void				InitTransport();
 	void				ProcessMsg();
+	bool				IsProcessableWhilePaused();
+	bool				IsBinaryValue();
+	void				ProcessDeferred();
 	void				OnPrepareRequest();
 	void				OnPrepareResponse();
 	void				OnProposeRequest();
 	void				OnProposeResponse();
 	void				OnLearnChosen();
+	void				OnLearnAhead();
+	void				ProcessLearned(unsigned nodeID);
+	bool				OnLearned(unsigned nodeID);
+	void				ProposeQueued();
+	void				ClearQueue();
 	void				OnRequestChosen();
 	void				OnStartCatchup();
 	void				OnRequest();
@@ -84,6 +100,11 @@ private:
 	uint64_t			highestPaxosID;
 	LogCache			logCache;
 	LogQueue			logQueue;
+	unsigned			appendQueueDepth;
+	bool				paused;
+	bool				stopRequested;
+	bool				hasDeferred;
+	ByteBuffer			deferred;
 	Func				onLearnLease;
 	Func				onLeaseTimeout;
 	ReplicatedDB*		replicatedDB;
@@ -1,4 +1,5 @@
 #include "ReplicatedLogMsg.h"
+#include "System/Binary.h"
 
 bool ReplicatedLogMsg::Init(unsigned nodeID_, uint64_t restartCounter_,
 	uint64_t leaseEpoch_, ByteString& value_)
@@ -15,6 +16,9 @@ bool ReplicatedLogMsg::Read(const ByteString& data)
 {
 	int read;
 	
+	if (data.length > 0 && data.buffer[0] == RLOG_MSG_BINARY_V1)
+		return ReadBinary(data);
+	
 	read = snreadf(data.buffer, data.size, "%u:%U:%U:%N",
 				   &nodeID, &restartCounter, &leaseEpoch, &value);
 	
@@ -26,3 +30,44 @@ bool ReplicatedLogMsg::Write(ByteString& data)
 	return data.Writef("%u:%U:%U:%M",
 					   nodeID, restartCounter, leaseEpoch, &value);
 }
+
+bool ReplicatedLogMsg::Write(ByteBuffer& data, bool binary)
+{
+	if (binary)
+		return WriteBinary(data);
+	
+	return Write(data);
+}
+
+bool ReplicatedLogMsg::ReadBinary(const ByteString& data)
+{
+	unsigned	pos;
+	bool		ret;
+	
+	pos = 1;
+	ret = ReadVarint(data, pos, nodeID);
+	ret = ret && ReadVarint(data, pos, restartCounter);
+	ret = ret && ReadVarint(data, pos, leaseEpoch);
+	ret = ret && ReadBytesNoCopy(data, pos, value);
+	
+	return (ret && pos == data.length);
+}
+
+bool ReplicatedLogMsg::WriteBinary(ByteBuffer& data)
+{
+	unsigned	size;
+	bool		ret;
+	
+	size = 1 + 4 * VARINT_MAX_LENGTH + value.length;
+	if (data.size < size && !data.Reallocate(size))
+		return false;
+	
+	data.buffer[0] = RLOG_MSG_BINARY_V1;
+	data.length = 1;
+	ret = WriteVarint(data, nodeID);
+	ret = ret && WriteVarint(data, restartCounter);
+	ret = ret && WriteVarint(data, leaseEpoch);
+	ret = ret && WriteBytes(data, value);
+	
+	return ret;
+}
@@ -5,6 +5,9 @@
 
 #define BS_MSG_NOP	ByteString(strlen("NOP"), strlen("NOP"), "NOP")
 
+// first byte of a binary message, text messages start with the nodeID
+#define RLOG_MSG_BINARY_V1	1
+
 class ReplicatedLogMsg
 {
 public:
@@ -18,6 +21,11 @@ public:
 		
 	bool		Read(const ByteString& data);
 	bool		Write(ByteString& data);
+	bool		Write(ByteBuffer& data, bool binary);
+
+private:
+	bool		ReadBinary(const ByteString& data);
+	bool		WriteBinary(ByteBuffer& data);
 };
 
 #endif
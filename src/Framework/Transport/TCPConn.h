@@ -7,6 +7,11 @@
 //
 //	Async tcp connection with automatic write queue management.
 //
+//	Queued data is a list of segments, each one either copied into
+//	the write buffers by Write() or referenced by WriteRef() until
+//	it is written, when OnRefReleased() gives the reference back.
+//	Up to TCP_MAX_SEGMENTS segments are written with one call.
+//
 //===================================================================
 
 #include "System/IO/IOOperation.h"
@@ -49,11 +54,22 @@ public:
 
 	void			AsyncRead(bool start = true);
 	void			Write(const char* data, int count, bool flush = true);
+	void			WriteRef(const char* data, int count, void* ref,
+					 bool flush = true);
 	
 protected:
 	typedef DynArray<bufSize> Buffer;
 	typedef Queue<Buffer, &Buffer::next> BufferQueue;
 
+	class Segment
+	{
+	public:
+		ByteString	data;
+		Buffer*		buffer;		// the write buffer holding the copied data
+		void*		ref;		// or the reference passed to WriteRef()
+		Segment*	next;
+	};
+	typedef Queue<Segment, &Segment::next> SegmentQueue;
 	
 	State			state;
 	Socket			socket;
@@ -61,6 +77,9 @@ protected:
 	TCPWrite		tcpwrite;
 	Buffer			readBuffer;
 	BufferQueue		writeQueue;
+	SegmentQueue	segments;
+	SegmentQueue	freeSegments;
+	ByteString		writing[TCP_MAX_SEGMENTS];
 	CdownTimer		connectTimeout;
 	
 	MFunc<TCPConn>	onRead;
@@ -74,9 +93,12 @@ protected:
 	virtual void	OnClose() = 0;
 	virtual void	OnConnect();
 	virtual void	OnConnectTimeout();
+	virtual void	OnRefReleased(void* /*ref*/) {}
 	
 	void			Append(const char* data, int count);
 	void			WritePending();
+	Segment*		NewSegment();
+	void			ReleaseSegment(Segment* segment);
 };
 
 
@@ -98,11 +120,20 @@ template<int bufSize>
 TCPConn<bufSize>::~TCPConn()
 {
 	Buffer* buf;
+	Segment* segment;
+
+	// the subclass is destroyed already, one passing references to
+	// WriteRef() has to close in its own destructor
+	for (segment = segments.Head(); segment != NULL; segment = segment->next)
+		assert(segment->ref == NULL);
+	
+	Close();
 
 	while ((buf = writeQueue.Get()) != NULL)
 		delete buf;
 	
-	Close();
+	while ((segment = freeSegments.Get()) != NULL)
+		delete segment;
 }
 
 
@@ -129,12 +160,12 @@ template<int bufSize>
 unsigned TCPConn<bufSize>::BytesQueued()
 {
 	unsigned bytes;
-	Buffer* buf;
+	Segment* segment;
 	
 	bytes = 0;
 	
-	for (buf = writeQueue.Head(); buf != NULL; buf = buf->next)
-		bytes += buf->length;
+	for (segment = segments.Head(); segment != NULL; segment = segment->next)
+		bytes += segment->data.length;
 	
 	return bytes;
 }
@@ -161,6 +192,7 @@ void TCPConn<bufSize>::Connect(Endpoint &endpoint_, unsigned timeout)
 	tcpwrite.onComplete = &onConnect;
 	// zero indicates for IOProcessor that we are waiting for connect event
 	tcpwrite.data.length = 0;
+	tcpwrite.segments = NULL;
 	
 	IOProcessor::Add(&tcpwrite);
 
@@ -176,25 +208,36 @@ void TCPConn<bufSize>::Connect(Endpoint &endpoint_, unsigned timeout)
 template<int bufSize>
 void TCPConn<bufSize>::OnWrite()
 {
-	Log_Trace("Written %d bytes", tcpwrite.data.length);
-	Log_Trace("Written: %.*s", tcpwrite.data.length, tcpwrite.data.buffer);
+	Log_Trace("Written %d bytes in %d segments",
+	 tcpwrite.data.length, tcpwrite.numSegments);
 
-	Buffer* buf;
+	Segment* segment;
+	int i;
+	
+	// Write() may have extended the last segment since it was passed to
+	// the kernel, in that case only its written part is dropped
+	for (i = 0; i < tcpwrite.numSegments; i++)
+	{
+		segment = segments.Head();
+		if (segment->data.length > writing[i].length)
+		{
+			segment->data.buffer += writing[i].length;
+			segment->data.length -= writing[i].length;
+			break;
+		}
+		
+		segments.Get();
+		ReleaseSegment(segment);
+	}
 	
-	buf = writeQueue.Get();
-	buf->Clear();
 	tcpwrite.data.Clear();
+	tcpwrite.segments = NULL;
+	tcpwrite.numSegments = 0;
 	
-	if (writeQueue.Size() == 0)
-	{
+	if (segments.Size() == 0)
 		Log_Trace("not posting write");
-		writeQueue.Append(buf);
-	}
 	else
-	{
-		delete buf;
 		WritePending();
-	}
 }
 
 template<int bufSize>
@@ -242,21 +285,59 @@ void TCPConn<bufSize>::Write(const char *data, int count, bool flush)
 		return;
 	
 	Buffer* buf;
+	Segment* segment;
 
 	if (data && count > 0)
 	{
 		buf = writeQueue.Tail();
 
-		if (!buf ||
-			(tcpwrite.active && writeQueue.Size() == 1) || 
-			(buf->length > 0 && buf->Remaining() < count))
+		// segments point into the buffers, so only an empty one may grow
+		if (!buf || (buf->length > 0 && buf->Remaining() < count))
 		{
 			buf = new Buffer;
 			writeQueue.Append(buf);
 		}
 
+		// data following the last segment extends it
+		segment = segments.Tail();
+		if (segment && (segment->buffer != buf ||
+			segment->data.buffer + segment->data.length != buf->buffer + buf->length))
+			segment = NULL;
+
 		buf->Append(data, count);
+
+		if (segment == NULL)
+		{
+			segment = NewSegment();
+			segment->data.buffer = buf->buffer + buf->length - count;
+			segment->buffer = buf;
+			segments.Append(segment);
+		}
+		segment->data.length += count;
+	}
+
+	if (flush)
+		WritePending();
+}
+
+template<int bufSize>
+void TCPConn<bufSize>::WriteRef(const char *data, int count, void* ref, bool flush)
+{
+	Segment* segment;
+
+	if (state == DISCONNECTED || count <= 0)
+	{
+		OnRefReleased(ref);
+		return;
 	}
+	
+	// the data is written from where it is, the caller keeps it until
+	// OnRefReleased() is called with 'ref'
+	segment = NewSegment();
+	segment->data.buffer = (char*) data;
+	segment->data.length = count;
+	segment->ref = ref;
+	segments.Append(segment);
 
 	if (flush)
 		WritePending();
@@ -271,27 +352,87 @@ void TCPConn<bufSize>::WritePending()
 		return;
 
 	
-	Buffer* buf;
+	Segment* segment;
+	unsigned length;
+	int num;
 	
 	if (tcpwrite.active)
 		return;
 	
-	buf = writeQueue.Head();
+	length = 0;
+	num = 0;
+	for (segment = segments.Head();
+	 segment != NULL && num < TCP_MAX_SEGMENTS;
+	 segment = segment->next)
+	{
+		writing[num].Set(segment->data);
+		length += segment->data.length;
+		num++;
+	}
 	
-	if (buf && buf->length > 0)
+	if (length > 0)
 	{
-		tcpwrite.data.Set(*buf);
+		// a single segment is written as a plain buffer
+		tcpwrite.data.Set(writing[0]);
+		tcpwrite.data.length = length;
+		tcpwrite.segments = num > 1 ? writing : NULL;
+		tcpwrite.numSegments = num;
 		tcpwrite.transferred = 0;
 		
 		IOProcessor::Add(&tcpwrite);
 	}	
 }
 
+template<int bufSize>
+typename TCPConn<bufSize>::Segment* TCPConn<bufSize>::NewSegment()
+{
+	Segment* segment;
+	
+	segment = freeSegments.Get();
+	if (segment == NULL)
+		segment = new Segment;
+	
+	segment->data.Init();
+	segment->buffer = NULL;
+	segment->ref = NULL;
+	
+	return segment;
+}
+
+template<int bufSize>
+void TCPConn<bufSize>::ReleaseSegment(Segment* segment)
+{
+	Buffer* buf;
+	
+	// the buffers are filled in order, so the one holding the end of a
+	// written segment is no longer needed, unless Write() still uses it
+	if (segment->buffer != NULL &&
+		segment->data.buffer + segment->data.length ==
+		segment->buffer->buffer + segment->buffer->length)
+	{
+		if (segment->buffer == writeQueue.Tail())
+			segment->buffer->Clear();
+		else
+		{
+			buf = writeQueue.Get();
+			assert(buf == segment->buffer);
+			delete buf;
+		}
+	}
+	
+	if (segment->ref != NULL)
+		OnRefReleased(segment->ref);
+	
+	freeSegments.Append(segment);
+}
+
 template<int bufSize>
 void TCPConn<bufSize>::Close()
 {
 	Log_Trace();
 
+	Segment* segment;
+
 	EventLoop::Remove(&connectTimeout);
 
 	if (tcpread.active)
@@ -303,6 +444,17 @@ void TCPConn<bufSize>::Close()
 	socket.Close();
 	state = DISCONNECTED;
 	
+	tcpwrite.segments = NULL;
+	tcpwrite.numSegments = 0;
+	
+	// Give back the references of the unwritten segments.
+	while ((segment = segments.Get()) != NULL)
+	{
+		if (segment->ref != NULL)
+			OnRefReleased(segment->ref);
+		freeSegments.Append(segment);
+	}
+	
 	// Discard unnecessary buffers if there are any.
 	// Keep the last one, so that when the connection
 	// is reused it isn't reallocated.
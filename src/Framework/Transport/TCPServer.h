@@ -43,7 +43,7 @@ public:
 			delete conn;
 	}
 	
-	bool Init(int port_, int backlog_)
+	bool Init(int port_, int backlog_, bool reusePort = false)
 	{
 		bool ret;
 		
@@ -53,6 +53,8 @@ public:
 		ret = listener.Create(Socket::TCP);
 		if (!ret)
 			return false;
+		if (reusePort && !listener.SetReusePort())
+			return false;
 		ret = listener.Listen(port_);
 		if (!ret)
 			return false;	
@@ -7,4 +7,8 @@
 
 #define MAX_UDP_MESSAGE_SIZE (64*KB + 1*KB)
 
+// sent by the accepting side of a TCP transport connection if it reads
+// binary messages; older versions never send anything on it
+#define TRANSPORT_BINARY_HELLO "1:B"
+
 #endif
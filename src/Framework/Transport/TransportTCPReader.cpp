@@ -45,6 +45,7 @@ bool TransportTCPReader::Init(int port)
 {
 	onRead = NULL;
 	running = true;
+	binary = false;
 	return TCPServer::Init(port);
 }
 
@@ -53,6 +54,11 @@ void TransportTCPReader::SetOnRead(Callable* onRead_)
 	onRead = onRead_;
 }
 
+void TransportTCPReader::SetBinary(bool binary_)
+{
+	binary = binary_;
+}
+
 void TransportTCPReader::SetMessage(ByteString msg_)
 {
 	msg.Set(msg_);
@@ -116,6 +122,9 @@ void TransportTCPReader::OnConnect()
 		
 		conn->GetSocket().SetNonblocking();
 		conn->Init(true);
+		if (binary)
+			conn->Write(TRANSPORT_BINARY_HELLO,
+						strlen(TRANSPORT_BINARY_HELLO));
 		if (!running)
 			conn->Stop();
 		conns.Append(conn);
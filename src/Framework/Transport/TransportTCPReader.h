@@ -34,6 +34,7 @@ public:
 	bool		Init(int port);
 
 	void		SetOnRead(Callable* onRead);
+	void		SetBinary(bool binary);
 	void		GetMessage(ByteString& msg_);
 	void		Stop();
 	void		Continue();
@@ -48,6 +49,7 @@ private:
 	ByteString	msg;
 	ConnsList	conns;
 	bool		running;
+	bool		binary;
 };
 
 #endif
@@ -7,6 +7,7 @@
 bool TransportTCPWriter::Init(Endpoint &endpoint_)
 {
 	endpoint = endpoint_;
+	binary = false;
 	TCPConn<>::Connect(endpoint, CONNECT_TIMEOUT);
 	return true;
 }
@@ -29,6 +30,44 @@ void TransportTCPWriter::Write(ByteString &bs)
 		Connect();
 }
 
+bool TransportTCPWriter::IsConnected()
+{
+	return (state == CONNECTED);
+}
+
+bool TransportTCPWriter::IsBinary()
+{
+	return (state == CONNECTED && binary);
+}
+
+bool TransportTCPWriter::IsBinary(TransportTCPWriter** writers, unsigned num)
+{
+	unsigned i;
+	
+	// messages to disconnected writers are dropped anyway
+	for (i = 0; i < num; i++)
+	{
+		if (writers[i]->IsConnected() && !writers[i]->IsBinary())
+			return false;
+	}
+	
+	return true;
+}
+
+bool TransportTCPWriter::IsAllBinary(TransportTCPWriter** writers,
+unsigned num)
+{
+	unsigned i;
+	
+	for (i = 0; i < num; i++)
+	{
+		if (!writers[i]->IsBinary())
+			return false;
+	}
+	
+	return true;
+}
+
 void TransportTCPWriter::Connect()
 {
 	Log_Trace();
@@ -42,6 +81,9 @@ void TransportTCPWriter::OnConnect()
 	
 	Log_Trace("endpoint = %s", endpoint.ToString());
 	
+	// the peer may have been restarted with another version
+	binary = false;
+	
 	AsyncRead();
 }
 
@@ -59,7 +101,25 @@ void TransportTCPWriter::OnRead()
 {
 	Log_Trace("endpoint = %s", endpoint.ToString());
 	
-	// drop any data
+	// the only thing the peer sends is the binary hello,
+	// drop anything else
+	if (tcpread.data.length < strlen(TRANSPORT_BINARY_HELLO) &&
+		strncmp(tcpread.data.buffer, TRANSPORT_BINARY_HELLO,
+		tcpread.data.length) == 0)
+	{
+		// wait for the rest of it
+		IOProcessor::Add(&tcpread);
+		return;
+	}
+	
+	if (tcpread.data.length >= strlen(TRANSPORT_BINARY_HELLO) &&
+		strncmp(tcpread.data.buffer, TRANSPORT_BINARY_HELLO,
+		strlen(TRANSPORT_BINARY_HELLO)) == 0)
+	{
+		Log_Trace("peer reads binary messages");
+		binary = true;
+	}
+	
 	readBuffer.Clear();
 	AsyncRead();
 }
@@ -12,6 +12,14 @@ public:
 	
 	virtual bool	Init(Endpoint &endpoint_);
 	virtual void	Write(ByteString &bs);
+	
+	bool			IsConnected();
+	bool			IsBinary();
+	
+	// true if the peers of all connected writers read binary messages
+	static bool		IsBinary(TransportTCPWriter** writers, unsigned num);
+	// true if all peers are connected and read binary messages
+	static bool		IsAllBinary(TransportTCPWriter** writers, unsigned num);
 
 private:
 	void			Connect();
@@ -23,6 +31,7 @@ private:
 	virtual void	OnClose();
 
 	Endpoint		endpoint;
+	bool			binary;
 };
 
 
@@ -14,6 +14,7 @@
 #include "Application/Keyspace/Protocol/HTTP/HttpApiHandler.h"
 #include "Application/Keyspace/Protocol/HTTP/HttpKeyspaceHandler.h"
 #include "Application/Keyspace/Protocol/Keyspace/KeyspaceServer.h"
+#include "Application/Keyspace/Protocol/Keyspace/KeyspaceReactor.h"
 
 #ifdef DEBUG
 #define VERSION_FMT_STRING "Keyspace v" VERSION_STRING " (DEBUG build date " __DATE__ " " __TIME__ ")"
@@ -25,6 +26,7 @@ int main(int argc, char* argv[])
 {
 	enum		{ single, replicated, missing } mode;
 	int			logTargets;
+	int			ioFlags;
 	const char*	user;
 	char		buf[4096];
 	bool		deleteDB;
@@ -85,7 +87,12 @@ int main(int argc, char* argv[])
 
 	run:
 	{
-		if (!IOProcessor::Init(Config::GetIntValue("io.maxfd", 1024), true))
+		ioFlags = 0;
+		if (Config::GetBoolValue("io.uring", false))
+			ioFlags |= IO_URING;
+		if (Config::GetBoolValue("io.edgeTriggered", false))
+			ioFlags |= IO_EDGE_TRIGGERED;
+		if (!IOProcessor::Init(Config::GetIntValue("io.maxfd", 1024), true, ioFlags))
 			STOP_FAIL("Cannot initalize IOProcessor!", 1);
 
 		// after io is initialized, drop root rights
@@ -96,6 +103,9 @@ int main(int argc, char* argv[])
 		DatabaseConfig dbConfig;
 		dbConfig.dir = Config::GetValue("database.dir", DATABASE_CONFIG_DIR);
 		dbConfig.pageSize = Config::GetIntValue("database.pageSize", DATABASE_CONFIG_PAGE_SIZE);
+		dbConfig.expiryPageSize = Config::GetIntValue("database.expiryPageSize", DATABASE_CONFIG_EXPIRY_PAGE_SIZE);
+		dbConfig.metaPageSize = Config::GetIntValue("database.metaPageSize", DATABASE_CONFIG_META_PAGE_SIZE);
+		dbConfig.logCachePageSize = Config::GetIntValue("database.logCachePageSize", DATABASE_CONFIG_LOGCACHE_PAGE_SIZE);
 		dbConfig.cacheSize = Config::GetIntValue("database.cacheSize", DATABASE_CONFIG_CACHE_SIZE);
 		dbConfig.logBufferSize = Config::GetIntValue("database.logBufferSize", DATABASE_CONFIG_LOG_BUFFER_SIZE);
 		dbConfig.checkpointTimeout = Config::GetIntValue("database.checkpointTimeout", DATABASE_CONFIG_CHECKPOINT_TIMEOUT);
@@ -144,7 +154,22 @@ int main(int argc, char* argv[])
 		}
 
 		KeyspaceServer protoKeyspace;
-		protoKeyspace.Init(kdb, Config::GetIntValue("keyspace.port", 7080));
+		KeyspaceReactor* reactors = NULL;
+		int keyspacePort = Config::GetIntValue("keyspace.port", 7080);
+		int numReactors = Config::GetIntValue("keyspace.numReactors", 0);
+		if (numReactors > 0)
+		{
+			// the clients are served on other threads, the main loop
+			// only executes their ops
+			reactors = new KeyspaceReactor[numReactors];
+			for (int i = 0; i < numReactors; i++)
+			{
+				if (!reactors[i].Start(kdb, keyspacePort))
+					STOP_FAIL("Cannot start keyspace reactors", 1);
+			}
+		}
+		else
+			protoKeyspace.Init(kdb, keyspacePort);
 		
 		EventLoop::Init();
 		EventLoop::Run();
@@ -155,6 +180,7 @@ int main(int argc, char* argv[])
 		else
 			deleteDB = false;
 		
+		delete[] reactors;
 		protoKeyspace.Shutdown();
 		protoHttp.Shutdown();
 		
@@ -174,6 +200,12 @@ int main(int argc, char* argv[])
 			DeleteWC(buf);
 			snprintf(buf, SIZE(buf), "%s/keyspace", dbConfig.dir);
 			DeleteWC(buf);
+			snprintf(buf, SIZE(buf), "%s/expiry", dbConfig.dir);
+			DeleteWC(buf);
+			snprintf(buf, SIZE(buf), "%s/meta", dbConfig.dir);
+			DeleteWC(buf);
+			snprintf(buf, SIZE(buf), "%s/logcache", dbConfig.dir);
+			DeleteWC(buf);
 #ifdef _WIN32
 			MSleep(3000); // otherwise Windows won't let use reuse the same ports
 #endif
@@ -0,0 +1,48 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/*
+ * Pointer-sized atomic operations, the ones that write are full
+ * memory barriers.
+ */
+
+inline bool AtomicCompareAndSwap(void* volatile* target, void* oldValue, void* newValue)
+{
+#ifdef _WIN32
+	return (InterlockedCompareExchangePointer(target, newValue, oldValue) == oldValue);
+#else
+	return __sync_bool_compare_and_swap(target, oldValue, newValue);
+#endif
+}
+
+inline void* AtomicExchange(void* volatile* target, void* value)
+{
+#ifdef _WIN32
+	return InterlockedExchangePointer(target, value);
+#else
+	void* old;
+	
+	do
+	{
+		old = *target;
+	} while (!__sync_bool_compare_and_swap(target, old, value));
+	
+	return old;
+#endif
+}
+
+// reads a value set by AtomicExchange() on another thread
+inline void* AtomicLoad(void* volatile* target)
+{
+#ifdef _WIN32
+	return *target;		// volatile reads have acquire semantics
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#endif
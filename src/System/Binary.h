@@ -0,0 +1,129 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include "Buffer.h"
+
+/*
+ * Helpers for the binary message formats. Numbers are written as
+ * varints (7 bits per byte, low bits first), signed numbers are
+ * zigzag-encoded first so that small negatives stay short. Strings
+ * are written as a varint length followed by the bytes.
+ *
+ * The writers append to data and return false if data.size is
+ * too small. The readers read from data at pos and advance it.
+ */
+
+#define VARINT_MAX_LENGTH	10
+
+inline unsigned VarintLength(uint64_t value)
+{
+	unsigned n;
+
+	for (n = 1; value >= 0x80; n++)
+		value >>= 7;
+
+	return n;
+}
+
+inline uint64_t ZigZag(int64_t value)
+{
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t value)
+{
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+inline bool WriteVarint(ByteString& data, uint64_t value)
+{
+	if (data.length + VarintLength(value) > data.size)
+		return false;
+
+	while (value >= 0x80)
+	{
+		data.buffer[data.length++] = (char) ((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	data.buffer[data.length++] = (char) value;
+
+	return true;
+}
+
+inline bool WriteBytes(ByteString& data, const ByteString& bs)
+{
+	if (!WriteVarint(data, bs.length))
+		return false;
+	if (data.length + bs.length > data.size)
+		return false;
+
+	memcpy(data.buffer + data.length, bs.buffer, bs.length);
+	data.length += bs.length;
+
+	return true;
+}
+
+inline bool ReadVarint(const ByteString& data, unsigned& pos, uint64_t& value)
+{
+	unsigned		shift;
+	unsigned char	c;
+
+	value = 0;
+	for (shift = 0; shift < 64; shift += 7)
+	{
+		if (pos >= data.length)
+			return false;
+		c = (unsigned char) data.buffer[pos++];
+		value |= (uint64_t) (c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+inline bool ReadVarint(const ByteString& data, unsigned& pos, unsigned& value)
+{
+	uint64_t u;
+
+	if (!ReadVarint(data, pos, u) || u > UINT32_MAX)
+		return false;
+	value = (unsigned) u;
+
+	return true;
+}
+
+// copies the bytes into bs
+inline bool ReadBytes(const ByteString& data, unsigned& pos, ByteString& bs)
+{
+	uint64_t len;
+
+	if (!ReadVarint(data, pos, len))
+		return false;
+	if (len > data.length - pos)
+		return false;
+	if (!bs.Set(data.buffer + pos, (unsigned) len))
+		return false;
+	pos += (unsigned) len;
+
+	return true;
+}
+
+// points bs into data, like %N in snreadf
+inline bool ReadBytesNoCopy(const ByteString& data, unsigned& pos, ByteString& bs)
+{
+	uint64_t len;
+
+	if (!ReadVarint(data, pos, len))
+		return false;
+	if (len > data.length - pos)
+		return false;
+	bs.buffer = data.buffer + pos;
+	bs.length = (unsigned) len;
+	bs.size = (unsigned) len;
+	pos += (unsigned) len;
+
+	return true;
+}
+
+#endif
@@ -220,7 +220,24 @@ public:
 		size = 0;
 		length = 0;
 	}
-	
+
+	void Swap(ByteBuffer& other)
+	{
+		char*		buffer_;
+		unsigned	size_;
+		unsigned	length_;
+
+		buffer_ = buffer;
+		size_ = size;
+		length_ = length;
+		buffer = other.buffer;
+		size = other.size;
+		length = other.length;
+		other.buffer = buffer_;
+		other.size = size_;
+		other.length = length_;
+	}
+
 private:
 	ByteString& operator=(const ByteString&) { return *this; }
 };
@@ -0,0 +1,67 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include "System/Atomic.h"
+
+/*
+ * MPSCQueue is a lock-free queue of elements linked through their next
+ * member, pushed by any number of threads and taken by one. Push() tells
+ * whether the queue was empty, so the consumer only has to be woken up
+ * once for everything pushed until it takes them with Get().
+ */
+
+template<class T, T* T::*pnext>
+class MPSCQueue
+{
+public:
+	MPSCQueue()
+	{
+		head = 0;
+	}
+
+	// returns true if the queue was empty
+	bool Push(T* elem)
+	{
+		T* old;
+		
+		do
+		{
+			old = (T*) head;
+			elem->*pnext = old;
+		} while (!AtomicCompareAndSwap((void* volatile*) &head, old, elem));
+		
+		return (old == 0);
+	}
+	
+	// takes every element, the oldest one first
+	T* Get()
+	{
+		T* elem;
+		T* next;
+		T* list;
+		
+		elem = (T*) AtomicExchange((void* volatile*) &head, 0);
+		
+		// they were pushed onto a stack
+		list = 0;
+		while (elem)
+		{
+			next = elem->*pnext;
+			elem->*pnext = list;
+			list = elem;
+			elem = next;
+		}
+		
+		return list;
+	}
+	
+	bool IsEmpty()
+	{
+		return (head == 0);
+	}
+
+private:
+	T* volatile		head;
+};
+
+#endif
@@ -1,12 +1,12 @@
 #include "EventLoop.h"
 
-static uint64_t now;
-static bool		running;
+// every event loop thread keeps its own time
+static THREAD_LOCAL uint64_t	now;
+static THREAD_LOCAL bool		running;
 
 
 long EventLoop::RunTimers()
 {
-	Timer**     it;
 	Timer*      timer;
 	uint64_t    now;
 	
@@ -14,22 +14,15 @@ long EventLoop::RunTimers()
 
     now = ::now;
     
-    for (it = timers.Head(); it != NULL; it = timers.Head())
+	while ((timer = timers->Next(now)) != NULL)
 	{
-		timer = *it;
-		
         UpdateTime();
 
-		if (timer->When() <= now)
-		{
-			Remove(timer);
-			timer->Execute();
-		}
-		else
-			return timer->When() - now;
+		Remove(timer);
+		timer->Execute();
 	}
 
-	return -1; // no timers to wait for
+	return timers->GetWait(now); // -1 if there are no timers to wait for
 }
 
 bool EventLoop::RunOnce()
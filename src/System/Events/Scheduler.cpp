@@ -1,17 +1,18 @@
 #include "Scheduler.h"
 
-SortedList<Timer*>	Scheduler::timers;
+static TimerWheel				mainTimers;
+THREAD_LOCAL TimerWheel*		Scheduler::timers = &mainTimers;
 
 void Scheduler::Add(Timer* timer)
 {
 	timer->OnAdd();
 	timer->active = true;
-	timers.Add(timer);
+	timers->Add(timer);
 }
 
 void Scheduler::Remove(Timer* timer)
 {
-	timers.Remove(timer);
+	timers->Remove(timer);
 	timer->active = false;
 }
 
@@ -23,5 +24,17 @@ void Scheduler::Reset(Timer* timer)
 
 void Scheduler::Shutdown()
 {
-	timers.Clear();
+	timers->Clear();
+}
+
+void Scheduler::InitThread()
+{
+	timers = new TimerWheel;
+}
+
+void Scheduler::ShutdownThread()
+{
+	timers->Clear();
+	delete timers;
+	timers = &mainTimers;
 }
@@ -1,8 +1,9 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
-#include "System/Containers/SortedList.h"
+#include "System/Platform.h"
 #include "Timer.h"
+#include "TimerWheel.h"
 
 class Scheduler
 {
@@ -12,8 +13,12 @@ public:
 	static void		Reset(Timer* timer);
 	static void		Shutdown();
 
+	// event loop threads other than the main one have their own timers
+	static void		InitThread();
+	static void		ShutdownThread();
+
 protected:
-	static SortedList<Timer*>	timers;
+	static THREAD_LOCAL TimerWheel*	timers;
 };
 
 #endif
@@ -4,9 +4,12 @@
 #include "System/Time.h"
 #include "Callable.h"
 
+struct TimerSlot;
+
 class Timer
 {
 friend class Scheduler;
+friend class TimerWheel;
 
 public:
 	Timer()
@@ -14,6 +17,9 @@ public:
 		when = 0;
 		callable = NULL;
 		active = false;
+		prev = NULL;
+		next = NULL;
+		slot = NULL;
 	}
 
 	virtual ~Timer() {}
@@ -23,6 +29,9 @@ public:
 		when = 0;
 		callable = callable_;
 		active = false;
+		prev = NULL;
+		next = NULL;
+		slot = NULL;
 	}
 		
 	void Set(uint64_t when_)
@@ -53,6 +62,10 @@ protected:
     bool			active;
 	uint64_t		when;
     Callable*		callable;
+	// position in the TimerWheel of the Scheduler
+	Timer*			prev;
+	Timer*			next;
+	TimerSlot*		slot;
 };
 
 class CdownTimer : public Timer
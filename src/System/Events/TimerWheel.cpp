@@ -0,0 +1,260 @@
+#include "TimerWheel.h"
+#include "System/Common.h"
+
+#define ROOT_MASK		(TIMERWHEEL_ROOT_SIZE - 1)
+#define LEVEL_MASK		(TIMERWHEEL_LEVEL_SIZE - 1)
+// msec per slot of a level
+#define LEVEL_SHIFT(l)	((l) == 0 ? 0 : \
+						TIMERWHEEL_ROOT_BITS + ((l) - 1) * TIMERWHEEL_LEVEL_BITS)
+#define LEVEL_UNIT(l)	((uint64_t) 1 << LEVEL_SHIFT(l))
+// msec covered by a level and the ones below it
+#define LEVEL_RANGE(l)	((uint64_t) 1 << \
+						(TIMERWHEEL_ROOT_BITS + (l) * TIMERWHEEL_LEVEL_BITS))
+
+TimerWheel::TimerWheel()
+{
+	unsigned i, j;
+
+	for (i = 0; i < TIMERWHEEL_ROOT_SIZE; i++)
+	{
+		root[i].head = NULL;
+		root[i].tail = NULL;
+		root[i].level = 0;
+	}
+
+	for (i = 0; i < TIMERWHEEL_LEVELS - 1; i++)
+	{
+		for (j = 0; j < TIMERWHEEL_LEVEL_SIZE; j++)
+		{
+			levels[i][j].head = NULL;
+			levels[i][j].tail = NULL;
+			levels[i][j].level = i + 1;
+		}
+	}
+
+	for (i = 0; i < TIMERWHEEL_LEVELS; i++)
+		counts[i] = 0;
+
+	num = 0;
+	current = 0;
+}
+
+void TimerWheel::Add(Timer* timer)
+{
+	if (timer->slot != NULL)
+		Remove(timer);
+
+	// the wheel is not advanced while it is empty
+	if (num == 0)
+		current = Now();
+
+	Append(GetSlot(timer->when), timer);
+	num++;
+}
+
+void TimerWheel::Remove(Timer* timer)
+{
+	if (timer->slot == NULL)
+		return;
+
+	Unlink(timer);
+	num--;
+}
+
+void TimerWheel::Clear()
+{
+	unsigned i, j;
+
+	for (i = 0; i < TIMERWHEEL_ROOT_SIZE; i++)
+		ClearSlot(&root[i]);
+
+	for (i = 0; i < TIMERWHEEL_LEVELS - 1; i++)
+	{
+		for (j = 0; j < TIMERWHEEL_LEVEL_SIZE; j++)
+			ClearSlot(&levels[i][j]);
+	}
+
+	for (i = 0; i < TIMERWHEEL_LEVELS; i++)
+		counts[i] = 0;
+
+	num = 0;
+}
+
+Timer* TimerWheel::Next(uint64_t now)
+{
+	TimerSlot*	slot;
+
+	if (num == 0)
+		return NULL;
+
+	Advance(now);
+
+	// the root slot of the current msec holds the timers due by then
+	slot = &root[current & ROOT_MASK];
+	if (slot->head != NULL && slot->head->when <= now)
+		return slot->head;
+
+	return NULL;
+}
+
+long TimerWheel::GetWait(uint64_t now)
+{
+	TimerSlot*	slot;
+	uint64_t	next;
+	unsigned	i;
+	unsigned	level;
+
+	if (num == 0)
+		return -1;
+
+	if (counts[0] > 0)
+	{
+		for (i = 0; i < TIMERWHEEL_ROOT_SIZE; i++)
+		{
+			slot = &root[(current + i) & ROOT_MASK];
+			if (slot->head != NULL)
+			{
+				next = current + i;
+				return (long) (next > now ? next - now : 0);
+			}
+		}
+	}
+
+	// wake up when the first upper slot with timers is moved down
+	for (level = 1; level < TIMERWHEEL_LEVELS - 1; level++)
+	{
+		if (counts[level] > 0)
+			break;
+	}
+	next = (current | (LEVEL_UNIT(level) - 1)) + 1;
+	return (long) (next > now ? next - now : 0);
+}
+
+TimerSlot* TimerWheel::GetSlot(uint64_t when)
+{
+	uint64_t	delta;
+	unsigned	level;
+
+	// late timers are due at the current msec
+	if (when < current)
+		when = current;
+
+	delta = when - current;
+	if (delta < TIMERWHEEL_ROOT_SIZE)
+		return &root[when & ROOT_MASK];
+
+	for (level = 1; level < TIMERWHEEL_LEVELS - 1; level++)
+	{
+		if (delta < LEVEL_RANGE(level))
+			break;
+	}
+
+	// the ones beyond the last level are put back when its slot is due
+	if (delta >= LEVEL_RANGE(level))
+		when = current + LEVEL_RANGE(level) - 1;
+
+	return &levels[level - 1][(when >> LEVEL_SHIFT(level)) & LEVEL_MASK];
+}
+
+void TimerWheel::Advance(uint64_t now)
+{
+	uint64_t	next;
+	unsigned	level;
+
+	while (current < now)
+	{
+		if (root[current & ROOT_MASK].head != NULL)
+			return;
+
+		// the levels below the first one with timers are empty, so
+		// the time is moved to the next slot boundary of that level
+		for (level = 0; level < TIMERWHEEL_LEVELS - 1; level++)
+		{
+			if (counts[level] > 0)
+				break;
+		}
+		next = (current | (LEVEL_UNIT(level) - 1)) + 1;
+		if (next > now)
+		{
+			current = now;
+			return;
+		}
+		current = next;
+
+		for (level = 1; level < TIMERWHEEL_LEVELS; level++)
+		{
+			if ((current & (LEVEL_UNIT(level) - 1)) != 0)
+				break;
+			Cascade(level);
+		}
+	}
+}
+
+void TimerWheel::Cascade(unsigned level)
+{
+	TimerSlot*	slot;
+	Timer*		timer;
+	Timer*		next;
+
+	slot = &levels[level - 1][(current >> LEVEL_SHIFT(level)) & LEVEL_MASK];
+	timer = slot->head;
+	slot->head = NULL;
+	slot->tail = NULL;
+
+	// the order of the timers is kept
+	for (; timer != NULL; timer = next)
+	{
+		next = timer->next;
+		counts[level]--;
+		Append(GetSlot(timer->when), timer);
+	}
+}
+
+void TimerWheel::Append(TimerSlot* slot, Timer* timer)
+{
+	timer->prev = slot->tail;
+	timer->next = NULL;
+	if (slot->tail != NULL)
+		slot->tail->next = timer;
+	else
+		slot->head = timer;
+	slot->tail = timer;
+	timer->slot = slot;
+	counts[slot->level]++;
+}
+
+void TimerWheel::ClearSlot(TimerSlot* slot)
+{
+	Timer*	timer;
+	Timer*	next;
+
+	for (timer = slot->head; timer != NULL; timer = next)
+	{
+		next = timer->next;
+		timer->prev = NULL;
+		timer->next = NULL;
+		timer->slot = NULL;
+	}
+	slot->head = NULL;
+	slot->tail = NULL;
+}
+
+void TimerWheel::Unlink(Timer* timer)
+{
+	TimerSlot* slot;
+
+	slot = timer->slot;
+	if (timer->prev != NULL)
+		timer->prev->next = timer->next;
+	else
+		slot->head = timer->next;
+	if (timer->next != NULL)
+		timer->next->prev = timer->prev;
+	else
+		slot->tail = timer->prev;
+
+	timer->prev = NULL;
+	timer->next = NULL;
+	timer->slot = NULL;
+	counts[slot->level]--;
+}
@@ -0,0 +1,62 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "Timer.h"
+
+#define TIMERWHEEL_LEVELS		5
+#define TIMERWHEEL_ROOT_BITS	8
+#define TIMERWHEEL_LEVEL_BITS	6
+#define TIMERWHEEL_ROOT_SIZE	(1 << TIMERWHEEL_ROOT_BITS)
+#define TIMERWHEEL_LEVEL_SIZE	(1 << TIMERWHEEL_LEVEL_BITS)
+
+/*
+ * TimerWheel is a hierarchical timing wheel of millisecond ticks.
+ * The first level has a slot for each of the next 256 msec, each
+ * further level has 64 slots covering 64 times the range of the one
+ * below it, so five levels reach about 49 days. Timers further away
+ * are kept in the last slot and put back when it comes due.
+ *
+ * Add and Remove are O(1). When the time passes a slot boundary of an
+ * upper level, the timers of that slot are moved to the levels below.
+ * Timers due at the same msec run in the order they were added.
+ */
+
+struct TimerSlot
+{
+	Timer*		head;
+	Timer*		tail;
+	unsigned	level;
+};
+
+class TimerWheel
+{
+public:
+	TimerWheel();
+
+	void		Add(Timer* timer);
+	void		Remove(Timer* timer);
+	void		Clear();
+
+	// returns the next timer due by now, NULL if there is none
+	Timer*		Next(uint64_t now);
+	// msec until the wheel has to be checked, -1 if it is empty
+	long		GetWait(uint64_t now);
+
+	unsigned	GetLength() { return num; }
+
+private:
+	TimerSlot*	GetSlot(uint64_t when);
+	void		Advance(uint64_t now);
+	void		Cascade(unsigned level);
+	void		Append(TimerSlot* slot, Timer* timer);
+	void		Unlink(Timer* timer);
+	void		ClearSlot(TimerSlot* slot);
+
+	TimerSlot	root[TIMERWHEEL_ROOT_SIZE];
+	TimerSlot	levels[TIMERWHEEL_LEVELS - 1][TIMERWHEEL_LEVEL_SIZE];
+	unsigned	counts[TIMERWHEEL_LEVELS];
+	unsigned	num;
+	uint64_t	current;	// the timers before it have been returned
+};
+
+#endif
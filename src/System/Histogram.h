@@ -0,0 +1,80 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "Common.h"
+
+#define HISTOGRAM_NUM_BUCKETS	65
+
+/*
+ * Histogram with power-of-two buckets: bucket 0 counts zeros,
+ * bucket i counts values in [2^(i-1), 2^i). Percentiles are
+ * returned as the upper bound of the bucket they fall into.
+ */
+
+class Histogram
+{
+public:
+	Histogram() { Reset(); }
+
+	void Reset()
+	{
+		unsigned i;
+
+		for (i = 0; i < HISTOGRAM_NUM_BUCKETS; i++)
+			buckets[i] = 0;
+		count = 0;
+		sum = 0;
+		max = 0;
+	}
+
+	void Add(uint64_t value)
+	{
+		unsigned i;
+
+		for (i = 0; i < HISTOGRAM_NUM_BUCKETS - 1 && value >> i; i++)
+			/* empty */;
+
+		buckets[i]++;
+		count++;
+		sum += value;
+		if (value > max)
+			max = value;
+	}
+
+	uint64_t GetCount() { return count; }
+	uint64_t GetSum() { return sum; }
+	uint64_t GetMax() { return max; }
+	uint64_t GetMean() { return count == 0 ? 0 : sum / count; }
+
+	uint64_t GetPercentile(unsigned percent)
+	{
+		unsigned	i;
+		uint64_t	n, limit;
+
+		if (count == 0)
+			return 0;
+
+		limit = (count * percent + 99) / 100;
+		n = 0;
+		for (i = 0; i < HISTOGRAM_NUM_BUCKETS; i++)
+		{
+			n += buckets[i];
+			if (n >= limit)
+				break;
+		}
+
+		if (i == 0)
+			return 0;
+		if (i >= 64)
+			return max;
+		return MIN(max, ((uint64_t) 1 << i) - 1);
+	}
+
+private:
+	uint64_t	buckets[HISTOGRAM_NUM_BUCKETS];
+	uint64_t	count;
+	uint64_t	sum;
+	uint64_t	max;
+};
+
+#endif
@@ -14,11 +14,14 @@
 
 #define	TCP_READ	'a'
 #define	TCP_WRITE	'b'
+#define	TCP_SENDFILE	'c'
 #define	UDP_READ	'x'
 #define	UDP_WRITE	'y'
 
 #define IO_READ_ANY -1
 
+#define TCP_MAX_SEGMENTS	64
+
 class AsyncOperation
 {
 public:
@@ -89,11 +92,40 @@ public:
 	{
 		type = TCP_WRITE;
 		transferred = 0;
+		segments = NULL;
+		numSegments = 0;
 	}
 
 public:
 	unsigned	transferred;		/*	the IO subsystem has given the first
 										'transferred' bytes to the kernel */
+	ByteString*	segments;			/*	if set, the first 'numSegments'
+										(at most TCP_MAX_SEGMENTS) are
+										written one after the other with
+										one gathering call, instead of
+										'data', whose length is their total */
+	int			numSegments;
+};
+
+class TCPSendFile : public IOOperation
+{
+public:
+	TCPSendFile()
+	: IOOperation()
+	{
+		type = TCP_SENDFILE;
+		file = INVALID_FD;
+		fileOffset = 0;
+		length = 0;
+		transferred = 0;
+	}
+
+public:
+	FD			file;				/*	sent to fd without copying it
+										through user space */
+	uint64_t	fileOffset;
+	unsigned	length;
+	unsigned	transferred;
 };
 
 class TCPRead : public IOOperation
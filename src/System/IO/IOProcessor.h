@@ -3,20 +3,45 @@
 
 #include "IOOperation.h"
 
+#define IO_MAX_LOOPS	64
+#define IO_MAIN_LOOP	0
+
+// flags of Init()
+#define IO_URING			1
+#define IO_EDGE_TRIGGERED	2
+
 class Callable;
 
+/*
+ * Every thread that runs an event loop polls its own set of IO
+ * operations. The main loop is created by Init(), other threads get
+ * theirs with CreateLoop() and SetThreadLoop(). Threads without a loop,
+ * like the thread pools, use the main one. Complete() passes a Callable
+ * to the main loop or to the given one from any thread.
+ *
+ * On Linux the loops use io_uring instead of epoll with IO_URING if the
+ * kernel supports it. With IO_EDGE_TRIGGERED each fd is added to epoll
+ * once and its readiness is tracked until Socket closes it.
+ */
+
 class IOProcessor
 {
 public:
-	static bool Init(int maxfd, bool blockSignals);
+	static bool Init(int maxfd, bool blockSignals, int flags = 0);
 	static void Shutdown();
 
+	static int	CreateLoop();
+	static void	DeleteLoop(int loopID);
+	static void	SetThreadLoop(int loopID);
+	static int	GetThreadLoop();
+
 	static bool Add(IOOperation* ioop);
 	static bool Remove(IOOperation* ioop);
 
 	static bool Poll(int sleep);
 
 	static bool Complete(Callable* callable);
+	static bool Complete(Callable* callable, int loopID);
 };
 
 #endif
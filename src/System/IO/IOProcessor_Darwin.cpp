@@ -5,6 +5,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <math.h>
 #include <errno.h>
@@ -31,6 +32,8 @@ static bool AddKq(int ident, short filter, IOOperation* ioop);
 static void ProcessAsyncOp();
 static void ProcessTCPRead(struct kevent* ev);
 static void ProcessTCPWrite(struct kevent* ev);
+static int	WriteSegments(TCPWrite* tcpwrite, int writelen);
+static void ProcessTCPSendFile(struct kevent* ev);
 static void ProcessUDPRead(struct kevent* ev);
 static void ProcessUDPWrite(struct kevent* ev);
 
@@ -80,7 +83,7 @@ void SetupSignals()
 //	AddKq(SIGXFSZ, EVFILT_SIGNAL, NULL);
 }
 
-bool IOProcessor::Init(int maxfd_, bool blockSignals)
+bool IOProcessor::Init(int maxfd_, bool blockSignals, int /*flags*/)
 {
 	rlimit rl;
 
@@ -131,6 +134,26 @@ void IOProcessor::Shutdown()
 	close(asyncOpPipe[1]);
 }
 
+// only the main loop is supported on this platform
+int IOProcessor::CreateLoop()
+{
+	Log_Message("Event loop threads are not supported on this platform");
+	return -1;
+}
+
+void IOProcessor::DeleteLoop(int /*loopID*/)
+{
+}
+
+void IOProcessor::SetThreadLoop(int /*loopID*/)
+{
+}
+
+int IOProcessor::GetThreadLoop()
+{
+	return IO_MAIN_LOOP;
+}
+
 bool IOProcessor::Add(IOOperation* ioop)
 {
 	short	filter;
@@ -221,6 +244,12 @@ bool IOProcessor::Remove(IOOperation* ioop)
 	return true;
 }
 
+// called by Socket before closing the fd
+bool IOProcessorUnregisterSocket(FD& /*fd*/)
+{
+	return true;
+}
+
 bool IOProcessor::Poll(int sleep)
 {
 	int						i, nevents;
@@ -284,6 +313,8 @@ bool IOProcessor::Poll(int sleep)
 			ProcessTCPRead(&events[i]);
 		else if (ioop->type == TCP_WRITE && (events[i].filter & EVFILT_WRITE))
 			ProcessTCPWrite(&events[i]);
+		else if (ioop->type == TCP_SENDFILE && (events[i].filter & EVFILT_WRITE))
+			ProcessTCPSendFile(&events[i]);
 		else if (ioop->type == UDP_READ && (events[i].filter & EVFILT_READ))
 			ProcessUDPRead(&events[i]);
 		else if (ioop->type == UDP_WRITE && (events[i].filter & EVFILT_WRITE))
@@ -309,6 +340,11 @@ bool IOProcessor::Complete(Callable* callable)
 	return false;
 }
 
+bool IOProcessor::Complete(Callable* callable, int /*loopID*/)
+{
+	return Complete(callable);
+}
+
 void ProcessAsyncOp()
 {
 	Log_Trace();
@@ -405,9 +441,12 @@ void ProcessTCPWrite(struct kevent* ev)
 	
 	if (writelen > 0)
 	{
-		nwrite = write(tcpwrite->fd,
-					   tcpwrite->data.buffer + tcpwrite->transferred,
-					   writelen);
+		if (tcpwrite->segments != NULL)
+			nwrite = WriteSegments(tcpwrite, writelen);
+		else
+			nwrite = write(tcpwrite->fd,
+						   tcpwrite->data.buffer + tcpwrite->transferred,
+						   writelen);
 		
 		if (nwrite < 0)
 		{
@@ -427,6 +466,80 @@ void ProcessTCPWrite(struct kevent* ev)
 	}
 }
 
+int WriteSegments(TCPWrite* tcpwrite, int writelen)
+{
+	struct iovec	iov[TCP_MAX_SEGMENTS];
+	unsigned		skip;
+	unsigned		len;
+	int				i, n;
+	
+	// at most 'writelen' bytes of the segments are passed to the kernel at
+	// once, leaving out the first 'transferred' bytes already written
+	skip = tcpwrite->transferred;
+	for (i = 0, n = 0; i < tcpwrite->numSegments && writelen > 0; i++)
+	{
+		if (skip >= tcpwrite->segments[i].length)
+		{
+			skip -= tcpwrite->segments[i].length;
+			continue;
+		}
+		
+		len = MIN(tcpwrite->segments[i].length - skip, (unsigned) writelen);
+		iov[n].iov_base = tcpwrite->segments[i].buffer + skip;
+		iov[n].iov_len = len;
+		writelen -= len;
+		skip = 0;
+		n++;
+	}
+	
+	return writev(tcpwrite->fd, iov, n);
+}
+
+void ProcessTCPSendFile(struct kevent* ev)
+{
+	off_t			len;
+	int				ret;
+	TCPSendFile*	tcpsendfile;
+	
+	tcpsendfile = (TCPSendFile*) ev->udata;
+	
+	if (ev->flags & EV_EOF)
+	{
+		Call(tcpsendfile->onClose);
+		return;
+	}
+	
+	// on return len is the number of bytes sent, also when the call
+	// would have blocked
+	len = tcpsendfile->length - tcpsendfile->transferred;
+	ret = sendfile(tcpsendfile->file,
+				   tcpsendfile->fd,
+				   (off_t) (tcpsendfile->fileOffset + tcpsendfile->transferred),
+				   &len,
+				   NULL,
+				   0);
+	
+	if (ret < 0 && errno != EWOULDBLOCK && errno != EAGAIN)
+	{
+		Log_Errno();
+		Call(tcpsendfile->onClose);
+		return;
+	}
+	
+	if (ret == 0 && len == 0)
+	{
+		// the file is shorter than expected
+		Call(tcpsendfile->onClose);
+		return;
+	}
+	
+	tcpsendfile->transferred += (unsigned) len;
+	if (tcpsendfile->transferred == tcpsendfile->length)
+		Call(tcpsendfile->onComplete);
+	else
+		IOProcessor::Add(tcpsendfile);
+}
+
 void ProcessUDPRead(struct kevent* ev)
 {
 	int			salen, nread;
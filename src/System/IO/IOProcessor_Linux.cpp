@@ -5,55 +5,101 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <signal.h>
 #include <math.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include "System/IO/IOProcessor.h"
+#include "System/IO/IOUring.h"
 #include "System/Common.h"
 #include "System/Log.h"
 #include "System/Time.h"
+#include "System/Containers/MPSCQueue.h"
 #include "System/Events/EventLoop.h"
 
 #define	MAX_EVENTS			1024
-#define PIPEOP				'p'
+#define ASYNCOP				'p'
+#define COMPLETION_POOL		256		// preallocated completions of a loop
 
+// the low bits of an io_uring user_data tell what the IOOperation waits for
+#define URING_POLL			1
+#define URING_CANCEL		2
+#define URING_FLAGS			(URING_POLL | URING_CANCEL)
 
-class PipeOp : public IOOperation
+
+// a Callable passed to a loop by Complete(), the processed ones are
+// reused and only deleted by Shutdown()
+class Completion
 {
 public:
-	PipeOp()
+	Completion()
 	{
-		type = PIPEOP;
-		pipe[0] = pipe[1] = -1;
+		callable = NULL;
+		next = NULL;
+		nextAllocated = NULL;
+	}
+
+	Callable*		callable;
+	Completion*		next;
+	Completion*		nextAllocated;
+};
+
+typedef MPSCQueue<Completion, &Completion::next> CompletionQueue;
+typedef MPSCQueue<Completion, &Completion::nextAllocated> AllocatedQueue;
+
+static Completion*	NewCompletion();
+
+// the eventfd that wakes up a loop when completions are queued for it
+class AsyncOp : public IOOperation
+{
+public:
+	AsyncOp()
+	{
+		type = ASYNCOP;
 		callback = NULL;
 	}
 	
-	~PipeOp()
+	~AsyncOp()
 	{
 		Close();
 	}
 	
 	void Close()
 	{
-		if (pipe[0] >= 0)
+		if (fd >= 0)
 		{
-			close(pipe[0]);
-			pipe[0] = -1;
-		}
-		if (pipe[1] >= 0)
-		{
-			close(pipe[1]);
-			pipe[1] = -1;
+			close(fd);
+			fd = -1;
 		}
 	}
 	
-	int			 	pipe[2];
 	CFunc::Callback	callback;
 };
 
+// an entry of the loop's ready list, each fd has one for either direction
+class ReadyLink
+{
+public:
+	ReadyLink()
+	{
+		ioop = NULL;
+		prev = NULL;
+		next = NULL;
+		linked = false;
+	}
+	
+	IOOperation*	ioop;
+	ReadyLink*		prev;
+	ReadyLink*		next;
+	bool			linked;
+};
+
 class EpollOp
 {
 public:
@@ -61,47 +107,124 @@ public:
 	{
 		read = NULL;
 		write = NULL;
+		edge = false;
+		readable = false;
+		writable = false;
 	}
 	
 	IOOperation*	read;
 	IOOperation*	write;
+	bool			edge;		// registered once with EPOLLET
+	bool			readable;	// the last transfer did not drain it
+	bool			writable;
+	ReadyLink		readReady;
+	ReadyLink		writeReady;
+};
+
+// the epoll set or the io_uring and the completions of one event loop
+class IOLoop
+{
+public:
+	IOLoop()
+	{
+		int i;
+		
+		for (i = 0; i < COMPLETION_POOL; i++)
+			pool.Push(NewCompletion());
+		epollfd = -1;
+		uring = NULL;
+		readyHead = NULL;
+		readyTail = NULL;
+		numReady = 0;
+		waited = false;
+	}
+	
+	~IOLoop()
+	{
+		if (epollfd >= 0)
+			close(epollfd);
+		delete uring;
+	}
+	
+	int					epollfd;
+	IOUring*			uring;
+	AsyncOp				asyncOp;
+	CompletionQueue		completions;
+	// the processed completions go back here, Complete() takes them all
+	// at once into the calling thread's freeCompletions
+	CompletionQueue		pool;
+	// the ops of edge-triggered fds that can go on without waiting
+	ReadyLink*			readyHead;
+	ReadyLink*			readyTail;
+	int					numReady;
+	bool				waited;
+	struct epoll_event	events[MAX_EVENTS];
+	// completions reaped by UringRemove() while waiting for a cancellation
+	DynArray<16 * sizeof(struct io_uring_cqe)> deferred;
 };
 
-static int			epollfd = 0;
+// the fds are unique in the process, each one is added to one loop only
 static int			maxfd;
-static PipeOp		asyncPipeOp;
 static EpollOp*		epollOps;
+static IOLoop*		loops[IO_MAX_LOOPS];
+static THREAD_LOCAL IOLoop* threadLoop = NULL;
+static AllocatedQueue allocatedCompletions;
+static volatile unsigned completionsGeneration = 0;
+static THREAD_LOCAL Completion* freeCompletions = NULL;
+static THREAD_LOCAL unsigned freeGeneration = 0;
 static volatile bool terminated = false;
+static bool			useUring = false;
+static bool			edgeTriggered = false;
 
-static bool			AddEvent(int fd, uint32_t filter, IOOperation* ioop);
+static IOLoop*		GetLoop();
+static IOLoop*		NewLoop();
+static bool			AddEvent(IOLoop* loop, int fd, uint32_t filter, IOOperation* ioop);
+
+static bool			EdgeAdd(IOLoop* loop, IOOperation* ioop);
+static void			EdgeRemove(IOLoop* loop, IOOperation* ioop);
+static bool			EdgePoll(IOLoop* loop, int sleep);
+static void			PushReady(IOLoop* loop, IOOperation* ioop);
+static void			UnlinkReady(IOLoop* loop, ReadyLink* link);
+static void			NotReady(IOOperation* ioop);
+static bool			IsRead(IOOperation* ioop);
+
+static bool			UringAdd(IOLoop* loop, IOOperation* ioop);
+static bool			UringArmPoll(IOLoop* loop, IOOperation* ioop);
+static bool			UringRemove(IOLoop* loop, IOOperation* ioop);
+static bool			UringPoll(IOLoop* loop, int sleep);
+static void			UringComplete(IOLoop* loop, struct io_uring_cqe& cqe);
 
 static void			ProcessAsyncOp();
 static void			ProcessIOOperation(IOOperation* ioop);
 static void			ProcessTCPRead(TCPRead* tcpread);
 static void			ProcessTCPWrite(TCPWrite* tcpwrite);
+static int			WriteSegments(TCPWrite* tcpwrite);
+static int			TCPReadLength(TCPRead* tcpread);
+static void			OnTCPRead(TCPRead* tcpread, int nread);
+static void			OnTCPWrite(TCPWrite* tcpwrite, int nwrite);
+static void			ProcessTCPSendFile(TCPSendFile* tcpsendfile);
 static void			ProcessUDPRead(UDPRead* udpread);
 static void			ProcessUDPWrite(UDPWrite* udpwrite);
 
 
-bool /*IOProcessor::*/InitPipe(PipeOp &pipeop, CFunc::Callback callback)
+bool /*IOProcessor::*/InitAsyncOp(IOLoop* loop, AsyncOp &asyncop, CFunc::Callback callback)
 {
-	if (pipe(pipeop.pipe) < 0)
+	asyncop.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (asyncop.fd < 0)
 	{
 		Log_Errno();
 		return false;
 	}
 
-	if (pipeop.pipe[0] < 0 || pipeop.pipe[1] < 0)
-		return false;
-	
-	fcntl(pipeop.pipe[0], F_SETFD, FD_CLOEXEC);
-	fcntl(pipeop.pipe[0], F_SETFL, O_NONBLOCK);
-	//fcntl(pipeop.pipe[1], F_SETFL, O_NONBLOCK);
-
-	if (!AddEvent(pipeop.pipe[0], EPOLLIN, &pipeop))
+	if (loop->uring != NULL)
+	{
+		if (!UringAdd(loop, &asyncop))
+			return false;
+	}
+	else if (!AddEvent(loop, asyncop.fd, EPOLLIN, &asyncop))
 		return false;
 	
-	pipeop.callback = callback;
+	asyncop.callback = callback;
 
 	return true;
 }
@@ -141,14 +264,13 @@ void SetupSignals()
 	pthread_sigmask(SIG_SETMASK, &mask, NULL);
 }
 
-bool IOProcessor::Init(int maxfd_, bool blockSignals)
+bool IOProcessor::Init(int maxfd_, bool blockSignals, int flags)
 {
-	int i;
 	rlimit rl;
 
 	terminated = false;
 
-	if (epollfd > 0)
+	if (loops[IO_MAIN_LOOP] != NULL)
 		return true;
 
 	if (maxfd_ < 0)
@@ -158,6 +280,8 @@ bool IOProcessor::Init(int maxfd_, bool blockSignals)
 	}
 
 	maxfd = maxfd_;
+	useUring = ((flags & IO_URING) != 0);
+	edgeTriggered = ((flags & IO_EDGE_TRIGGERED) != 0);
 	rl.rlim_cur = maxfd;
 	rl.rlim_max = maxfd;
 	if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
@@ -165,65 +289,179 @@ bool IOProcessor::Init(int maxfd_, bool blockSignals)
 		Log_Errno();
 	}
 	
-	epollfd = epoll_create(maxfd);
-	if (epollfd < 0)
-	{
-		Log_Errno();
-		return false;
-	}
-
 	if (blockSignals)
 		SetupSignals();
 
 	epollOps = new EpollOp[maxfd];
-	for (i = 0; i < maxfd; i++)
-	{
-		epollOps[i].read = NULL;
-		epollOps[i].write = NULL;
-	}
 
-	
-	if (!InitPipe(asyncPipeOp, ProcessAsyncOp))
+	loops[IO_MAIN_LOOP] = NewLoop();
+	if (loops[IO_MAIN_LOOP] == NULL)
 		return false;
+	threadLoop = loops[IO_MAIN_LOOP];
 
 	return true;
 }
 
 void IOProcessor::Shutdown()
 {
-	close(epollfd);
-	epollfd = 0;
+	int i;
+	
+	Completion* completion;
+	Completion* next;
+	
+	for (i = 0; i < IO_MAX_LOOPS; i++)
+		DeleteLoop(i);
+	threadLoop = NULL;
+	
+	// the free lists of the threads refer to these, they are dropped
+	// when the threads see the new generation
+	completionsGeneration++;
+	freeCompletions = NULL;
+	for (completion = allocatedCompletions.Get(); completion != NULL; completion = next)
+	{
+		next = completion->nextAllocated;
+		delete completion;
+	}
 	delete[] epollOps;
-	asyncPipeOp.Close();
+	epollOps = NULL;
+}
+
+int IOProcessor::CreateLoop()
+{
+	int i;
+	
+	// called by the main thread before the loop's thread is started
+	for (i = IO_MAIN_LOOP + 1; i < IO_MAX_LOOPS; i++)
+	{
+		if (loops[i] == NULL)
+		{
+			loops[i] = NewLoop();
+			return (loops[i] != NULL ? i : -1);
+		}
+	}
+	
+	Log_Message("Cannot create more than %d event loops", IO_MAX_LOOPS);
+	return -1;
+}
+
+void IOProcessor::DeleteLoop(int loopID)
+{
+	IOLoop* loop;
+	
+	loop = loops[loopID];
+	if (loop == NULL)
+		return;
+	
+	// the fd number of the eventfd will be reused
+	if (loop->asyncOp.fd >= 0)
+		epollOps[loop->asyncOp.fd] = EpollOp();
+	
+	delete loop;
+	loops[loopID] = NULL;
+}
+
+void IOProcessor::SetThreadLoop(int loopID)
+{
+	threadLoop = loops[loopID];
+}
+
+int IOProcessor::GetThreadLoop()
+{
+	int i;
+	
+	for (i = 0; i < IO_MAX_LOOPS; i++)
+	{
+		if (loops[i] == GetLoop())
+			return i;
+	}
+	
+	return IO_MAIN_LOOP;
+}
+
+IOLoop* GetLoop()
+{
+	if (threadLoop != NULL)
+		return threadLoop;
+	
+	return loops[IO_MAIN_LOOP];
+}
+
+IOLoop* NewLoop()
+{
+	IOLoop* loop;
+	
+	loop = new IOLoop;
+	if (useUring)
+	{
+		loop->uring = new IOUring;
+		if (!loop->uring->Init(IOURING_ENTRIES))
+		{
+			Log_Message("io_uring is not available, using epoll");
+			delete loop->uring;
+			loop->uring = NULL;
+			useUring = false;
+		}
+	}
+	
+	if (loop->uring == NULL)
+	{
+		loop->epollfd = epoll_create(maxfd);
+		if (loop->epollfd < 0)
+		{
+			Log_Errno();
+			delete loop;
+			return NULL;
+		}
+	}
+	
+	if (!InitAsyncOp(loop, loop->asyncOp, ProcessAsyncOp))
+	{
+		delete loop;
+		return NULL;
+	}
+	
+	return loop;
 }
 
 bool IOProcessor::Add(IOOperation* ioop)
 {
 	uint32_t	filter;
+	IOLoop*		loop;
 	
 	if (ioop->active)
 		return true;
 	
+	loop = GetLoop();
+	if (loop != NULL && loop->uring != NULL)
+		return UringAdd(loop, ioop);
+	
+	// listeners are accepted from one by one by TCPServer, which does not
+	// tell when it runs out, so they are not edge-triggered
+	if (edgeTriggered && loop != NULL &&
+	 !(ioop->type == TCP_READ && ((TCPRead*) ioop)->listening))
+		return EdgeAdd(loop, ioop);
+	
 	if (ioop->pending)
 		return true;
 	
 	filter = EPOLLONESHOT;
 	if (ioop->type == TCP_READ || ioop->type == UDP_READ)
 		filter |= EPOLLIN;
-	else if (ioop->type == TCP_WRITE || ioop->type == UDP_WRITE)
+	else if (ioop->type == TCP_WRITE || ioop->type == UDP_WRITE ||
+			 ioop->type == TCP_SENDFILE)
 		filter |= EPOLLOUT;
 	
-	return AddEvent(ioop->fd, filter, ioop);
+	return AddEvent(loop, ioop->fd, filter, ioop);
 }
 
-bool AddEvent(int fd, uint32_t event, IOOperation* ioop)
+bool AddEvent(IOLoop* loop, int fd, uint32_t event, IOOperation* ioop)
 {
 	int					nev;
 	struct epoll_event	ev;
 	EpollOp				*epollOp;
 	bool				hasEvent;
 	
-	if (epollfd < 0)
+	if (loop == NULL || loop->epollfd < 0)
 	{
 		Log_Trace("epollfd < 0");
 		return false;
@@ -248,7 +486,7 @@ bool AddEvent(int fd, uint32_t event, IOOperation* ioop)
 	ev.data.ptr = epollOp;
 	
 	// add our interest in the event
-	nev = epoll_ctl(epollfd, hasEvent ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+	nev = epoll_ctl(loop->epollfd, hasEvent ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
 
     // If you add the same fd to an epoll_set twice, you
     // probably get EEXIST, but this is a harmless condition.
@@ -257,7 +495,7 @@ bool AddEvent(int fd, uint32_t event, IOOperation* ioop)
 		if (errno == EEXIST)
 		{
 			//Log_Trace("AddEvent: fd = %d exists", fd);
-			nev = epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev);
+			nev = epoll_ctl(loop->epollfd, EPOLL_CTL_MOD, fd, &ev);
 		}
 
 		if (nev < 0)
@@ -278,9 +516,17 @@ bool IOProcessor::Remove(IOOperation* ioop)
 	int					nev;
 	struct epoll_event	ev;
 	EpollOp*			epollOp;
+	IOLoop*				loop;
 	
 	if (!ioop->active)
 		return true;
+	
+	loop = GetLoop();
+	if (loop != NULL && epollOps[ioop->fd].edge)
+	{
+		EdgeRemove(loop, ioop);
+		return true;
+	}
 		
 	if (ioop->pending)
 	{
@@ -288,7 +534,10 @@ bool IOProcessor::Remove(IOOperation* ioop)
 		return true;
 	}
 	
-	if (epollfd < 0)
+	if (loop != NULL && loop->uring != NULL)
+		return UringRemove(loop, ioop);
+	
+	if (loop == NULL || loop->epollfd < 0)
 	{
 		Log_Trace("eventfd < 0");
 		return false;
@@ -314,9 +563,9 @@ bool IOProcessor::Remove(IOOperation* ioop)
 	}
 
 	if (epollOp->read || epollOp->write)
-		nev = epoll_ctl(epollfd, EPOLL_CTL_MOD, ioop->fd, &ev);
+		nev = epoll_ctl(loop->epollfd, EPOLL_CTL_MOD, ioop->fd, &ev);
 	else
-		nev = epoll_ctl(epollfd, EPOLL_CTL_DEL, ioop->fd, &ev /* ignored */);
+		nev = epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, ioop->fd, &ev /* ignored */);
 
 	if (nev < 0)
 	{
@@ -334,12 +583,20 @@ bool IOProcessor::Poll(int sleep)
 	
 	int							i, nevents;
 	int							ret, currentev, newfd = -1;
-	static struct epoll_event	events[MAX_EVENTS];
-	static struct epoll_event	newev;
+	struct epoll_event*			events;
+	struct epoll_event			newev;
 	IOOperation*				ioop;
 	EpollOp*					epollOp;
-		
-	nevents = epoll_wait(epollfd, events, SIZE(events), sleep);
+	IOLoop*						loop;
+	
+	loop = GetLoop();
+	if (loop->uring != NULL)
+		return UringPoll(loop, sleep);
+	if (edgeTriggered)
+		return EdgePoll(loop, sleep);
+	
+	events = loop->events;
+	nevents = epoll_wait(loop->epollfd, events, MAX_EVENTS, sleep);
 	EventLoop::UpdateTime();
 	
 	if (nevents < 0 || terminated)
@@ -372,11 +629,11 @@ bool IOProcessor::Poll(int sleep)
 		
 		if (newev.events)
 		{
-			if ((epollOp->read && epollOp->read->type != PIPEOP) ||
-				(epollOp->write && epollOp->write->type != PIPEOP))
+			if ((epollOp->read && epollOp->read->type != ASYNCOP) ||
+				(epollOp->write && epollOp->write->type != ASYNCOP))
 					newev.events |= EPOLLONESHOT;
 
-			ret = epoll_ctl(epollfd, EPOLL_CTL_MOD, newfd, &newev);
+			ret = epoll_ctl(loop->epollfd, EPOLL_CTL_MOD, newfd, &newev);
 			if (ret < 0)
 			{
 				Log_Errno();
@@ -402,11 +659,11 @@ bool IOProcessor::Poll(int sleep)
 			ioop = epollOp->read;
 			assert(ioop != NULL);
 			ioop->pending = false;
-			if (ioop->active && ioop->type == PIPEOP)
+			if (ioop->active && ioop->type == ASYNCOP)
 			{
-				// we never set pipeOps' read to NULL, they're special
-				PipeOp* pipeop = (PipeOp*) ioop;
-				pipeop->callback();
+				// we never set asyncOps' read to NULL, they're special
+				AsyncOp* asyncop = (AsyncOp*) ioop;
+				asyncop->callback();
 			}
 			else if (ioop->active)
 			{
@@ -421,7 +678,7 @@ bool IOProcessor::Poll(int sleep)
 			epollOp->write = NULL;
 			assert(ioop != NULL);
 			ioop->pending = false;
-			// we don't care about write notifications for pipeOps
+			// we don't care about write notifications for asyncOps
 			if (ioop->active)
 				ProcessIOOperation(ioop);
 		}		
@@ -430,13 +687,487 @@ bool IOProcessor::Poll(int sleep)
 	return true;
 }
 
+bool EdgeAdd(IOLoop* loop, IOOperation* ioop)
+{
+	struct epoll_event	ev;
+	EpollOp*			epollOp;
+	bool				ready;
+	int					nev;
+	
+	epollOp = &epollOps[ioop->fd];
+	if (IsRead(ioop))
+	{
+		epollOp->read = ioop;
+		ready = epollOp->readable;
+	}
+	else
+	{
+		epollOp->write = ioop;
+		ready = epollOp->writable;
+	}
+	ioop->active = true;
+	
+	// removed while it was ready, it is still on the list
+	if (ioop->pending)
+		return true;
+	
+	if (epollOp->edge)
+	{
+		if (ready)
+			PushReady(loop, ioop);
+		return true;
+	}
+	
+	// the fd is registered for both directions until it is closed, and the
+	// first wait reports its current readiness
+	ev.data.u64 = 0;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = epollOp;
+	
+	nev = epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, ioop->fd, &ev);
+	if (nev < 0 && errno == EEXIST)
+		nev = epoll_ctl(loop->epollfd, EPOLL_CTL_MOD, ioop->fd, &ev);
+	
+	if (nev < 0)
+	{
+		Log_Errno();
+		EdgeRemove(loop, ioop);
+		return false;
+	}
+	
+	epollOp->edge = true;
+	epollOp->readable = false;
+	epollOp->writable = false;
+	
+	return true;
+}
+
+void EdgeRemove(IOLoop* loop, IOOperation* ioop)
+{
+	EpollOp*		epollOp;
+	ReadyLink*		link;
+	
+	epollOp = &epollOps[ioop->fd];
+	if (IsRead(ioop) && epollOp->read == ioop)
+		epollOp->read = NULL;
+	else if (!IsRead(ioop) && epollOp->write == ioop)
+		epollOp->write = NULL;
+	ioop->active = false;
+	
+	// the op may be freed after this, so it is taken off the ready list
+	link = IsRead(ioop) ? &epollOp->readReady : &epollOp->writeReady;
+	if (link->linked && link->ioop == ioop)
+		UnlinkReady(loop, link);
+}
+
+bool EdgePoll(IOLoop* loop, int sleep)
+{
+	int					i, nevents, numReady;
+	int					currentev;
+	struct epoll_event*	events;
+	IOOperation*		ioop;
+	EpollOp*			epollOp;
+	ReadyLink*			link;
+	
+	events = loop->events;
+	
+	// the ready ops go on first, but every other round epoll is asked too,
+	// so that the other fds are not starved
+	nevents = 0;
+	if (loop->readyHead == NULL || !loop->waited)
+	{
+		nevents = epoll_wait(loop->epollfd, events, MAX_EVENTS,
+		 loop->readyHead == NULL ? sleep : 0);
+		loop->waited = true;
+		EventLoop::UpdateTime();
+		
+		if (nevents < 0 || terminated)
+		{
+			Log_Errno();
+			return false;
+		}
+	}
+	else
+		loop->waited = false;
+	
+	for (i = 0; i < nevents; i++)
+	{
+		currentev = events[i].events;
+		epollOp = (EpollOp*) events[i].data.ptr;
+		
+		if (!epollOp->edge)
+		{
+			// listeners and the eventfd
+			if (epollOp->read && !epollOp->read->pending)
+				PushReady(loop, epollOp->read);
+			continue;
+		}
+		
+		if (currentev & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		{
+			epollOp->readable = true;
+			if (epollOp->read && !epollOp->read->pending)
+				PushReady(loop, epollOp->read);
+		}
+		if (currentev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+		{
+			epollOp->writable = true;
+			if (epollOp->write && !epollOp->write->pending)
+				PushReady(loop, epollOp->write);
+		}
+	}
+	
+	// the ops made ready by the callbacks wait for the next round
+	numReady = loop->numReady;
+	for (i = 0; i < numReady && loop->readyHead != NULL; i++)
+	{
+		link = loop->readyHead;
+		ioop = link->ioop;
+		UnlinkReady(loop, link);
+		
+		if (!ioop->active)
+			continue;
+		
+		if (ioop->type == ASYNCOP)
+		{
+			((AsyncOp*) ioop)->callback();
+			continue;
+		}
+		
+		epollOp = &epollOps[ioop->fd];
+		if (IsRead(ioop))
+			epollOp->read = NULL;
+		else
+			epollOp->write = NULL;
+		ProcessIOOperation(ioop);
+	}
+	
+	return true;
+}
+
+void PushReady(IOLoop* loop, IOOperation* ioop)
+{
+	EpollOp*	epollOp;
+	ReadyLink*	link;
+	
+	epollOp = &epollOps[ioop->fd];
+	link = IsRead(ioop) ? &epollOp->readReady : &epollOp->writeReady;
+	if (link->linked)
+		UnlinkReady(loop, link);
+	
+	ioop->pending = true;
+	link->ioop = ioop;
+	link->linked = true;
+	link->next = NULL;
+	link->prev = loop->readyTail;
+	if (loop->readyTail)
+		loop->readyTail->next = link;
+	else
+		loop->readyHead = link;
+	loop->readyTail = link;
+	loop->numReady++;
+}
+
+void UnlinkReady(IOLoop* loop, ReadyLink* link)
+{
+	if (link->prev)
+		link->prev->next = link->next;
+	else
+		loop->readyHead = link->next;
+	if (link->next)
+		link->next->prev = link->prev;
+	else
+		loop->readyTail = link->prev;
+	loop->numReady--;
+	
+	link->ioop->pending = false;
+	link->ioop = NULL;
+	link->prev = NULL;
+	link->next = NULL;
+	link->linked = false;
+}
+
+void NotReady(IOOperation* ioop)
+{
+	EpollOp* epollOp;
+	
+	// the next edge will tell when the transfer can go on
+	epollOp = &epollOps[ioop->fd];
+	if (!epollOp->edge)
+		return;
+	
+	if (IsRead(ioop))
+		epollOp->readable = false;
+	else
+		epollOp->writable = false;
+}
+
+bool IsRead(IOOperation* ioop)
+{
+	return (ioop->type == TCP_READ || ioop->type == UDP_READ ||
+	 ioop->type == ASYNCOP);
+}
+
+bool UringAdd(IOLoop* loop, IOOperation* ioop)
+{
+	struct io_uring_sqe*	sqe;
+	TCPRead*				tcpread;
+	TCPWrite*				tcpwrite;
+	int						readlen;
+	
+	// reads and writes of TCP data are done by the kernel, the rest of the
+	// ops only wait for readiness like with epoll, including segmented
+	// writes, which are gathered by writev() when the socket is writable
+	readlen = 0;
+	if (ioop->type == TCP_READ && !((TCPRead*) ioop)->listening)
+		readlen = TCPReadLength((TCPRead*) ioop);
+	
+	if (readlen <= 0 && !(ioop->type == TCP_WRITE && ioop->data.length > 0 &&
+	 ((TCPWrite*) ioop)->segments == NULL))
+		return UringArmPoll(loop, ioop);
+	
+	sqe = loop->uring->GetSQE();
+	if (sqe == NULL)
+	{
+		Log_Message("io_uring submission queue is full");
+		return false;
+	}
+	
+	sqe->fd = ioop->fd;
+	sqe->user_data = (uint64_t) ioop;
+	if (ioop->type == TCP_READ)
+	{
+		tcpread = (TCPRead*) ioop;
+		sqe->opcode = IORING_OP_RECV;
+		sqe->addr = (uint64_t) (tcpread->data.buffer + tcpread->data.length);
+		sqe->len = readlen;
+	}
+	else
+	{
+		tcpwrite = (TCPWrite*) ioop;
+		sqe->opcode = IORING_OP_SEND;
+		sqe->addr = (uint64_t) (tcpwrite->data.buffer + tcpwrite->transferred);
+		sqe->len = tcpwrite->data.length - tcpwrite->transferred;
+	}
+	
+	ioop->active = true;
+	
+	return true;
+}
+
+bool UringArmPoll(IOLoop* loop, IOOperation* ioop)
+{
+	struct io_uring_sqe*	sqe;
+	
+	sqe = loop->uring->GetSQE();
+	if (sqe == NULL)
+	{
+		Log_Message("io_uring submission queue is full");
+		return false;
+	}
+	
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = ioop->fd;
+	sqe->user_data = (uint64_t) ioop | URING_POLL;
+	if (ioop->type == TCP_READ || ioop->type == UDP_READ || ioop->type == ASYNCOP)
+		sqe->poll32_events = POLLIN;
+	else
+		sqe->poll32_events = POLLOUT;
+	
+	ioop->active = true;
+	
+	return true;
+}
+
+bool UringRemove(IOLoop* loop, IOOperation* ioop)
+{
+	struct io_uring_sqe*	sqe;
+	struct io_uring_cqe		cqe;
+	struct io_uring_cqe*	deferred;
+	unsigned				i, num, wait;
+	
+	ioop->active = false;
+	
+	// the op may have completed already
+	deferred = (struct io_uring_cqe*) loop->deferred.buffer;
+	num = loop->deferred.length / sizeof(struct io_uring_cqe);
+	for (i = 0; i < num; i++)
+	{
+		if ((deferred[i].user_data & ~(uint64_t) URING_FLAGS) == (uint64_t) ioop)
+		{
+			loop->deferred.Remove(i * sizeof(cqe), sizeof(cqe));
+			return true;
+		}
+	}
+	
+	// the kernel may use the buffer of the op until its completion arrives,
+	// so wait for it and for the cancellations, keeping the other completions
+	for (i = 0; i < 2; i++)
+	{
+		sqe = loop->uring->GetSQE();
+		if (sqe == NULL)
+		{
+			Log_Message("io_uring submission queue is full");
+			return false;
+		}
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = (uint64_t) ioop | (i == 0 ? 0 : URING_POLL);
+		sqe->user_data = (uint64_t) ioop | URING_CANCEL;
+	}
+	
+	wait = 3;
+	while (wait > 0)
+	{
+		if (loop->uring->Enter(1, -1) < 0)
+		{
+			Log_Errno();
+			return false;
+		}
+		
+		while (loop->uring->GetCQE(cqe))
+		{
+			if ((cqe.user_data & ~(uint64_t) URING_FLAGS) == (uint64_t) ioop)
+				wait--;
+			else
+				loop->deferred.Append(&cqe, sizeof(cqe));
+		}
+	}
+	
+	return true;
+}
+
+bool UringPoll(IOLoop* loop, int sleep)
+{
+	struct io_uring_cqe	cqe;
+	int					ret;
+	
+	// the ops added since the last call are submitted with the same
+	// system call that waits for the completions
+	ret = loop->uring->Enter(loop->deferred.length > 0 ? 0 : 1, sleep);
+	EventLoop::UpdateTime();
+	
+	if (ret < 0 || terminated)
+	{
+		Log_Errno();
+		return false;
+	}
+	
+	// completions are taken one by one, because a callback may remove an op
+	// whose completion is still in the ring
+	while (true)
+	{
+		if (loop->deferred.length > 0)
+		{
+			memcpy(&cqe, loop->deferred.buffer, sizeof(cqe));
+			loop->deferred.Remove(0, sizeof(cqe));
+		}
+		else if (!loop->uring->GetCQE(cqe))
+			break;
+		
+		UringComplete(loop, cqe);
+	}
+	
+	return true;
+}
+
+void UringComplete(IOLoop* loop, struct io_uring_cqe& cqe)
+{
+	IOOperation*	ioop;
+	
+	if (cqe.user_data & URING_CANCEL)
+		return;
+	
+	ioop = (IOOperation*) (cqe.user_data & ~(uint64_t) URING_FLAGS);
+	if (ioop->type == ASYNCOP)
+	{
+		UringArmPoll(loop, ioop);
+		((AsyncOp*) ioop)->callback();
+		return;
+	}
+	
+	if (!ioop->active)
+		return;
+	
+	if (cqe.user_data & URING_POLL)
+	{
+		ProcessIOOperation(ioop);
+		return;
+	}
+	
+	// older kernels do not wait for non-blocking sockets
+	if (cqe.res == -EAGAIN)
+	{
+		UringArmPoll(loop, ioop);
+		return;
+	}
+	
+	ioop->active = false;
+	if (cqe.res < 0)
+		errno = -cqe.res;
+	
+	if (ioop->type == TCP_READ)
+		OnTCPRead((TCPRead*) ioop, cqe.res < 0 ? -1 : cqe.res);
+	else
+		OnTCPWrite((TCPWrite*) ioop, cqe.res < 0 ? -1 : cqe.res);
+}
+
+// called by Socket before closing the fd
+bool IOProcessorUnregisterSocket(FD& fd)
+{
+	EpollOp* epollOp;
+	
+	if (epollOps == NULL || fd < 0 || fd >= maxfd)
+		return true;
+	
+	// closing the fd takes it out of the epoll set, a new fd with the same
+	// number has to be registered again
+	epollOp = &epollOps[fd];
+	if (epollOp->readReady.linked)
+		UnlinkReady(GetLoop(), &epollOp->readReady);
+	if (epollOp->writeReady.linked)
+		UnlinkReady(GetLoop(), &epollOp->writeReady);
+	if (epollOp->edge)
+		*epollOp = EpollOp();
+	
+	return true;
+}
+
 bool IOProcessor::Complete(Callable* callable)
+{
+	return Complete(callable, IO_MAIN_LOOP);
+}
+
+bool IOProcessor::Complete(Callable* callable, int loopID)
 {
 	Log_Trace();
 	
-	int nwrite;
+	IOLoop*		loop;
+	Completion*	completion;
+	uint64_t	value;
+	int			nwrite;
 	
-	nwrite = write(asyncPipeOp.pipe[1], &callable, sizeof(Callable*));
+	loop = loops[loopID];
+	if (freeGeneration != completionsGeneration)
+	{
+		freeGeneration = completionsGeneration;
+		freeCompletions = NULL;
+	}
+	if (freeCompletions == NULL)
+		freeCompletions = loop->pool.Get();
+	if (freeCompletions == NULL)
+		freeCompletions = NewCompletion();
+	completion = freeCompletions;
+	freeCompletions = completion->next;
+	completion->callable = callable;
+	
+	// the loop is only woken up when the queue becomes non-empty, it takes
+	// everything queued until then at once
+	if (!loop->completions.Push(completion))
+		return true;
+	
+	value = 1;
+	nwrite = write(loop->asyncOp.fd, &value, sizeof(value));
 	if (nwrite < 0)
 	{
 		Log_Errno();
@@ -446,6 +1177,16 @@ bool IOProcessor::Complete(Callable* callable)
 	return true;
 }
 
+Completion* NewCompletion()
+{
+	Completion* completion;
+	
+	// only when more are queued than were processed so far
+	completion = new Completion;
+	allocatedCompletions.Push(completion);
+	return completion;
+}
+
 void ProcessIOOperation(IOOperation* ioop)
 {
 	ioop->active = false;
@@ -461,6 +1202,9 @@ void ProcessIOOperation(IOOperation* ioop)
 	case TCP_WRITE:
 		ProcessTCPWrite((TCPWrite*) ioop);
 		break;
+	case TCP_SENDFILE:
+		ProcessTCPSendFile((TCPSendFile*) ioop);
+		break;
 	case UDP_READ:
 		ProcessUDPRead((UDPRead*) ioop);
 		break;
@@ -470,26 +1214,28 @@ void ProcessIOOperation(IOOperation* ioop)
 	}
 }
 
-#define MAX_CALLABLE 256	
 void ProcessAsyncOp()
 {
 	Log_Trace();
 
-	Callable* callables[MAX_CALLABLE];
-	int nread;
-	int count;
-	int i;
+	IOLoop*		loop;
+	Completion*	completion;
+	Completion*	next;
+	Callable*	callable;
+	uint64_t	value;
 	
-	while (true)
+	// the eventfd is reset before taking the queue, so a completion pushed
+	// after Get() rings it again
+	loop = GetLoop();
+	if (read(loop->asyncOp.fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		Log_Errno();
+	
+	for (completion = loop->completions.Get(); completion != NULL; completion = next)
 	{
-		nread = read(asyncPipeOp.pipe[0], callables, SIZE(callables));
-		count = nread / sizeof(Callable*);
-		
-		for (i = 0; i < count; i++)
-			Call(callables[i]);
-		
-		if (count < (int) SIZE(callables))
-			break;
+		next = completion->next;
+		callable = completion->callable;
+		loop->pool.Push(completion);
+		Call(callable);
 	}
 }
 
@@ -503,11 +1249,7 @@ void ProcessTCPRead(TCPRead* tcpread)
 		return;
 	}
 	
-	if (tcpread->requested == IO_READ_ANY)
-		readlen = tcpread->data.size - tcpread->data.length;
-	else
-		readlen = tcpread->requested - tcpread->data.length;
-	
+	readlen = TCPReadLength(tcpread);
 	if (readlen <= 0)
 		return;
 
@@ -515,10 +1257,28 @@ void ProcessTCPRead(TCPRead* tcpread)
 				 tcpread->data.buffer + tcpread->data.length,
 				 readlen);
 	
+	// a short read drained the socket
+	if (nread >= 0 && nread < readlen)
+		NotReady(tcpread);
+	
+	OnTCPRead(tcpread, nread);
+}
+
+int TCPReadLength(TCPRead* tcpread)
+{
+	if (tcpread->requested == IO_READ_ANY)
+		return tcpread->data.size - tcpread->data.length;
+	else
+		return tcpread->requested - tcpread->data.length;
+}
+
+void OnTCPRead(TCPRead* tcpread, int nread)
+{
 	if (nread < 0)
 	{
 		if (errno == EWOULDBLOCK || errno == EAGAIN)
 		{
+			NotReady(tcpread);
 			IOProcessor::Add(tcpread);
 		}
 		else
@@ -570,14 +1330,53 @@ void ProcessTCPWrite(TCPWrite* tcpwrite)
 		ASSERT_FAIL();
 	}
 	
-	nwrite = write(tcpwrite->fd,
-				   tcpwrite->data.buffer + tcpwrite->transferred,
-				   writelen);
-				   
+	if (tcpwrite->segments != NULL)
+		nwrite = WriteSegments(tcpwrite);
+	else
+		nwrite = write(tcpwrite->fd,
+					   tcpwrite->data.buffer + tcpwrite->transferred,
+					   writelen);
+	
+	// a short write filled the socket buffer
+	if (nwrite >= 0 && nwrite < writelen)
+		NotReady(tcpwrite);
+	
+	OnTCPWrite(tcpwrite, nwrite);
+}
+
+int WriteSegments(TCPWrite* tcpwrite)
+{
+	struct iovec	iov[TCP_MAX_SEGMENTS];
+	unsigned		skip;
+	int				i, n;
+	
+	// the segments are passed to the kernel at once, leaving out the
+	// first 'transferred' bytes already written
+	skip = tcpwrite->transferred;
+	for (i = 0, n = 0; i < tcpwrite->numSegments; i++)
+	{
+		if (skip >= tcpwrite->segments[i].length)
+		{
+			skip -= tcpwrite->segments[i].length;
+			continue;
+		}
+		
+		iov[n].iov_base = tcpwrite->segments[i].buffer + skip;
+		iov[n].iov_len = tcpwrite->segments[i].length - skip;
+		skip = 0;
+		n++;
+	}
+	
+	return writev(tcpwrite->fd, iov, n);
+}
+
+void OnTCPWrite(TCPWrite* tcpwrite, int nwrite)
+{
 	if (nwrite < 0)
 	{
 		if (errno == EWOULDBLOCK || errno == EAGAIN)
 		{
+			NotReady(tcpwrite);
 			IOProcessor::Add(tcpwrite);
 		}
 		else
@@ -600,6 +1399,50 @@ void ProcessTCPWrite(TCPWrite* tcpwrite)
 	}
 }
 
+void ProcessTCPSendFile(TCPSendFile* tcpsendfile)
+{
+	off_t	offset;
+	ssize_t	nwrite;
+	
+	if (tcpsendfile->transferred >= tcpsendfile->length)
+	{
+		ASSERT_FAIL();
+	}
+	
+	offset = (off_t) (tcpsendfile->fileOffset + tcpsendfile->transferred);
+	nwrite = sendfile(tcpsendfile->fd,
+					  tcpsendfile->file,
+					  &offset,
+					  tcpsendfile->length - tcpsendfile->transferred);
+
+	if (nwrite < 0)
+	{
+		if (errno == EWOULDBLOCK || errno == EAGAIN)
+		{
+			NotReady(tcpsendfile);
+			IOProcessor::Add(tcpsendfile);
+		}
+		else
+		{
+			Log_Errno();
+			Call(tcpsendfile->onClose);
+		}
+	}
+	else if (nwrite == 0)
+	{
+		// the file is shorter than expected
+		Call(tcpsendfile->onClose);
+	}
+	else
+	{
+		tcpsendfile->transferred += nwrite;
+		if (tcpsendfile->transferred == tcpsendfile->length)
+			Call(tcpsendfile->onComplete);
+		else
+			IOProcessor::Add(tcpsendfile);
+	}
+}
+
 void ProcessUDPRead(UDPRead* udpread)
 {
 	int			nread;
@@ -618,6 +1461,7 @@ void ProcessUDPRead(UDPRead* udpread)
 		{
 			if (errno == EWOULDBLOCK || errno == EAGAIN)
 			{
+				NotReady(udpread);
 				IOProcessor::Add(udpread); // try again
 			}
 			else
@@ -654,6 +1498,7 @@ void ProcessUDPWrite(UDPWrite* udpwrite)
 	{
 		if (errno == EWOULDBLOCK || errno == EAGAIN)
 		{
+			NotReady(udpwrite);
 			IOProcessor::Add(udpwrite); // try again
 		}
 		else
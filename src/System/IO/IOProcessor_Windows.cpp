@@ -43,6 +43,7 @@ static LPFN_CONNECTEX	ConnectEx;
 bool ProcessTCPRead(TCPRead* tcpread);
 bool ProcessUDPRead(UDPRead* udpread);
 bool ProcessTCPWrite(TCPWrite* tcpwrite);
+DWORD FillWSABufs(TCPWrite* tcpwrite, WSABUF* wsabufs, unsigned maxlen);
 bool ProcessUDPWrite(UDPWrite* udpwrite);
 
 
@@ -154,7 +155,7 @@ BOOL WINAPI ConsoleCtrlHandler(DWORD /*ctrlType*/)
 	return TRUE;
 }
 
-bool IOProcessor::Init(int maxfd, bool blockSignals)
+bool IOProcessor::Init(int maxfd, bool blockSignals, int /*flags*/)
 {
 	WSADATA		wsaData;
 	SOCKET		s;
@@ -218,6 +219,26 @@ void IOProcessor::Shutdown()
 
 }
 
+// only the main loop is supported on this platform
+int IOProcessor::CreateLoop()
+{
+	Log_Message("Event loop threads are not supported on this platform");
+	return -1;
+}
+
+void IOProcessor::DeleteLoop(int /*loopID*/)
+{
+}
+
+void IOProcessor::SetThreadLoop(int /*loopID*/)
+{
+}
+
+int IOProcessor::GetThreadLoop()
+{
+	return IO_MAIN_LOOP;
+}
+
 static bool RequestReadNotification(IOOperation* ioop)
 {
 	DWORD	numBytes, flags;
@@ -539,6 +560,11 @@ bool IOProcessor::Complete(Callable *callable)
 	return true;
 }
 
+bool IOProcessor::Complete(Callable* callable, int /*loopID*/)
+{
+	return Complete(callable);
+}
+
 bool ProcessTCPRead(TCPRead* tcpread)
 {
 	BOOL		ret;
@@ -638,10 +664,46 @@ bool ProcessUDPRead(UDPRead* udpread)
 	return true;
 }
 
+DWORD FillWSABufs(TCPWrite* tcpwrite, WSABUF* wsabufs, unsigned maxlen)
+{
+	unsigned	skip;
+	unsigned	len;
+	int			i;
+	DWORD		n;
+
+	if (tcpwrite->segments == NULL)
+	{
+		wsabufs[0].buf = (char*) tcpwrite->data.buffer + tcpwrite->transferred;
+		wsabufs[0].len = MIN(tcpwrite->data.length - tcpwrite->transferred, maxlen);
+		return 1;
+	}
+
+	// gather the segments after the first 'transferred' bytes already sent
+	skip = tcpwrite->transferred;
+	for (i = 0, n = 0; i < tcpwrite->numSegments && maxlen > 0; i++)
+	{
+		if (skip >= tcpwrite->segments[i].length)
+		{
+			skip -= tcpwrite->segments[i].length;
+			continue;
+		}
+
+		len = MIN(tcpwrite->segments[i].length - skip, maxlen);
+		wsabufs[n].buf = (char*) tcpwrite->segments[i].buffer + skip;
+		wsabufs[n].len = len;
+		maxlen -= len;
+		skip = 0;
+		n++;
+	}
+
+	return n;
+}
+
 bool ProcessTCPWrite(TCPWrite* tcpwrite)
 {
 	BOOL		ret;
-	WSABUF		wsabuf;
+	WSABUF		wsabufs[TCP_MAX_SEGMENTS];
+	DWORD		numBufs;
 	Callable*	callable;
 	DWORD		numBytes;
 	DWORD		error;
@@ -653,13 +715,12 @@ bool ProcessTCPWrite(TCPWrite* tcpwrite)
 	else
 	{
 		// handle tcp write partial writes
-		wsabuf.buf = (char*) tcpwrite->data.buffer + tcpwrite->transferred;
 		// the -1 is actually a windows bug, for more info see:
 		// http://support.microsoft.com/kb/823764/EN-US/
-		wsabuf.len = MIN(tcpwrite->data.length - tcpwrite->transferred, SEND_BUFFER_SIZE - 1);
+		numBufs = FillWSABufs(tcpwrite, wsabufs, SEND_BUFFER_SIZE - 1);
 
 		// perform non-blocking write
-		ret = WSASend(tcpwrite->fd.sock, &wsabuf, 1, &numBytes, 0, NULL, NULL);
+		ret = WSASend(tcpwrite->fd.sock, wsabufs, numBufs, &numBytes, 0, NULL, NULL);
 		if (ret != 0)
 		{
 			error = GetLastError();
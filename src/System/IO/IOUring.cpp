@@ -0,0 +1,216 @@
+#ifdef PLATFORM_LINUX
+
+#include "IOUring.h"
+#include "System/Log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete,
+ unsigned flags, void* arg, size_t argsz)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+	 flags, arg, argsz);
+}
+
+IOUring::IOUring()
+{
+	fd = -1;
+	sqRing = MAP_FAILED;
+	cqRing = MAP_FAILED;
+	sqes = (struct io_uring_sqe*) MAP_FAILED;
+}
+
+IOUring::~IOUring()
+{
+	Close();
+}
+
+bool IOUring::Init(unsigned entries)
+{
+	struct io_uring_params	params;
+	unsigned char*			sq;
+	unsigned char*			cq;
+
+	memset(&params, 0, sizeof(params));
+	fd = io_uring_setup(entries, &params);
+	if (fd < 0)
+	{
+		Log_Errno();
+		return false;
+	}
+
+	// waiting with a timeout needs the extended arguments of io_uring_enter,
+	// and completions must not be dropped when the CQ ring is full
+	if (!(params.features & IORING_FEAT_EXT_ARG) ||
+	 !(params.features & IORING_FEAT_NODROP))
+	{
+		Log_Message("io_uring lacks required features");
+		Close();
+		return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes +
+	 params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (cqRingSize > sqRingSize)
+			sqRingSize = cqRingSize;
+		cqRingSize = sqRingSize;
+	}
+
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+	 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		Log_Errno();
+		Close();
+		return false;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		cq = (unsigned char*) sqRing;
+	else
+	{
+		cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED)
+		{
+			Log_Errno();
+			Close();
+			return false;
+		}
+		cq = (unsigned char*) cqRing;
+	}
+
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = (struct io_uring_sqe*) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+	 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		Log_Errno();
+		Close();
+		return false;
+	}
+
+	sq = (unsigned char*) sqRing;
+	sqHeadPtr = (unsigned*) (sq + params.sq_off.head);
+	sqTailPtr = (unsigned*) (sq + params.sq_off.tail);
+	sqArray = (unsigned*) (sq + params.sq_off.array);
+	sqMask = *(unsigned*) (sq + params.sq_off.ring_mask);
+	sqEntries = params.sq_entries;
+	sqTail = *sqTailPtr;
+	sqSubmitted = sqTail;
+
+	cqHeadPtr = (unsigned*) (cq + params.cq_off.head);
+	cqTailPtr = (unsigned*) (cq + params.cq_off.tail);
+	cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+	cqMask = *(unsigned*) (cq + params.cq_off.ring_mask);
+
+	return true;
+}
+
+void IOUring::Close()
+{
+	if (sqes != MAP_FAILED)
+		munmap(sqes, sqesSize);
+	if (cqRing != MAP_FAILED)
+		munmap(cqRing, cqRingSize);
+	if (sqRing != MAP_FAILED)
+		munmap(sqRing, sqRingSize);
+	if (fd >= 0)
+		close(fd);
+
+	fd = -1;
+	sqRing = MAP_FAILED;
+	cqRing = MAP_FAILED;
+	sqes = (struct io_uring_sqe*) MAP_FAILED;
+}
+
+struct io_uring_sqe* IOUring::GetSQE()
+{
+	struct io_uring_sqe*	sqe;
+	unsigned				head;
+
+	head = __atomic_load_n(sqHeadPtr, __ATOMIC_ACQUIRE);
+	if (sqTail - head >= sqEntries)
+	{
+		// the ring is full, pass the queued entries to the kernel now
+		Enter(0, 0);
+		head = __atomic_load_n(sqHeadPtr, __ATOMIC_ACQUIRE);
+		if (sqTail - head >= sqEntries)
+			return NULL;
+	}
+
+	sqe = &sqes[sqTail & sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqArray[sqTail & sqMask] = sqTail & sqMask;
+	sqTail++;
+
+	return sqe;
+}
+
+int IOUring::Enter(unsigned minComplete, int msec)
+{
+	struct io_uring_getevents_arg	arg;
+	struct __kernel_timespec		ts;
+	unsigned						toSubmit;
+	unsigned						flags;
+	int								ret;
+
+	__atomic_store_n(sqTailPtr, sqTail, __ATOMIC_RELEASE);
+	toSubmit = sqTail - sqSubmitted;
+
+	flags = IORING_ENTER_EXT_ARG;
+	if (minComplete > 0)
+		flags |= IORING_ENTER_GETEVENTS;
+
+	memset(&arg, 0, sizeof(arg));
+	if (msec >= 0)
+	{
+		ts.tv_sec = msec / 1000;
+		ts.tv_nsec = (msec % 1000) * 1000000L;
+		arg.ts = (uint64_t) &ts;
+	}
+
+	ret = io_uring_enter(fd, toSubmit, minComplete, flags, &arg, sizeof(arg));
+	if (ret >= 0)
+		sqSubmitted += ret;
+	else if (errno == EBUSY || errno == EAGAIN)
+	{
+		// completions are to be reaped before more can be submitted
+		ret = 0;
+	}
+	else if (errno == ETIME || errno == EINTR)
+		ret = 0;
+
+	return ret;
+}
+
+bool IOUring::GetCQE(struct io_uring_cqe& cqe)
+{
+	unsigned	head;
+	unsigned	tail;
+
+	head = *cqHeadPtr;
+	tail = __atomic_load_n(cqTailPtr, __ATOMIC_ACQUIRE);
+	if (head == tail)
+		return false;
+
+	cqe = cqes[head & cqMask];
+	__atomic_store_n(cqHeadPtr, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+#endif // PLATFORM_LINUX
@@ -0,0 +1,58 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#ifdef PLATFORM_LINUX
+
+#include <linux/io_uring.h>
+#include "System/Platform.h"
+
+#define IOURING_ENTRIES		1024
+
+/*
+ * IOUring is a thin wrapper of the io_uring system calls: the SQEs
+ * taken with GetSQE() are only passed to the kernel by the next Enter(),
+ * together with waiting for completions, so a whole round of the event
+ * loop costs one system call. Completions are read with GetCQE().
+ */
+
+class IOUring
+{
+public:
+	IOUring();
+	~IOUring();
+
+	bool					Init(unsigned entries);
+	void					Close();
+
+	struct io_uring_sqe*	GetSQE();
+	int						Enter(unsigned minComplete, int msec);
+	bool					GetCQE(struct io_uring_cqe& cqe);
+
+	unsigned				NumQueued() { return sqTail - sqSubmitted; }
+
+private:
+	int						fd;
+	void*					sqRing;
+	size_t					sqRingSize;
+	void*					cqRing;
+	size_t					cqRingSize;
+	struct io_uring_sqe*	sqes;
+	size_t					sqesSize;
+
+	unsigned*				sqHeadPtr;
+	unsigned*				sqTailPtr;
+	unsigned*				sqArray;
+	unsigned				sqMask;
+	unsigned				sqEntries;
+	unsigned				sqTail;
+	unsigned				sqSubmitted;
+
+	unsigned*				cqHeadPtr;
+	unsigned*				cqTailPtr;
+	struct io_uring_cqe*	cqes;
+	unsigned				cqMask;
+};
+
+#endif // PLATFORM_LINUX
+
+#endif
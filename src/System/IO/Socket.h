@@ -19,6 +19,7 @@ public:
 
 	bool		SetNonblocking();
 	bool		SetNodelay();
+	bool		SetReusePort();
 
 	bool		Bind(int port);
 	bool		Bind(const Endpoint& endpoint);
@@ -11,6 +11,12 @@
 #include <unistd.h>
 #include <errno.h>
 
+/*
+ * the IOProcessor keeps the fds registered in edge-triggered mode,
+ * it is told when one is closed
+ */
+bool IOProcessorUnregisterSocket(FD& fd);
+
 #ifndef INADDR_NONE
 #define INADDR_NONE 0xffffffff
 #endif
@@ -100,6 +106,35 @@ bool Socket::SetNodelay()
 	return true;
 }
 
+bool Socket::SetReusePort()
+{
+#ifdef SO_REUSEPORT
+	int		ret;
+	int		sockopt;
+
+	if (fd < 0)
+	{
+		Log_Trace("SetReusePort on invalid file descriptor");
+		return false;
+	}
+	
+	// several sockets listen on the same port, the kernel spreads the
+	// connections between them
+	sockopt = 1;
+	ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt));
+	if (ret < 0)
+	{
+		Log_Errno();
+		return false;
+	}
+	
+	return true;
+#else
+	Log_Message("SO_REUSEPORT is not supported on this platform");
+	return false;
+#endif
+}
+
 bool Socket::Bind(int port)
 {
 	int					ret;
@@ -324,6 +359,7 @@ void Socket::Close()
 	
 	if (fd != -1)
 	{
+		IOProcessorUnregisterSocket(fd);
 		ret = close(fd);
 
 		if (ret < 0)
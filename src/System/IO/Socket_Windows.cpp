@@ -143,6 +143,12 @@ bool Socket::SetNodelay()
 	
 }
 
+bool Socket::SetReusePort()
+{
+	Log_Message("SO_REUSEPORT is not supported on this platform");
+	return false;
+}
+
 
 bool Socket::Listen(int port, int backlog)
 {
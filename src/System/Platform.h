@@ -36,11 +36,15 @@ typedef unsigned __int64	uint64_t;
 
 #define localtime_r(t, tm)	localtime_s(tm, t)
 
+#define THREAD_LOCAL		__declspec(thread)
+
 
 #else
 #include <stdint.h>
 #include <inttypes.h>
 #include <unistd.h>
+
+#define THREAD_LOCAL		__thread
 #endif
 
 // PLATFORM_STRING selection
@@ -0,0 +1,77 @@
+#include "Test.h"
+#include "System/Events/Callable.h"
+#include "System/Events/EventLoop.h"
+#include "System/IO/IOProcessor.h"
+#include "System/ThreadPool.h"
+#include "System/Time.h"
+
+#define NUM_THREADS			4
+#define NUM_COMPLETIONS		1000000
+
+// worker threads hand completions back to the event loop, like the
+// database threads do
+
+class CompletionBenchmark
+{
+public:
+	CompletionBenchmark() :
+	onWork(this, &CompletionBenchmark::Work),
+	onComplete(this, &CompletionBenchmark::OnComplete)
+	{
+		numCompleted = 0;
+	}
+
+	void Work()
+	{
+		int i;
+
+		for (i = 0; i < NUM_COMPLETIONS / NUM_THREADS; i++)
+			IOProcessor::Complete(&onComplete);
+	}
+
+	void OnComplete()
+	{
+		if (++numCompleted == NUM_COMPLETIONS)
+			EventLoop::Stop();
+	}
+
+	int								numCompleted;
+	MFunc<CompletionBenchmark>		onWork;
+	MFunc<CompletionBenchmark>		onComplete;
+};
+
+int CompletionThroughputBenchmark()
+{
+	CompletionBenchmark	benchmark;
+	ThreadPool*			threads;
+	uint64_t			start;
+	uint64_t			elapsed;
+	int					i;
+
+	if (!IOProcessor::Init(1024, false))
+		return TEST_FAILURE;
+	EventLoop::Init();
+
+	threads = ThreadPool::Create(NUM_THREADS);
+	threads->Start();
+
+	start = NowMicro();
+	for (i = 0; i < NUM_THREADS; i++)
+		threads->Execute(&benchmark.onWork);
+	EventLoop::Run();
+	elapsed = NowMicro() - start;
+
+	threads->Stop();
+	delete threads;
+
+	TEST_LOG("%d threads, %d completions: %" PRIu64 " usec, %.0f/sec",
+			 NUM_THREADS, NUM_COMPLETIONS, elapsed,
+			 NUM_COMPLETIONS * 1000000.0 / (elapsed ? elapsed : 1));
+
+	EventLoop::Shutdown();
+	IOProcessor::Shutdown();
+
+	return TEST_SUCCESS;
+}
+
+TEST_MAIN(CompletionThroughputBenchmark);
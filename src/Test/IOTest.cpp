@@ -1,94 +1,245 @@
-#include <fcntl.h>
-#include <signal.h>
-#include <stdlib.h>
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 
+#include "Test.h"
+#include "System/Events/Callable.h"
 #include "System/Events/EventLoop.h"
+#include "System/IO/IOProcessor.h"
+#include "System/IO/Socket.h"
+#include "System/Time.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define NUM_REQUESTS		20000
+#define REQUEST_SIZE		32
+
+// request-response round trips over one connection, like a client of
+// KeyspaceConn; the system calls of the event loop thread are counted
+// by wrapping the libc functions
 
-IOProcessor* ioproc;
-ByteArray<32> ba;
-FileWrite fw;
-FileRead fr;
-char c = 'a';
+static THREAD_LOCAL bool	counting = false;
+static unsigned				numEpollCtl;
+static unsigned				numEpollWait;
+static unsigned				numRead;
+static unsigned				numWrite;
 
-void OnFileWrite()
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
 {
-	if (c++ < 'z')
-	{
-		for (int i = 0; i < ba.size - 1; i++)
-			ba.buffer[i] = c;
-		ba.buffer[ba.size - 1] = '\n';
-		
-		fw.offset += fw.nbytes;
-		ioproc->Add(&fw);
-	}
-	else
-	{
-		exit(0);
-	}
+	static int (*real)(int, int, int, struct epoll_event*) = NULL;
+
+	if (real == NULL)
+		real = (int (*)(int, int, int, struct epoll_event*)) dlsym(RTLD_NEXT, "epoll_ctl");
+	if (counting)
+		numEpollCtl++;
+	return real(epfd, op, fd, event);
 }
 
-void OnFileRead()
+extern "C" int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout)
 {
-	if (fr.data.length < 1)
-		exit(0);
-		
-	printf("%d, %.32s", fr.data.length, fr.data.buffer);
-	
-	fr.nbytes = fr.data.size;
-	fr.offset += fr.data.length;
-	ioproc->Add(&fr);
+	static int (*real)(int, struct epoll_event*, int, int) = NULL;
+
+	if (real == NULL)
+		real = (int (*)(int, struct epoll_event*, int, int)) dlsym(RTLD_NEXT, "epoll_wait");
+	if (counting)
+		numEpollWait++;
+	return real(epfd, events, maxevents, timeout);
 }
 
-int main(int argc, char* argv[])
+extern "C" ssize_t read(int fd, void* buf, size_t count)
 {
-	EventLoop*	eventloop;
-	char*		filename = "test.txt";
-#ifdef PLATFORM_DARWIN
-	const int	DIRECT_MODE = 0;
-#else
-	const int	DIRECT_MODE = 0;
-#endif
-	
-	if (argc > 2)
+	static ssize_t (*real)(int, void*, size_t) = NULL;
+
+	if (real == NULL)
+		real = (ssize_t (*)(int, void*, size_t)) dlsym(RTLD_NEXT, "read");
+	if (counting)
+		numRead++;
+	return real(fd, buf, count);
+}
+
+extern "C" ssize_t write(int fd, const void* buf, size_t count)
+{
+	static ssize_t (*real)(int, const void*, size_t) = NULL;
+
+	if (real == NULL)
+		real = (ssize_t (*)(int, const void*, size_t)) dlsym(RTLD_NEXT, "write");
+	if (counting)
+		numWrite++;
+	return real(fd, buf, count);
+}
+
+class EchoServer
+{
+public:
+	EchoServer() :
+	onAccept(this, &EchoServer::OnAccept),
+	onRead(this, &EchoServer::OnRead),
+	onWrite(this, &EchoServer::OnWrite),
+	onClose(this, &EchoServer::OnClose)
+	{
+	}
+
+	bool Init(int port)
+	{
+		if (!listener.Create(Socket::TCP) || !listener.Listen(port))
+			return false;
+		listener.SetNonblocking();
+
+		listen.fd = listener.fd;
+		listen.listening = true;
+		listen.onComplete = &onAccept;
+
+		return IOProcessor::Add(&listen);
+	}
+
+	void OnAccept()
+	{
+		listener.Accept(&conn);
+		conn.SetNonblocking();
+
+		tcpread.fd = conn.fd;
+		tcpread.data.buffer = readBuffer;
+		tcpread.data.size = sizeof(readBuffer);
+		tcpread.data.length = 0;
+		tcpread.requested = REQUEST_SIZE;
+		tcpread.onComplete = &onRead;
+		tcpread.onClose = &onClose;
+
+		tcpwrite.fd = conn.fd;
+		tcpwrite.data.buffer = writeBuffer;
+		tcpwrite.data.size = sizeof(writeBuffer);
+		tcpwrite.onComplete = &onWrite;
+		tcpwrite.onClose = &onClose;
+
+		IOProcessor::Add(&tcpread);
+	}
+
+	void OnRead()
+	{
+		memcpy(writeBuffer, readBuffer, REQUEST_SIZE);
+		tcpwrite.data.length = REQUEST_SIZE;
+		tcpwrite.transferred = 0;
+		IOProcessor::Add(&tcpwrite);
+
+		tcpread.data.length = 0;
+		IOProcessor::Add(&tcpread);
+	}
+
+	void OnWrite()
+	{
+	}
+
+	void OnClose()
 	{
-		filename = argv[1];
+		if (tcpread.active)
+			IOProcessor::Remove(&tcpread);
+		if (tcpwrite.active)
+			IOProcessor::Remove(&tcpwrite);
+		conn.Close();
+		listener.Close();
+		EventLoop::Stop();
 	}
-	
-	ioproc = IOProcessor::Get();
-	eventloop = new EventLoop(ioproc);
-	
-	ioproc->Init();
-		
-	for (int i = 0; i < ba.size - 1; i++)
-		ba.buffer[i] = c;
-	ba.buffer[ba.size - 1] = '\n';
-	ba.length = ba.size;
-	
-	if ((fw.fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC | DIRECT_MODE, 0600)) < 0)
+
+	Socket				listener;
+	Socket				conn;
+	TCPRead				listen;
+	TCPRead				tcpread;
+	TCPWrite			tcpwrite;
+	char				readBuffer[REQUEST_SIZE];
+	char				writeBuffer[REQUEST_SIZE];
+	MFunc<EchoServer>	onAccept;
+	MFunc<EchoServer>	onRead;
+	MFunc<EchoServer>	onWrite;
+	MFunc<EchoServer>	onClose;
+};
+
+static void* Client(void* arg)
+{
+	struct sockaddr_in	sa;
+	char				buf[REQUEST_SIZE];
+	int					fd;
+	int					i;
+	int					n;
+	int					nread;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((intptr_t) arg);
+	sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(fd, (struct sockaddr*) &sa, sizeof(sa)) < 0)
 	{
-		Log_Errno();
-		return 1;
+		close(fd);
+		return NULL;
 	}
-	
-	fw.data = ba;
-	fw.nbytes = ba.length;
-	CFunc onFileWrite(&OnFileWrite);
-	fw.onComplete = &onFileWrite;
-	ioproc->Add(&fw);
-	/*
-	
-	if ((fr.fd = open(filename, O_RDONLY)) < 0)
+
+	memset(buf, 'x', sizeof(buf));
+	for (i = 0; i < NUM_REQUESTS; i++)
 	{
-		Log_Errno();
-		return 1;
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+			break;
+		for (n = 0; n < REQUEST_SIZE; n += nread)
+		{
+			nread = read(fd, buf + n, sizeof(buf) - n);
+			if (nread <= 0)
+				break;
+		}
 	}
-	
-	fr.data = ba;
-	fr.nbytes = ba.size;
-	CFunc onFileRead(&OnFileRead);
-	fr.onComplete = &onFileRead;
-	ioproc->Add(&fr);
-	*/
-	
-	eventloop->Run();	
+
+	close(fd);
+	return NULL;
 }
+
+static int IOBenchmark(const char* name, int flags, int port)
+{
+	EchoServer	server;
+	pthread_t	client;
+	uint64_t	start;
+	uint64_t	elapsed;
+	unsigned	total;
+
+	if (!IOProcessor::Init(1024, false, flags))
+		return TEST_FAILURE;
+	EventLoop::Init();
+	if (!server.Init(port))
+		return TEST_FAILURE;
+
+	numEpollCtl = numEpollWait = numRead = numWrite = 0;
+	counting = true;
+	start = NowMicro();
+	pthread_create(&client, NULL, Client, (void*) (intptr_t) port);
+	EventLoop::Run();
+	elapsed = NowMicro() - start;
+	counting = false;
+	pthread_join(client, NULL);
+
+	total = numEpollCtl + numEpollWait + numRead + numWrite;
+	TEST_LOG("%s: %d requests: %" PRIu64 " usec, %.2f syscalls/request "
+			 "(epoll_ctl %u, epoll_wait %u, read %u, write %u)",
+			 name, NUM_REQUESTS, elapsed, (double) total / NUM_REQUESTS,
+			 numEpollCtl, numEpollWait, numRead, numWrite);
+
+	EventLoop::Shutdown();
+	IOProcessor::Shutdown();
+
+	return TEST_SUCCESS;
+}
+
+int IOLevelTriggeredBenchmark()
+{
+	return IOBenchmark("one-shot", 0, 17771);
+}
+
+int IOEdgeTriggeredBenchmark()
+{
+	return IOBenchmark("edge-triggered", IO_EDGE_TRIGGERED, 17772);
+}
+
+TEST_MAIN(IOLevelTriggeredBenchmark, IOEdgeTriggeredBenchmark);
@@ -0,0 +1,163 @@
+#include "Test.h"
+#include "System/Events/TimerWheel.h"
+#include "System/Containers/SortedList.h"
+#include "System/Time.h"
+#include <stdlib.h>
+
+#define NUM_TIMERS		10000
+#define NUM_RESETS		20000
+#define MAX_DELAY		(60*1000)
+
+static int RandomDelay(int max)
+{
+	return (int) (((double) rand() / RAND_MAX) * max);
+}
+
+int TimerWheelOrderTest()
+{
+	TimerWheel	wheel;
+	Timer*		timers;
+	Timer*		timer;
+	uint64_t	start;
+	uint64_t	now;
+	uint64_t	last;
+	long		wait;
+	int			i;
+	int			numFired;
+	int			numRemoved;
+
+	srand(0);
+	timers = new Timer[NUM_TIMERS];
+	start = Now();
+
+	// spread over every level, some beyond the last one
+	for (i = 0; i < NUM_TIMERS; i++)
+	{
+		if (i % 100 == 0)
+			timers[i].Set(start + ((uint64_t) 1 << 33) + i);
+		else
+			timers[i].Set(start + ((uint64_t) 1 << (i % 28)) + RandomDelay(1000));
+		wheel.Add(&timers[i]);
+	}
+
+	numRemoved = 0;
+	for (i = 0; i < NUM_TIMERS; i += 3)
+	{
+		wheel.Remove(&timers[i]);
+		numRemoved++;
+	}
+
+	numFired = 0;
+	last = 0;
+	now = start;
+	while (true)
+	{
+		while ((timer = wheel.Next(now)) != NULL)
+		{
+			if (timer->When() != now || timer->When() < last)
+			{
+				TEST_LOG("timer due at %" PRIu64 " fired at %" PRIu64,
+						 timer->When(), now);
+				return TEST_FAILURE;
+			}
+			last = timer->When();
+			wheel.Remove(timer);
+			numFired++;
+		}
+
+		wait = wheel.GetWait(now);
+		if (wait < 0)
+			break;
+		now += (wait == 0 ? 1 : wait);
+	}
+
+	delete[] timers;
+
+	if (numFired + numRemoved != NUM_TIMERS)
+	{
+		TEST_LOG("fired %d, removed %d", numFired, numRemoved);
+		return TEST_FAILURE;
+	}
+
+	return TEST_SUCCESS;
+}
+
+// the connection timeouts of the event loop: each timer is reset
+// many times and rarely fires
+
+int TimerWheelBenchmark()
+{
+	TimerWheel	wheel;
+	Timer*		timers;
+	uint64_t	start;
+	uint64_t	now;
+	int			i;
+
+	srand(0);
+	timers = new Timer[NUM_TIMERS];
+	now = Now();
+
+	start = NowMicro();
+	for (i = 0; i < NUM_TIMERS; i++)
+	{
+		timers[i].Set(now + RandomDelay(MAX_DELAY));
+		wheel.Add(&timers[i]);
+	}
+	for (i = 0; i < NUM_RESETS; i++)
+	{
+		wheel.Remove(&timers[i % NUM_TIMERS]);
+		timers[i % NUM_TIMERS].Set(now + RandomDelay(MAX_DELAY));
+		wheel.Add(&timers[i % NUM_TIMERS]);
+	}
+	for (i = 0; i < NUM_TIMERS; i++)
+		wheel.Remove(&timers[i]);
+
+	TEST_LOG("TimerWheel: %d timers, %d resets: %" PRIu64 " usec",
+			 NUM_TIMERS, NUM_RESETS, NowMicro() - start);
+
+	delete[] timers;
+
+	return TEST_SUCCESS;
+}
+
+int SortedListBenchmark()
+{
+	SortedList<Timer*>	list;
+	Timer*				timers;
+	Timer*				timer;
+	uint64_t			start;
+	uint64_t			now;
+	int					i;
+
+	srand(0);
+	timers = new Timer[NUM_TIMERS];
+	now = Now();
+
+	start = NowMicro();
+	for (i = 0; i < NUM_TIMERS; i++)
+	{
+		timers[i].Set(now + RandomDelay(MAX_DELAY));
+		list.Add(&timers[i]);
+	}
+	for (i = 0; i < NUM_RESETS; i++)
+	{
+		timer = &timers[i % NUM_TIMERS];
+		list.Remove(timer);
+		timer->Set(now + RandomDelay(MAX_DELAY));
+		list.Add(timer);
+	}
+	for (i = 0; i < NUM_TIMERS; i++)
+	{
+		timer = &timers[i];
+		list.Remove(timer);
+	}
+
+	TEST_LOG("SortedList: %d timers, %d resets: %" PRIu64 " usec",
+			 NUM_TIMERS, NUM_RESETS, NowMicro() - start);
+
+	delete[] timers;
+
+	return TEST_SUCCESS;
+}
+
+TEST_MAIN(TimerWheelOrderTest, TimerWheelBenchmark, SortedListBenchmark);